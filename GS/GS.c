@@ -1,23 +1,157 @@
+#define _GNU_SOURCE  // recvmmsg
 #include "../common.h"
 #include "GS.h"
+#include <fcntl.h>
 
-PlayerGame *player_games = NULL; // Head of the player linked list
+PlayerGame *game_buckets[GAME_BUCKETS]; // Active games hashed by PLID
+PlayerGame *free_games = NULL;          // Unused slots of the shared game table
+PlayerGame *game_table = NULL;          // MAX_PLAYERS slots shared with TCP workers
+int game_fds[MAX_PLAYERS];              // Open game files per slot (io_uring backend), -1 if closed
+RecentGame recent_games[RECENT_GAMES];  // Last game ended per slot, for retransmitted TRY/QUT
 
 int udp_fd, tcp_fd, errcode;
+int control_fd = -1;                    // Handoff socket (--handoff), -1 if disabled
+const char *handoff_path = NULL;
+int handed_off = 0;                     // Sockets given to a new process; draining
 socklen_t addrlen;
 char buffer[MAX_BUFFER_SIZE];
+char reply_tag[7] = "";                 // PLID echoed in UDP replies (ECHO_TOKEN), "" if not asked
+WireRequest request;                    // Current UDP request, decoded from either protocol
 int verbose = 0;
+RateLimiter rate_limiter;               // Per-source UDP limit (--rate, --burst, --trusted-proxy)
+
+// TCP admission control
+int tcp_backlog = TCP_DEFAULT_BACKLOG;
+int tcp_max_workers = TCP_DEFAULT_WORKERS;
+int tcp_queue_limit = TCP_DEFAULT_QUEUE;
+int tcp_workers = 0;                        // Live worker processes
+PendingConn tcp_queue[TCP_QUEUE_MAX];       // Connections waiting for a worker (ring)
+int tcp_queue_head = 0, tcp_queue_len = 0;
+PendingConn tcp_rejects[TCP_REJECT_MAX];    // Rejected connections not answered yet
+int tcp_reject_count = 0;
+unsigned long tcp_rejected = 0;
+pid_t *tcp_worker_pids = NULL;              // tcp_max_workers slots, 0 when free
+volatile sig_atomic_t drain_requested = 0;  // Workers: finish the current request and close
+volatile sig_atomic_t promote_requested = 0; // Replica: take over serving games (SIGUSR2)
+int signal_pipe[2] = { -1, -1 };            // Self-pipe: signal handlers wake up select()
+pid_t compactor_pid = 0;                    // Background archive compactor, 0 when not running
+
+/**
+ * @brief Returns the hash bucket for a PLID.
+ */
+static inline PlayerGame **game_bucket(uint32_t plid) {
+    return &game_buckets[(plid * 2654435761u) >> 22 & (GAME_BUCKETS - 1)];
+}
+
+/**
+ * @brief Maps the shared game table and threads all slots onto the free list.
+ *
+ * Active games live in a MAP_SHARED region so forked TCP workers read the live
+ * state instead of a copy-on-write snapshot taken at fork time. Only the UDP loop
+ * writes to it; every in-memory update of a slot is bracketed by its seqlock.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int init_game_table() {
+    game_table = mmap(NULL, MAX_PLAYERS * sizeof(PlayerGame), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (game_table == MAP_FAILED) {
+        perror("mmap game table");
+        game_table = NULL;
+        return 0;
+    }
+    memset(game_table, 0, MAX_PLAYERS * sizeof(PlayerGame));
+
+    for (int i = MAX_PLAYERS - 1; i >= 0; i--) {
+        game_table[i].next = free_games;
+        free_games = &game_table[i];
+        game_fds[i] = -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Copies a consistent snapshot of the active game for a PLID.
+ *
+ * Safe to call from forked TCP workers while the UDP loop updates the table.
+ *
+ * @param plid The player's ID.
+ * @param out Receives the copy of the game.
+ * @return 1 if the player has an active game, 0 otherwise, -1 if a slot stayed
+ *         mid-update (see SEQLOCK_READ_TRIES).
+ */
+int snapshot_game(uint32_t plid, PlayerGame *out) {
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        PlayerGame *slot = &game_table[i];
+        unsigned seq, tries = 0;
+        int found;
+        do {
+            if (!seqlock_read_begin(&slot->seq, &seq, &tries)) return -1;
+            found = slot->in_use && slot->plid == plid;
+            if (found) memcpy(out, slot, sizeof(PlayerGame));
+        } while (seqlock_read_retry(&slot->seq, seq));
+
+        if (found) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Copies an active game into its fixed-layout snapshot (handoff, replication).
+ *
+ * @param game The active game.
+ * @param snap Receives the snapshot.
+ */
+void capture_game(const PlayerGame *game, GameSnapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    snap->plid = game->plid;
+    snap->mode = game->mode;
+    snap->geometry = game->geometry;
+    snap->current_trial = game->current_trial;
+    snap->secret_key = game->secret_key;
+    memcpy(snap->trials, game->trials, sizeof(snap->trials));
+    snap->total_duration = game->total_duration;
+    snap->remaining_time = game->remaining_time;
+    snap->elapsed_time = game->elapsed_time;
+    snap->last_update_time = game->last_update_time;
+    snap->start_time = game->start_time;
+}
+
+/**
+ * @brief Creates or overwrites the active game described by a snapshot.
+ *
+ * @param snap The snapshot, received from another process.
+ * @return The game, or NULL if the snapshot is invalid or the table is full.
+ */
+PlayerGame *restore_game(const GameSnapshot *snap) {
+    if (snap->geometry >= NUM_GEOMETRIES || snap->plid >= PLID_SPACE || snap->current_trial > MAX_TRIALS + 1) return NULL;
+
+    PlayerGame *game = find_or_create_game(snap->plid, snap->total_duration, snap->mode, snap->geometry);
+    if (!game) return NULL;
+    seqlock_write_begin(&game->seq);
+    game->mode = snap->mode;
+    game->geometry = snap->geometry;
+    game->current_trial = snap->current_trial;
+    game->secret_key = snap->secret_key;
+    memcpy(game->trials, snap->trials, sizeof(game->trials));
+    game->total_duration = snap->total_duration;
+    game->remaining_time = snap->remaining_time;
+    game->elapsed_time = snap->elapsed_time;
+    game->last_update_time = snap->last_update_time;
+    game->start_time = snap->start_time;
+    seqlock_write_end(&game->seq);
+    return game;
+}
 
 /**
  * @brief Retrieves the game associated with the given Player ID (PLID).
  * 
- * @param PLID The player's ID.
+ * @param plid The player's ID.
  * @return Pointer to the PlayerGame structure or NULL if not found.
  */
-PlayerGame *get_game(const char *PLID) {
-    PlayerGame *current = player_games;
+PlayerGame *get_game(uint32_t plid) {
+    PlayerGame *current = *game_bucket(plid);
     while (current != NULL) {
-        if (strcmp(current->PLID, PLID) == 0) {
+        if (current->plid == plid) {
             return current;
         }
         current = current->next;
@@ -28,565 +162,919 @@ PlayerGame *get_game(const char *PLID) {
 /**
  * @brief Finds an existing game for the given PLID or creates a new one.
  * 
- * @param PLID The player's ID.
- * @param time_str The total time allowed for the game.
- * @param mode The mode of the game ("PLAY" or "DEBUG").
+ * @param plid The player's ID.
+ * @param total_duration The total time allowed for the game, in seconds.
+ * @param mode The mode of the game (MODE_PLAY or MODE_DEBUG).
+ * @param geometry Index of the game's geometry in geometries[].
  * @return Pointer to the newly created or existing PlayerGame structure.
  */
-PlayerGame *find_or_create_game(const char *PLID, const char *time_str, const char *mode) {
-    PlayerGame *game = get_game(PLID);
+PlayerGame *find_or_create_game(uint32_t plid, int total_duration, uint8_t mode, uint8_t geometry) {
+    PlayerGame *game = get_game(plid);
     if (game) return game;
 
-    PlayerGame *new_game = (PlayerGame *)malloc(sizeof(PlayerGame));
+    PlayerGame *new_game = free_games;
     if (!new_game) {
-        perror("Memory allocation failed");
+        printf("[!] Game table full (%d active games).\n", MAX_PLAYERS);
         return NULL;
     }
-    
-    strcpy(new_game->PLID, PLID);
-    strcpy(new_game->mode, mode);
-    memset(new_game->secret_key, 0, sizeof(new_game->secret_key));
-    
-    new_game->remaining_time = 0;
+    free_games = new_game->next;
+
+    PlayerGame **bucket = game_bucket(plid);
+    time_t now = gs_clock.now;
+
+    seqlock_write_begin(&new_game->seq);
+    new_game->plid = plid;
+    new_game->mode = mode;
+    new_game->geometry = geometry;
+    new_game->secret_key = 0;
+    new_game->remaining_time = total_duration;
     new_game->current_trial = 1;
-    new_game->expected_trial = 1;
-    new_game->next = player_games;
-    new_game->total_duration = atoi(time_str);
+    new_game->next = *bucket;
+    new_game->total_duration = total_duration;
     new_game->elapsed_time = 0;
-    new_game->start_time = time(NULL);
-    new_game->last_update_time = time(NULL);
-    player_games = new_game;
+    new_game->start_time = now;
+    new_game->last_update_time = now;
+    new_game->in_use = 1;
+    seqlock_write_end(&new_game->seq);
+    *bucket = new_game;
 
     return new_game;
 }
 
 /**
- * @brief Ends the game for the specified Player ID (PLID) and updates the game file.
+ * @brief Writes a line to the game file of an active game.
+ *
+ * With the io_uring backend the file stays open for the whole game (game_fds) and
+ * the line is queued as an append; otherwise, or once game files would take
+ * descriptors from the top GAME_FD_HEADROOM under FD_SETSIZE, it is written
+ * through stdio.
  * 
- * @param PLID The player's ID.
+ * @param game The active game.
+ * @param text The line to write.
+ * @param len Length of the line.
+ * @param create Start a new file instead of appending.
+ */
+static void write_game_file(const PlayerGame *game, const char *text, size_t len, int create) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "GAMES/GAME_%06u.txt", game->plid);
+
+    if (uring_active) {
+        int *fd = &game_fds[game - game_table];
+        if (create && *fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+        if (*fd == -1) {
+            // Games taken over from another process have no descriptor yet
+            *fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC | (create ? O_TRUNC : 0), 0666);
+            // Sockets select() watches must stay below FD_SETSIZE; leave them room
+            if (*fd >= FD_SETSIZE - GAME_FD_HEADROOM) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        if (*fd != -1) {
+            if (!uring_write(*fd, text, len) && write(*fd, text, len) != (ssize_t)len) {
+                perror("Failed to write game file");
+            }
+            return;
+        }
+        // Out of (low) descriptors: fall back to stdio for this line
+    }
+
+    FILE *file = fopen(filename, create ? "w" : "a");
+    if (!file) {
+        perror(create ? "Failed to create game file for player" : "Failed to open game file for player");
+        return;
+    }
+    fwrite(text, 1, len, file);
+    fclose(file);
+}
+
+/**
+ * @brief Closes the game file kept open by the io_uring backend once its appends are done.
+ * 
+ * @param game The game being removed.
+ */
+static void release_game_file(const PlayerGame *game) {
+    int *fd = &game_fds[game - game_table];
+    if (*fd == -1) return;
+    uring_flush_writes();
+    close(*fd);
+    *fd = -1;
+}
+
+/**
+ * @brief Ends the game for the specified Player ID (PLID) and archives the game file.
+ *
+ * The end line is appended to the game file, whose contents then move into the
+ * player's archive (GAMES/<PLID>.arc).
+ * 
+ * @param plid The player's ID.
  * @param status The status of the game (WIN, FAIL, QUIT, or TIMEOUT).
  * @param start_time The start time of the game.
  */
-void end_game_file(const char *PLID, const char *status, time_t start_time) {
+void end_game_file(uint32_t plid, const char *status, time_t start_time) {
     char filename[64];
-    snprintf(filename, sizeof(filename), "GAMES/GAME_%s.txt", PLID);
+    snprintf(filename, sizeof(filename), "GAMES/GAME_%06u.txt", plid);
 
-    FILE *file = fopen(filename, "a");
+    FILE *file = fopen(filename, "a+");
     if (!file) {
         perror("Failed to open game file for final update");
         return;
     }
 
-    time_t now = time(NULL);
+    time_t now = gs_clock.now;
     int game_duration = (int)(now - start_time);
-    struct tm *t = localtime(&now);
-
-    char end_date[11];
-    char end_time[9];
-    strftime(end_date, sizeof(end_date), "%Y-%m-%d", t);
-    strftime(end_time, sizeof(end_time), "%H:%M:%S", t);
-
-    fprintf(file, "%s %s %d", end_date, end_time, game_duration);
-    fclose(file);
 
-    char player_dir[64];
-    snprintf(player_dir, sizeof(player_dir), "GAMES/%s", PLID);
+    fprintf(file, "%s %s %d", gs_clock.date, gs_clock.time, game_duration);
+    fflush(file);
 
-    struct stat st = {0};
-    if (stat(player_dir, &st) == -1) {
-        if (mkdir(player_dir, 0777) == -1) {
-            perror("Failed to create player directory");
-            return;
-        }
-        printf("[*] Created player directory: %s\n", player_dir);
+    // Read the finished file back and move it into the archive
+    long size = ftell(file);
+    char *text = size > 0 ? malloc(size) : NULL;
+    size_t len = 0;
+    if (text) {
+        rewind(file);
+        len = fread(text, 1, size, file);
     }
+    fclose(file);
 
-    char new_filename[128];
-    char end_datetime[32];
-    strftime(end_datetime, sizeof(end_datetime), "%Y%m%d_%H%M%S", t);
-    snprintf(new_filename, sizeof(new_filename), "GAMES/%s/%s_%s.txt", PLID, end_datetime, status);
-
-    if (rename(filename, new_filename) == -1) {
-        perror("Failed to move and rename game file");
+    if (len == 0 || !archive_append(plid, text, len, now, status[0])) {
+        printf("[!] Could not archive %s; left in place.\n", filename);
+        free(text);
         return;
     }
+    free(text);
+    unlink(filename);
 
-    printf("[*] Game file moved to: %s\n", new_filename);
+    if (verbose) printf("[*] Game file archived to: GAMES/%06u.arc\n", plid);
 }
 
 
 /**
  * @brief Removes a game for the given Player ID (PLID) and performs cleanup.
  * 
- * @param PLID The player's ID.
+ * @param plid The player's ID.
  * @param status The status of the game (WIN, FAIL, QUIT, or TIMEOUT).
  */
-void remove_game(const char *PLID, const char *status) {
-    PlayerGame *current = player_games;
-    PlayerGame *previous = NULL;
-
-    while (current != NULL) {
-        if (strcmp(current->PLID, PLID) == 0) {
-            if (previous == NULL) {
-                player_games = current->next; 
-            } else {
-                previous->next = current->next; 
-            }
-
-            end_game_file(PLID, status, current->start_time);
-            free(current);
+void remove_game(uint32_t plid, const char *status) {
+    PlayerGame **link = game_bucket(plid);
+
+    while (*link != NULL) {
+        PlayerGame *current = *link;
+        if (current->plid == plid) {
+            *link = current->next;
+            replicate_end(plid, status[0]);
+
+            release_game_file(current);
+            end_game_file(plid, status, current->start_time);
+
+            seqlock_write_begin(&current->seq);
+            current->in_use = 0;
+            seqlock_write_end(&current->seq);
+            current->next = free_games;
+            free_games = current;
             return;
         }
-        previous = current;
-        current = current->next;
+        link = &current->next;
     }
 }
 
 /**
- * @brief Creates a new game file for the specified player.
+ * @brief Creates a new game file for the specified game.
  * 
- * @param PLID The player's ID.
- * @param time_str The maximum time for the game.
- * @param secret_key The secret key for the game.
- * @param mode The mode of the game ("PLAY" or "DEBUG").
+ * @param game The newly created game.
  */
-void create_game_file(const char *PLID, const char *time_str, const char *secret_key, const char *mode){
-    char filename[64];
-    snprintf(filename, sizeof(filename), "GAMES/GAME_%s.txt", PLID);
+void create_game_file(PlayerGame *game){
+    char secret_key[CODE_STR_LEN];
+    code_to_string(game->secret_key, geometries[game->geometry].pegs, secret_key);
 
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror("Failed to create game file for player");
-        return;
-    }
+    // The start time, not the clock: a replica recreates the same file
+    CachedClock scratch;
+    const CachedClock *start = clock_at(game->start_time, &scratch);
 
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char timestamp[32];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", t);
-    // Format: PLID mode secret_key time_str timestamp start_time
-    fprintf(file, "%s %s %s %s %s %ld\n", PLID, mode, secret_key, time_str, timestamp, (long)now);
-    fclose(file);
+    // Format: PLID mode secret_key time_str date time start_time
+    char line[MAX_BUFFER_SIZE];
+    int len = snprintf(line, sizeof(line), "%06u %s %s %03d %s %s %ld\n", game->plid, game->mode == MODE_DEBUG ? "D" : "PLAY",
+                       secret_key, game->total_duration, start->date, start->time, (long)game->start_time);
+    write_game_file(game, line, len, 1);
+    replicate_game(REPL_START, game);
 }
 
 /**
  * @brief Updates the game file with the result of a player's guess.
  * 
- * @param PLID The player's ID.
+ * @param game The player's active game.
  * @param guess The player's guess for the secret key.
  * @param time_elapsed The time elapsed for this trial.
  * @param nB Number of black pegs (correct color and position).
  * @param nW Number of white pegs (correct color, wrong position).
  */
-void update_game_file(const char *PLID, const char *guess, int time_elapsed, int nB, int nW){
-    char filename[64];
-    snprintf(filename, sizeof(filename), "GAMES/GAME_%s.txt", PLID);
+void update_game_file(const PlayerGame *game, Code guess, int time_elapsed, int nB, int nW){
+    char guess_str[CODE_STR_LEN];
+    code_to_string(guess, geometries[game->geometry].pegs, guess_str);
 
-    FILE *file = fopen(filename, "a");
-    if (!file) {
-        perror("Failed to open game file for player");
-        return;
+    char line[MAX_BUFFER_SIZE];
+    int len = snprintf(line, sizeof(line), "T: %s %d %d %d\n", guess_str, nB, nW, time_elapsed);
+    write_game_file(game, line, len, 0);
+    replicate_trial(game, guess, nB, nW, time_elapsed);
+}
+
+/**
+ * @brief Sends a datagram to a client (through the ring with --io-uring).
+ *
+ * The reply is complete at this point, which ends its TRACE_RENDER phase.
+ */
+static void send_datagram(struct sockaddr_in *addr, const void *data, size_t len) {
+    trace_mark(TRACE_RENDER);
+    if (!uring_active || !uring_send(data, len, addr)) {
+        sendto(udp_fd, data, len, 0, (struct sockaddr *)addr, addrlen);
     }
+    trace_mark(TRACE_SEND);
+}
 
-    fprintf(file, "T: %s %d %d %d\n", guess, nB, nW, time_elapsed);
-    fclose(file);
+/**
+ * @brief Sends a UDP reply, tagged with the request's PLID if the client asked for it.
+ *
+ * A tagged reply carries the PLID as an extra last field ("RSG OK 123456\n"), so a
+ * client running many sessions over one socket can tell whose reply it is.
+ * 
+ * @param addr Address of the client.
+ * @param reply The newline-terminated reply.
+ * @param len Length of the reply.
+ */
+void send_udp_reply(struct sockaddr_in *addr, const char *reply, size_t len) {
+    char tagged[MAX_BUFFER_SIZE + 8];
+    if (reply_tag[0] && len > 0 && len < MAX_BUFFER_SIZE && reply[len - 1] == '\n') {
+        len = snprintf(tagged, sizeof(tagged), "%.*s %s\n", (int)(len - 1), reply, reply_tag);
+        reply = tagged;
+    }
+    send_datagram(addr, reply, len);
+}
+
+/**
+ * @brief Answers the current UDP request in the protocol it came in.
+ *
+ * A binary request gets a reply frame echoing its ID and PLID; a text request the
+ * v1 line ("RTR OK 2 1 0\n"), tagged if it asked for it.
+ *
+ * @param addr Address of the client.
+ * @param reply The reply; version, op, ID and PLID are filled in here.
+ * @param pegs Length of the key in reply->code (ENT, ETM, QUT OK).
+ */
+void send_reply(struct sockaddr_in *addr, WireReply *reply, int pegs) {
+    reply->version = WIRE_VERSION;
+    reply->op = request.op;
+    reply->id = request.id;
+    reply->plid = request.plid;
+    if (request.version == WIRE_VERSION) {
+        uint8_t frame[WIRE_FRAME_LEN];
+        wire_encode_reply(reply, frame);
+        send_datagram(addr, frame, sizeof(frame));
+    } else {
+        char text[MAX_BUFFER_SIZE];
+        send_udp_reply(addr, text, wire_reply_text(reply, pegs, text, sizeof(text)));
+    }
+    if (verbose) {
+        printf("UDP sent to %s:%d: %s %s; PLID = %06u\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port),
+               wire_reply_code(reply->op), wire_status(reply->status), request.plid <= WIRE_PLID_MAX ? request.plid : 0);
+    }
+}
+
+/**
+ * @brief Answers the current UDP request with a bare status ("RSG OK", "RTR ERR").
+ */
+static void send_status(struct sockaddr_in *addr, uint8_t status) {
+    WireReply reply = { .status = status };
+    send_reply(addr, &reply, 0);
+}
+
+/**
+ * @brief Removes the echo token from the request in buffer and remembers its PLID.
+ *
+ * Clients append ECHO_TOKEN (" E") to ask for replies tagged with the PLID; the
+ * request is then handled exactly as without it.
+ */
+static void take_echo_token() {
+    size_t len = strlen(buffer);
+    size_t end = (len > 0 && buffer[len - 1] == '\n') ? len - 1 : len;
+    size_t tlen = strlen(ECHO_TOKEN);
+    char plid[7];
+
+    reply_tag[0] = '\0';
+    if (end <= tlen || strncmp(buffer + end - tlen, ECHO_TOKEN, tlen) != 0) return;
+    strcpy(buffer + end - tlen, end < len ? "\n" : "");
+    if (sscanf(buffer, "%*3s %6s", plid) == 1 && validate_plid(plid)) {
+        strcpy(reply_tag, plid);
+    }
 }
 
 /**
  * @brief Checks if the game time has expired and updates the game's elapsed time.
  * 
- * @param PLID The player's ID.
+ * @param plid The player's ID.
  * @param addr Address of the client (used for UDP communication).
- * @param client_fd TCP client file descriptor.
- * @param is_udp Flag indicating if the communication is via UDP.
  * @param command_type The type of command being processed (e.g., "TRY", "SNG").
  * @return 1 if the game is ongoing, -1 if the game has expired, 0 if no game exists.
  */
-int check_and_update_game_time(const char *PLID, struct sockaddr_in *addr, int client_fd, int is_udp, const char *command_type) {
-    PlayerGame *game = get_game(PLID);
+int check_and_update_game_time(uint32_t plid, struct sockaddr_in *addr, const char *command_type) {
+    PlayerGame *game = get_game(plid);
     if (!game) {
         return 0; 
     }
 
-    time_t current_time = time(NULL);
+    time_t current_time = gs_clock.now;
     int time_elapsed = (int)(current_time - game->last_update_time);
+    seqlock_write_begin(&game->seq);
     game->elapsed_time += time_elapsed;
     game->remaining_time -= time_elapsed;
     game->last_update_time = current_time;
+    seqlock_write_end(&game->seq);
 
     if (game->remaining_time <= 0) {
-        char formatted_key[8];
-        format_secret_key(formatted_key, game->secret_key);
-        if (strcmp(command_type, "TRY") == 0) {
-            // SEND RTR ETM
-            if (is_udp && addr != NULL) {
-                snprintf(buffer, MAX_BUFFER_SIZE, "RTR ETM %s\n", formatted_key);
-                sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
-                if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR EM", PLID);}
-            }
+        if (strcmp(command_type, "TRY") == 0 && addr != NULL) {
+            WireReply reply = { .status = WIRE_ETM, .code = game->secret_key };
+            send_reply(addr, &reply, geometries[game->geometry].pegs);
         }
-        remove_game(PLID, TIMEOUT);
+        remove_game(plid, TIMEOUT);
         return -1; // time up
     }
 
     return 1; // ongoing
 }
 
+/**
+ * @brief Splits a request line into whitespace-separated fields, in place.
+ * 
+ * @param line The line to split (modified).
+ * @param fields Receives pointers to the fields.
+ * @param max Capacity of fields.
+ * @return The number of fields, or -1 if the line has more than max.
+ */
+static int split_fields(char *line, char **fields, int max) {
+    int n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(line, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save)) {
+        if (n == max) return -1;
+        fields[n++] = tok;
+    }
+    return n;
+}
+
+/**
+ * @brief Checks that a field is a non-empty string of digits.
+ */
+static int is_number(const char *field) {
+    return field[0] != '\0' && strspn(field, "0123456789") == strlen(field);
+}
+
+/**
+ * @brief Reads a small number field (pegs, colors, trial number).
+ *
+ * @return The number, or max if the field is not a number up to max.
+ */
+static int small_number(const char *field, int max) {
+    if (!is_number(field) || strlen(field) > 5) return max;
+    int value = atoi(field);
+    return value < max ? value : max;
+}
+
+/**
+ * @brief Packs one-letter color fields into a code.
+ * 
+ * @param fields The color fields.
+ * @param n The number of fields.
+ * @return The code, or CODE_INVALID if a field is not a single color letter.
+ *         Whether the colors fit the game is checked with code_valid.
+ */
+static Code pack_color_fields(char **fields, int n) {
+    Code code = 0;
+    for (int i = 0; i < n; i++) {
+        int color = fields[i][0] != '\0' && fields[i][1] == '\0' ? color_index(fields[i][0]) : -1;
+        if (color < 0) return CODE_INVALID;
+        code |= (Code)color << (CODE_BITS * i);
+    }
+    return code;
+}
+
+/**
+ * @brief Decodes the text request in buffer into request.
+ *
+ * "SNG PLID time [P C]", "TRY PLID C1 ... Cn nT", "DBG PLID time C1 ... Cn [P C]"
+ * and "QUT PLID"; without P and C the classic 4-peg, 6-color game is meant. Fields
+ * that do not parse are left invalid (PLID above WIRE_PLID_MAX, play time 0,
+ * CODE_INVALID, no geometry), so that text and binary requests go through the
+ * same checks.
+ *
+ * @param op The command, one of the WIRE_* ops.
+ */
+static void parse_text_request(int op) {
+    char line[MAX_BUFFER_SIZE], PLID[7];
+    char *fields[MAX_PEGS + 5];
+    strcpy(line, buffer);
+    int n = split_fields(line, fields, MAX_PEGS + 5);
+
+    memset(&request, 0, sizeof(request));
+    request.version = 1;
+    request.op = op;
+    request.plid = UINT32_MAX;
+    request.code = CODE_INVALID;
+    if (op != WIRE_QUT && n >= 2 && !parse_plid(fields[1], &request.plid)) request.plid = UINT32_MAX;
+
+    if (op == WIRE_SNG && n >= 3) {
+        request.arg = validate_play_time(fields[2]) ? atoi(fields[2]) : 0;
+        if (n == 3) {
+            request.pegs = COLOR_SEQUENCE_LEN;
+            request.colors = NUM_COLORS;
+        } else if (n == 5) {
+            request.pegs = small_number(fields[3], 0xff);
+            request.colors = small_number(fields[4], 0xff);
+        }
+    } else if (op == WIRE_TRY && n >= 4 && n - 3 <= MAX_PEGS && is_number(fields[n - 1])) {
+        request.pegs = n - 3;
+        request.arg = small_number(fields[n - 1], 0xffff);
+        request.code = pack_color_fields(fields + 2, n - 3);
+    } else if (op == WIRE_DBG && n >= 3) {
+        request.arg = validate_play_time(fields[2]) ? atoi(fields[2]) : 0;
+        // Trailing numeric fields select the geometry; the rest are the key's colors
+        int extra = n >= 5 && is_number(fields[n - 1]) && is_number(fields[n - 2]) ? 2 : 0;
+        request.pegs = extra ? small_number(fields[n - 2], 0xff) : COLOR_SEQUENCE_LEN;
+        request.colors = extra ? small_number(fields[n - 1], 0xff) : NUM_COLORS;
+        if (n - 3 - extra == request.pegs) request.code = pack_color_fields(fields + 3, request.pegs);
+    } else if (op == WIRE_QUT) {
+        if (sscanf(buffer, "QUT %6s", PLID) != 1 || !parse_plid(PLID, &request.plid)) request.plid = UINT32_MAX;
+    }
+}
+
+/**
+ * @brief Checks the play time of a SNG/DBG request.
+ */
+static int valid_play_time(int time) {
+    return time > 0 && time <= MAX_PLAYTIME;
+}
+
+/**
+ * @brief Checks whether two requests came from the same address and port.
+ */
+static int same_source(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/**
+ * @brief Checks whether a SNG/DBG repeats the request that started the player's game.
+ *
+ * A retransmission whose OK was lost comes from the same source and finds a game
+ * of the same mode, geometry and play time (and key, for DBG) with no trial made yet.
+ */
+static int repeats_start(const PlayerGame *game, uint8_t mode, int geometry, const struct sockaddr_in *addr) {
+    return game->mode == mode && game->geometry == geometry && game->total_duration == request.arg &&
+           game->current_trial == 1 && (mode != MODE_DEBUG || game->secret_key == request.code) &&
+           same_source(&game->source, addr);
+}
+
 /**
  * @brief Processes the START command from the player.
+ *
+ * Starts a game of the requested geometry (pegs x colors) for request.arg seconds.
+ * A SNG repeating the one that started the current game is answered OK again.
  * 
  * @param addr Address of the client sending the command.
  */
 void process_start_command(struct sockaddr_in *addr) {
-    char PLID[7], time_str[16];
-    int sscount = sscanf(buffer, "SNG %6s %15s", PLID, time_str);
-    if (sscount != 2 || !validate_plid(PLID) || !validate_play_time(time_str)) {
-        sendto(udp_fd, "RSG ERR\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSG ERR", PLID);}
+    uint32_t plid = request.plid;
+    int geometry = geometry_find(request.pegs, request.colors);
+    if (geometry < 0 || plid > WIRE_PLID_MAX || !valid_play_time(request.arg)) {
+        send_status(addr, WIRE_ERR);
         return;
     }
 
-    int time_status = check_and_update_game_time(PLID, addr, -1, 1, "SNG");
+    int time_status = check_and_update_game_time(plid, addr, "SNG");
     if (time_status == -1) {
         // Time up. Just create new game anyway (following original logic)
-        PlayerGame *game = find_or_create_game(PLID, time_str, "PLAY");
-        game->remaining_time = atoi(time_str);
-        generate_secret_key(game->secret_key);
+        PlayerGame *game = find_or_create_game(plid, request.arg, MODE_PLAY, geometry);
+        if (!game) {
+            send_status(addr, WIRE_ERR);
+            return;
+        }
+        seqlock_write_begin(&game->seq);
+        game->secret_key = generate_secret_key(geometry);
+        game->source = *addr;
+        seqlock_write_end(&game->seq);
         
-        sendto(udp_fd, "RSG OK\n", 7, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSG OK", PLID);}
+        send_status(addr, WIRE_OK);
         return;
     }
 
-    PlayerGame *game = get_game(PLID);
+    PlayerGame *game = get_game(plid);
     if (game) {
-        sendto(udp_fd, "RSG NOK\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSG NOK", PLID);}
+        send_status(addr, repeats_start(game, MODE_PLAY, geometry, addr) ? WIRE_OK : WIRE_NOK);
     } else {
-        game = find_or_create_game(PLID, time_str, "PLAY");
-        game->remaining_time = atoi(time_str);
-        generate_secret_key(game->secret_key);
-        create_game_file(PLID, time_str, game->secret_key,"PLAY");
-        printf("PLID = %s: new game (max %s sec); Colors: %s\n", PLID, time_str, game->secret_key);
-        sendto(udp_fd, "RSG OK\n", 7, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSG OK", PLID);}
+        game = find_or_create_game(plid, request.arg, MODE_PLAY, geometry);
+        if (!game) {
+            send_status(addr, WIRE_ERR);
+            return;
+        }
+        seqlock_write_begin(&game->seq);
+        game->secret_key = generate_secret_key(geometry);
+        game->source = *addr;
+        seqlock_write_end(&game->seq);
+        trace_mark(TRACE_LOOKUP);
+        create_game_file(game);
+        trace_mark(TRACE_PERSIST);
+
+        char secret_key[CODE_STR_LEN];
+        code_to_string(game->secret_key, geometries[geometry].pegs, secret_key);
+        printf("PLID = %06u: new game (max %03d sec); Colors: %s\n", plid, request.arg, secret_key);
+        send_status(addr, WIRE_OK);
     }
 }
 
 
 /**
- * @brief Checks for duplicate player trials for the given guess.
- * 
- * @param PLID The player's ID.
- * @param C1, C2, C3, C4 The 4 colors of the player's guess.
- * @return 1 if the guess is a duplicate, 0 otherwise.
+ * @brief Finds the slot remembering the last game a player ended.
  */
-int check_for_duplicate_trial(const char *PLID, const char *C1, const char *C2, const char *C3, const char *C4) {
-    char filename[64];
-    snprintf(filename, sizeof(filename), "GAMES/GAME_%s.txt", PLID);
+static inline RecentGame *recent_game(uint32_t plid) {
+    return &recent_games[(plid * 2654435761u) >> 16 & (RECENT_GAMES - 1)];
+}
 
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        return 0;
-    }
+/**
+ * @brief Remembers how a game ended, to answer a retransmission of the request that
+ * ended it (whose reply may have been lost) the same way.
+ *
+ * @param game The game, before it is removed.
+ * @param status WIN, FAIL or QUIT.
+ * @param guess The winning or failing guess (CODE_INVALID for QUIT).
+ * @param addr Address of the client that ended it.
+ */
+static void remember_end(const PlayerGame *game, const char *status, Code guess, const struct sockaddr_in *addr) {
+    *recent_game(game->plid) = (RecentGame){
+        .plid = game->plid, .secret_key = game->secret_key, .last_guess = guess, .trial = request.arg,
+        .pegs = geometries[game->geometry].pegs, .status = status[0], .source = *addr, .end_time = gs_clock.now,
+    };
+}
 
-    char line[MAX_BUFFER_SIZE];
-    char player_guess[5];
-    snprintf(player_guess, sizeof(player_guess), "%s%s%s%s", C1, C2, C3, C4);
+/**
+ * @brief Finds the game a player ended from addr within END_REPLAY_WINDOW seconds with status.
+ *
+ * Only the client that ended the game can be retransmitting that request.
+ */
+static const RecentGame *ended_game(uint32_t plid, const char *status, const struct sockaddr_in *addr) {
+    const RecentGame *end = recent_game(plid);
+    if (end->end_time == 0 || end->plid != plid || end->status != status[0] || !same_source(&end->source, addr)) {
+        return NULL;
+    }
+    return gs_clock.now - end->end_time <= END_REPLAY_WINDOW ? end : NULL;
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        if (strncmp(line, "T: ", 3) == 0) {
-            char trial_guess[5];
-            if (sscanf(line, "T: %4s", trial_guess) == 1) {
-                if (strcmp(trial_guess, player_guess) == 0) {
-                    fclose(file);
-                    return 1; 
-                }
-            }
+/**
+ * @brief Checks whether the player already tried the given guess in this game.
+ * 
+ * @param game The player's active game.
+ * @param guess The player's guess.
+ * @return 1 if the guess is a duplicate, 0 otherwise.
+ */
+int check_for_duplicate_trial(const PlayerGame *game, Code guess) {
+    for (int i = 0; i < game->current_trial - 1; i++) {
+        if (game->trials[i] == guess) {
+            return 1;
         }
     }
-
-    fclose(file);
     return 0;
 }
 
 /**
  * @brief Processes the TRY command from the player.
+ *
+ * The guess (request.code, request.pegs colors) must have one color per peg of the
+ * game's geometry; request.arg is the trial number. A TRY that repeats the previous
+ * trial (same number and guess) is a retransmission whose reply was lost; it is
+ * answered again without changing the game. So is the TRY that just won or lost
+ * the game, from the same client, for END_REPLAY_WINDOW seconds after the game ended.
  * 
  * @param addr Address of the client sending the command.
  */
 void process_try_command(struct sockaddr_in *addr) {
-    char PLID[7], C1[2], C2[2], C3[2], C4[2];
-    int nT;
-
-    int scanned = sscanf(buffer, "TRY %6s %1s %1s %1s %1s %d", PLID, C1, C2, C3, C4, &nT);
-    if (scanned != 6) {
-        sendto(udp_fd, "RTR ERR\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR ERR", PLID);}
-        return;
-    }
-    
-    if (!validate_plid(PLID) || !validate_color_sequence(C1, C2, C3, C4)) {
-        sendto(udp_fd, "RTR ERR\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR ERR", PLID);}
+    uint32_t plid = request.plid;
+    if (request.pegs < 1 || request.pegs > MAX_PEGS || plid > WIRE_PLID_MAX) {
+        send_status(addr, WIRE_ERR);
         return;
     }
+    int nT = request.arg;
 
-    int time_status = check_and_update_game_time(PLID, addr, -1, 1, "TRY");
+    int time_status = check_and_update_game_time(plid, addr, "TRY");
     if (time_status == -1) {
         return; // time up handled
     }
 
-    PlayerGame *game = get_game(PLID);
+    PlayerGame *game = get_game(plid);
+    trace_mark(TRACE_LOOKUP);
     if (!game) {
-        sendto(udp_fd, "RTR NOK\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR NOK", PLID);}
+        const RecentGame *end = ended_game(plid, WIN, addr);
+        if (!end) end = ended_game(plid, FAIL, addr);
+        if (end && end->trial == nT && end->pegs == request.pegs && end->last_guess == request.code) {
+            WireReply last = { .status = WIRE_OK, .trial = nT, .nB = end->pegs };
+            if (end->status == FAIL[0]) last = (WireReply){ .status = WIRE_ENT, .code = end->secret_key };
+            send_reply(addr, &last, end->pegs);
+        } else {
+            send_status(addr, WIRE_NOK);
+        }
         return;
     }
 
-    if (game->current_trial > MAX_TRIALS) {
-        char formatted_key[8];
-        format_secret_key(formatted_key, game->secret_key);
-        snprintf(buffer, MAX_BUFFER_SIZE, "RTR ENT %s\n", formatted_key);
-        sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR ENT", PLID);}
-        remove_game(PLID,FAIL);
+    const Geometry *g = &geometries[game->geometry];
+    Code guess = request.pegs == g->pegs && code_valid(g, request.code) ? request.code : CODE_INVALID;
+    if (guess == CODE_INVALID) {
+        send_status(addr, WIRE_ERR);
         return;
     }
 
-    if (check_for_duplicate_trial(PLID, C1, C2, C3, C4)) {
-        snprintf(buffer, MAX_BUFFER_SIZE, "RTR DUP\n");
-        sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR DUP", PLID);}
+    WireReply reply = { .status = WIRE_ENT, .code = game->secret_key };
+    if (game->current_trial > MAX_TRIALS) {
+        send_reply(addr, &reply, g->pegs);
+        remove_game(plid, FAIL);
         return;
     }
 
-    char guess[COLOR_SEQUENCE_LEN + 1] = {C1[0], C2[0], C3[0], C4[0], '\0'};
     int nB, nW;
-    calculate_nB_nW(guess, game->secret_key, &nB, &nW);
+    if (nT == game->current_trial - 1 && nT >= 1 && game->trials[nT - 1] == guess) {
+        g->score(guess, game->secret_key, &nB, &nW);
+        WireReply resend = { .status = WIRE_OK, .trial = nT, .nB = nB, .nW = nW };
+        send_reply(addr, &resend, g->pegs);
+        return;
+    }
 
-    if (game->current_trial != nT || (strcmp(guess, game->last_guess) != 0 && nT == game->expected_trial - 1)) {
-        snprintf(buffer, MAX_BUFFER_SIZE, "RTR INV\n");
-        sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR INV", PLID);}
+    int duplicate = check_for_duplicate_trial(game, guess);
+    trace_mark(TRACE_DUPSCAN);
+    if (duplicate) {
+        send_status(addr, WIRE_DUP);
         return;
     }
 
-    if (game->current_trial >= MAX_TRIALS && nB != 4) {
-        update_game_file(PLID, guess, game->elapsed_time, nB, nW);
+    if (game->current_trial != nT) {
+        send_status(addr, WIRE_INV);
+        return;
+    }
+
+    g->score(guess, game->secret_key, &nB, &nW);
+    trace_mark(TRACE_SCORE);
+    char guess_str[CODE_STR_LEN];
+    code_to_string(guess, g->pegs, guess_str);
+
+    if (game->current_trial >= MAX_TRIALS && nB != g->pegs) {
+        update_game_file(game, guess, game->elapsed_time, nB, nW);
+        trace_mark(TRACE_PERSIST);
 
-        char formatted_key[8];
-        format_secret_key(formatted_key, game->secret_key);
-        snprintf(buffer, MAX_BUFFER_SIZE, "RTR ENT %s\n", formatted_key);
-        sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR ENT", PLID);}
-        remove_game(PLID, FAIL);
+        send_reply(addr, &reply, g->pegs);
+        remember_end(game, FAIL, guess, addr);
+        remove_game(plid, FAIL);
     } else {
-        strncpy(game->last_guess, guess, COLOR_SEQUENCE_LEN);
-        update_game_file(PLID, guess, game->elapsed_time, nB, nW);
-        
+        update_game_file(game, guess, game->elapsed_time, nB, nW);
+
+        reply = (WireReply){ .status = WIRE_OK, .trial = game->current_trial, .nB = nB, .nW = nW };
 
-        snprintf(buffer, MAX_BUFFER_SIZE, "RTR OK %d %d %d\n", game->current_trial, nB, nW);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTR OK", PLID);}
-        sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
+        seqlock_write_begin(&game->seq);
+        game->trials[game->current_trial - 1] = guess;
+        if (nB != g->pegs) game->current_trial++;
+        seqlock_write_end(&game->seq);
 
-        if (nB == 4){
-            printf("PLID = %s: try %s - nB = %d, nW = %d; WIN (game ended)\n", PLID, guess, nB, nW);
+        if (nB == g->pegs){
+            // Persist the win before replying, so a STR/SSB sent right after the
+            // reply (possibly on a kept-alive connection) already sees it.
+            printf("PLID = %06u: try %s - nB = %d, nW = %d; WIN (game ended)\n", plid, guess_str, nB, nW);
             create_score_file(game);
-            remove_game(PLID, WIN);
-            return;
+            remember_end(game, WIN, guess, addr);
+            remove_game(plid, WIN);
         }
+        trace_mark(TRACE_PERSIST);
 
-        printf("PLID = %s: try %s - nB = %d, nW = %d; not guessed\n", PLID, guess, nB, nW);
-
+        send_reply(addr, &reply, g->pegs);
+        if (nB == g->pegs) return;
 
-        if(!(strcmp(guess, game->last_guess) == 0 && nT == game->expected_trial - 1)){
-            game->current_trial++;
-            game->expected_trial = game->current_trial;
-        }
+        printf("PLID = %06u: try %s - nB = %d, nW = %d; not guessed\n", plid, guess_str, nB, nW);
     }
 }
 
 /**
  * @brief Processes the DEBUG command from the player.
+ *
+ * Starts a game of the requested geometry with the given key (request.code) for
+ * request.arg seconds. A DBG repeating the one that started the current game is
+ * answered OK again.
  * 
  * @param addr Address of the client sending the command.
  */
 void process_debug_command(struct sockaddr_in *addr) {
-    char PLID[7], time_str[16], C1[2], C2[2], C3[2], C4[2];
-
-    int scanned = sscanf(buffer, "DBG %6s %15s %1s %1s %1s %1s", PLID, time_str, C1, C2, C3, C4);
-    if (scanned != 6) {
-        sendto(udp_fd, "RDB ERR\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RDB ERR", PLID);}
-        return;
-    }
-
-    if (!validate_plid(PLID) || !validate_play_time(time_str) || !validate_color_sequence(C1, C2, C3, C4)) {
-        sendto(udp_fd, "RDB ERR\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RDB ERR", PLID);}
+    uint32_t plid = request.plid;
+    int geometry = geometry_find(request.pegs, request.colors);
+    if (geometry < 0 || !code_valid(&geometries[geometry], request.code) || plid > WIRE_PLID_MAX ||
+        !valid_play_time(request.arg)) {
+        send_status(addr, WIRE_ERR);
         return;
     }
 
-    int time_status = check_and_update_game_time(PLID, addr, -1, 1, "DBG");
+    int time_status = check_and_update_game_time(plid, addr, "DBG");
     if (time_status == -1) {
         return;
     }
 
-    PlayerGame *game = get_game(PLID);
+    PlayerGame *game = get_game(plid);
     if (game) {
-        sendto(udp_fd, "RDB NOK\n", 8, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RDB NOK", PLID);}
+        send_status(addr, repeats_start(game, MODE_DEBUG, geometry, addr) ? WIRE_OK : WIRE_NOK);
     } else {
-        game = find_or_create_game(PLID, time_str, "D");
-        game->remaining_time = atoi(time_str);
-        snprintf(game->secret_key, COLOR_SEQUENCE_LEN + 1, "%s%s%s%s", C1, C2, C3, C4);
-        create_game_file(PLID, time_str, game->secret_key,"D");
-        sendto(udp_fd, "RDB OK\n", 7, 0, (struct sockaddr *)addr, addrlen);
-        if (verbose) {printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RDB OK", PLID);}
-        
+        game = find_or_create_game(plid, request.arg, MODE_DEBUG, geometry);
+        if (!game) {
+            send_status(addr, WIRE_ERR);
+            return;
+        }
+        seqlock_write_begin(&game->seq);
+        game->secret_key = request.code;
+        game->source = *addr;
+        seqlock_write_end(&game->seq);
+        trace_mark(TRACE_LOOKUP);
+        create_game_file(game);
+        trace_mark(TRACE_PERSIST);
+        send_status(addr, WIRE_OK);
     }
 }
 
 /**
  * @brief Processes the QUIT command from the player.
+ *
+ * A QUT arriving without a game within END_REPLAY_WINDOW seconds of quitting one,
+ * from the client that quit it, is a retransmission whose reply was lost; it gets
+ * the same RQT OK and key.
  * 
  * @param addr Address of the client sending the command.
  */
 void process_quit_command(struct sockaddr_in *addr) {
-    char PLID[7];
-    sscanf(buffer, "QUT %6s", PLID);
+    uint32_t plid = request.plid;
+    if (plid > WIRE_PLID_MAX) {
+        send_status(addr, WIRE_ERR);
+        return;
+    }
 
-    int time_status = check_and_update_game_time(PLID, addr, -1, 1, "QUT");
+    int time_status = check_and_update_game_time(plid, addr, "QUT");
     if (time_status == -1) {
-        sendto(udp_fd, "RQT NOK\n", 8, 0, (struct sockaddr *)addr, addrlen);
-
-        if (verbose) {
-            printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RQT NOK", PLID);
-        }
-
+        send_status(addr, WIRE_NOK);
         return;
     }
 
-    PlayerGame *game = get_game(PLID);
+    PlayerGame *game = get_game(plid);
+    trace_mark(TRACE_LOOKUP);
+    const RecentGame *end = ended_game(plid, QUIT, addr);
     if (!game) {
-        sendto(udp_fd, "RQT NOK\n", 8, 0, (struct sockaddr *)addr, addrlen);
-
-        if (verbose) {
-            printf("UDP sent to %s:%d: %s; PLID = %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RQT NOK", PLID);
+        if (end) {
+            WireReply reply = { .status = WIRE_OK, .code = end->secret_key };
+            send_reply(addr, &reply, end->pegs);
+        } else {
+            send_status(addr, WIRE_NOK);
         }
     } else {
-        char formatted_key[8];
-        format_secret_key(formatted_key, game->secret_key);
-        snprintf(buffer, MAX_BUFFER_SIZE, "RQT OK %s\n", formatted_key);
-        printf("PLID = %s: quitting the game.\n", PLID);
-        if (verbose) {
-            printf("UDP sent to %s:%d: %s; PLID = %s; quitting the game!\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RQT OK", PLID);
-        }
-        sendto(udp_fd, buffer, strlen(buffer), 0, (struct sockaddr *)addr, addrlen);
-        remove_game(PLID, QUIT);
+        printf("PLID = %06u: quitting the game.\n", plid);
+        WireReply reply = { .status = WIRE_OK, .code = game->secret_key };
+        send_reply(addr, &reply, geometries[game->geometry].pegs);
+        remember_end(game, QUIT, CODE_INVALID, addr);
+        remove_game(plid, QUIT);
+        trace_mark(TRACE_PERSIST);
     }
 }
 
 /**
- * @brief Extracts trial details from the player's game file.
+ * @brief Renders the trials view of a game file into a memory buffer.
  * 
- * @param source_filename The source file containing the game data.
- * @param output_filename The output file to write the extracted trial data.
- * @param game The PlayerGame structure containing game details.
+ * @param source_file The game data (an active game file or an archived record); left open.
+ * @param game The PlayerGame structure containing game details (NULL for finished games).
+ * @param out Set to a malloc'd buffer with the rendered view; the caller frees it.
+ * @param out_len Set to the length of the rendered view.
  * @return 1 if successful, 0 otherwise.
  */
-int extract_trials_from_game_file(const char *source_filename, const char *output_filename, PlayerGame *game) {
-    FILE *source_file = fopen(source_filename, "r");
-    FILE *output_file = fopen(output_filename, "w");
-
-    if (!source_file || !output_file) {
-        perror("Failed to open files for trial extraction");
-        if (source_file) fclose(source_file);
-        if (output_file) fclose(output_file);
+int render_trials(FILE *source_file, PlayerGame *game, char **out, size_t *out_len) {
+    FILE *output = open_memstream(out, out_len);
+    if (!output) {
+        perror("open_memstream");
         return 0;
     }
 
-    
-    char PLID[7], mode[16], secret_key[5], time_str[16], timestamp[32];
+    char PLID[7], mode[16], secret_key[CODE_STR_LEN], time_str[16], timestamp[32];
     long start_t;
-    if (fscanf(source_file, "%6s %15s %4s %15s %31s %ld", PLID, mode, secret_key, time_str, timestamp, &start_t) == 6) {
+    if (fscanf(source_file, "%6s %15s %6s %15s %31s %ld", PLID, mode, secret_key, time_str, timestamp, &start_t) == 6) {
         
-        fprintf(output_file, "===================================================\n");
-        fprintf(output_file, "PLID: %s | Mode: %s | Started: %s\n\n", PLID, mode, timestamp);
+        fprintf(output, "===================================================\n");
+        fprintf(output, "PLID: %s | Mode: %s | Started: %s\n\n", PLID, mode, timestamp);
     }
     
     // Now read trials
     char line[MAX_BUFFER_SIZE];
     while (fgets(line, sizeof(line), source_file)) {
         if (strncmp(line, "T: ", 3) == 0) {
-            char C1, C2, C3, C4;
+            char guess[CODE_STR_LEN];
             int nB, nW, tElapsed;
-            if (sscanf(line, "T: %c%c%c%c %d %d %d", &C1, &C2, &C3, &C4, &nB, &nW, &tElapsed) == 7) {
-                fprintf(output_file, "%c %c %c %c %d %d\n", C1, C2, C3, C4, nB, nW);
+            if (sscanf(line, "T: %6s %d %d %d", guess, &nB, &nW, &tElapsed) == 4) {
+                for (int i = 0; guess[i]; i++) {
+                    fprintf(output, "%c ", guess[i]);
+                }
+                fprintf(output, "%d %d\n", nB, nW);
             }
         }
     }
 
     if (game) {
-        fprintf(output_file, "Remaining Time: %d seconds\n", game->remaining_time);
+        fprintf(output, "Remaining Time: %d seconds\n", game->remaining_time);
     }
 
-    fclose(source_file);
-    fclose(output_file);
+    if (fclose(output) != 0) {
+        perror("Failed to render trials");
+        free(*out);
+        return 0;
+    }
     return 1;
 }
 
 /**
- * @brief Sends a file to the client using TCP.
+ * @brief Sends a TCP reply carrying a file body: "<code> <status> <fname> <size> <data>\n".
+ *
+ * Header, data and trailing newline go out in a single vectored write (resumed if
+ * the socket accepts only part of it).
  * 
  * @param client_fd The TCP client file descriptor.
- * @param status The status of the operation (e.g., "OK", "NOK").
- * @param filepath The path to the file being sent.
+ * @param code The reply code ("RST" or "RSS").
+ * @param status The status of the operation (e.g., "ACT", "FIN", "OK").
+ * @param fname The file name announced to the client.
+ * @param data The file contents.
+ * @param size The size of the file contents.
  */
-void send_file_to_client(int client_fd, const char *status, const char *filepath) {
-    FILE *file = fopen(filepath, "r");
-    if (!file) {
-        perror("Failed to open file to send");
-        send(client_fd, "RST NOK\n", 8, 0);
-        return;
-    }
-
-    fseek(file, 0, SEEK_END);
-    long filesize = ftell(file);
-    rewind(file);
-
-    char *fname = strrchr(filepath, '/');
-    fname = fname ? fname + 1 : (char *)filepath;
-
+void send_data_to_client(int client_fd, const char *code, const char *status, const char *fname, const char *data, size_t size) {
     char header[MAX_BUFFER_SIZE];
-    snprintf(header, sizeof(header), "RST %s %s %ld ", status, fname, filesize);
-    send(client_fd, header, strlen(header), 0);
-
-    char file_buffer[MAX_BUFFER_SIZE];
-    size_t nread;
-    while ((nread = fread(file_buffer, 1, sizeof(file_buffer), file)) > 0) {
-        send(client_fd, file_buffer, nread, 0);
+    int header_len = snprintf(header, sizeof(header), "%s %s %s %zu ", code, status, fname, size);
+
+    struct iovec iov[3] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = (void *)data, .iov_len = size },
+        { .iov_base = "\n", .iov_len = 1 },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 3 };
+
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(client_fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to send reply");
+            return;
+        }
+        // Skip what was sent and resume with the rest
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
     }
-    send(client_fd, "\n", 1, 0);
-    if(verbose){printf("TCP sent: RST %s %s %ld ", status, fname, filesize);}
+    trace_mark(TRACE_SEND);
+    if(verbose){printf("TCP sent: %s %s %s %zu\n", code, status, fname, size);}
+}
 
-    fclose(file);
+/**
+ * @brief Splits a TCP request in buffer into fields, leaving out the keep-alive token.
+ *
+ * @return The number of fields.
+ */
+static int split_tcp_request(char *line, char **fields, int max) {
+    strcpy(line, buffer);
+    if (wants_keepalive(line)) line[strlen(line) - strlen(KEEPALIVE_TOKEN)] = '\0';
+    return split_fields(line, fields, max);
 }
 
 /**
  * @brief Processes the scoreboard request from the player.
+ *
+ * "SSB" asks for the all-time top 10, "SSB DAY" / "SSB WEEK" for the top 10 of the
+ * last 24 hours / 7 days. Every board is served from its shared cache; no file is
+ * read or written.
  * 
  * @param client_fd The TCP client file descriptor.
  */
 void process_scoreboard_command(int client_fd, struct sockaddr_in *addr) {
-    int score_count = 0;
-    ScoreEntry *scores = load_scores(&score_count);
+    char line[MAX_BUFFER_SIZE];
+    char *fields[3];
+    int n = split_tcp_request(line, fields, 3);
+    int window = n == 2 ? scoreboard_window_find(fields[1]) : -1;
+    if (n > 2 || (n == 2 && window < 0)) {
+        send(client_fd, "RSS ERR\n", 8, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSS ERR");}
+        return;
+    }
 
-    if (!scores || score_count == 0) {
-        if (scores) free(scores);
+    char payload[SCOREBOARD_PAYLOAD_MAX];
+    size_t len = window < 0 ? scoreboard_snapshot(payload, NULL) : scoreboard_window_snapshot(window, payload);
+    const char *fname = window < 0 ? "scoreboard.txt" : scoreboard_window_fname(window);
+    trace_mark(TRACE_LOOKUP);
+
+    if (len == 0) {
         send(client_fd, "RSS EMPTY\n", 10, 0);
-        
 
         if (verbose) {
             printf("TCP sent to %s:%d: %s; %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSS EMPTY", "no scores found");
@@ -594,56 +1082,255 @@ void process_scoreboard_command(int client_fd, struct sockaddr_in *addr) {
         return;
     }
 
-    qsort(scores, score_count, sizeof(ScoreEntry), compare_scores);
+    if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSS OK");}
+    send_data_to_client(client_fd, "RSS", "OK", fname, payload, len);
+}
 
-    int limit = score_count < 10 ? score_count : 10;
+/**
+ * @brief Parses the optional view field of SRK/SPG.
+ *
+ * @param field "PLAY", "DEBUG", or NULL for both modes.
+ * @return MODE_PLAY, MODE_DEBUG or MODE_ALL; -1 if the field is invalid.
+ */
+static int parse_score_view(const char *field) {
+    if (!field) return MODE_ALL;
+    if (strcmp(field, "PLAY") == 0) return MODE_PLAY;
+    if (strcmp(field, "DEBUG") == 0) return MODE_DEBUG;
+    return -1;
+}
 
-    // Creates and processes the file.
-    char scoreboard_file[] = "top_scoreboard.txt";
-    FILE *out = fopen(scoreboard_file, "w");
-    if (!out) {
-        perror("fopen top_scoreboard");
-        free(scores);
-        send(client_fd, "RSS EMPTY\n", 10, 0);
-        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSS EMPTY");}
+/**
+ * @brief Processes the rank request: "SRK PLID [PLAY|DEBUG]".
+ *
+ * Answers "RRK OK rank total SSS PLID KEY N MODE" for the player's best score in
+ * the view, "RRK NOK" if the player has none (or the index could not be read),
+ * or "RRK ERR".
+ *
+ * A cluster proxy asks the player's node "SBE PLID [PLAY|DEBUG]" instead, and gets
+ * "RBE OK rank total END SSS PLID KEY N MODE" (END as in STK) to rank the entry
+ * on the other nodes with SAH.
+ * 
+ * @param client_fd The TCP client file descriptor.
+ * @param addr Address of the client.
+ */
+void process_rank_command(int client_fd, struct sockaddr_in *addr) {
+    char line[MAX_BUFFER_SIZE], reply[MAX_BUFFER_SIZE];
+    char *fields[4];
+    uint32_t plid;
+    int shard = strncmp(buffer, "SBE", 3) == 0;
+    const char *code = shard ? "RBE" : "RRK";
+    int n = split_tcp_request(line, fields, 4);
+    int mode = parse_score_view(n == 3 ? fields[2] : NULL);
+    if ((n != 2 && n != 3) || mode < 0 || !parse_plid(fields[1], &plid)) {
+        int len = snprintf(reply, sizeof(reply), "%s ERR\n", code);
+        send(client_fd, reply, len, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
         return;
     }
+    trace_mark(TRACE_PARSE);
 
-    for (int i = 0; i < limit; i++) {
-        fprintf(out, "%03d %s %s %d %s", scores[i].SSS, scores[i].PLID, scores[i].secret_key, scores[i].total_plays, scores[i].mode);
-        if(i != limit - 1) {
-            fprintf(out, "\n");
-        }
-    }
-    fclose(out);
-    free(scores);
-
-    FILE *file = fopen(scoreboard_file, "r");
-    if (!file) {
-        perror("fopen top_scoreboard to send");
-        send(client_fd, "RSS EMPTY\n", 10, 0);
-        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSS EMPTY");}
-
+    ScoreEntry entry;
+    int rank, total;
+    int found = score_rank(plid, mode, &entry, &rank, &total);
+    trace_mark(TRACE_LOOKUP);
+    if (found <= 0) {
+        int len = snprintf(reply, sizeof(reply), "%s NOK\n", code);
+        send(client_fd, reply, len, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
         return;
     }
 
-    fseek(file, 0, SEEK_END);
-    long filesize = ftell(file);
-    rewind(file);
+    int len = snprintf(reply, sizeof(reply), "%s OK %d %d ", code, rank, total);
+    if (shard) len += snprintf(reply + len, sizeof(reply) - len, "%ld ", (long)entry.end_time);
+    len += format_score_entry(&entry, reply + len, sizeof(reply) - len - 1);
+    reply[len++] = '\n';
+    send(client_fd, reply, len, MSG_NOSIGNAL);
+    trace_mark(TRACE_SEND);
+    if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
+}
 
-    char header[MAX_BUFFER_SIZE];
-    snprintf(header, sizeof(header), "RSS OK %s %ld ", "scoreboard.txt", filesize);
-    if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RSS OK");}
-    send(client_fd, header, strlen(header), 0);
+/**
+ * @brief Processes the scoreboard page request: "SPG first count [PLAY|DEBUG]".
+ *
+ * Sends the entries ranked first to first+count-1 (at most SCORE_PAGE_MAX) as a
+ * file, one "rank SSS PLID KEY N MODE" line each: "RPG OK fname size data", or
+ * "RPG EMPTY" past the last entry (or, as when busy, if the index could not be
+ * read), or "RPG ERR".
+ *
+ * A cluster proxy merging the pages of several nodes asks "SPE first count
+ * [PLAY|DEBUG]" instead: the same page as "RPE OK|EMPTY|ERR", its lines being
+ * "END SSS PLID KEY N MODE" as in STK.
+ * 
+ * @param client_fd The TCP client file descriptor.
+ * @param addr Address of the client.
+ */
+void process_page_command(int client_fd, struct sockaddr_in *addr) {
+    char line[MAX_BUFFER_SIZE], reply[16];
+    char *fields[5];
+    int shard = strncmp(buffer, "SPE", 3) == 0;
+    const char *code = shard ? "RPE" : "RPG";
+    int n = split_tcp_request(line, fields, 5);
+    int mode = parse_score_view(n == 4 ? fields[3] : NULL);
+    if ((n != 3 && n != 4) || mode < 0 || !is_number(fields[1]) || !is_number(fields[2]) ||
+        atoi(fields[1]) < 1 || atoi(fields[2]) < 1) {
+        int len = snprintf(reply, sizeof(reply), "%s ERR\n", code);
+        send(client_fd, reply, len, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
+        return;
+    }
+    int first = atoi(fields[1]);
+    trace_mark(TRACE_PARSE);
+
+    ScoreEntry entries[SCORE_PAGE_MAX];
+    int total;
+    int count = score_page(first, atoi(fields[2]), mode, entries, &total);
+    trace_mark(TRACE_LOOKUP);
+    if (count <= 0) {
+        int len = snprintf(reply, sizeof(reply), "%s EMPTY\n", code);
+        send(client_fd, reply, len, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
+        return;
+    }
 
-    char file_buffer[MAX_BUFFER_SIZE];
-    size_t nread;
-    while ((nread = fread(file_buffer, 1, sizeof(file_buffer), file)) > 0) {
-        send(client_fd, file_buffer, nread, 0);
+    char payload[SCORE_PAGE_MAX * 80], fname[64];
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        if (shard) len += snprintf(payload + len, sizeof(payload) - len, "%s%ld ", i > 0 ? "\n" : "", (long)entries[i].end_time);
+        else len += snprintf(payload + len, sizeof(payload) - len, "%s%d ", i > 0 ? "\n" : "", first + i);
+        len += format_score_entry(&entries[i], payload + len, sizeof(payload) - len);
     }
-    send(client_fd, "\n", 1, 0);
+    snprintf(fname, sizeof(fname), "scores_%d_%d.txt", first, first + count - 1);
+    trace_mark(TRACE_RENDER);
 
-    fclose(file);
+    if(verbose){printf("TCP sent to %s:%d: %s OK\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), code);}
+    send_data_to_client(client_fd, code, "OK", fname, payload, len);
+}
+
+/**
+ * @brief Processes the rank-ahead request: "SAH END SSS PLID PLAY|DEBUG [PLAY|DEBUG]".
+ *
+ * Used by a cluster proxy to rank a player's best entry, held by another node,
+ * across every node: answers "RAH OK ahead total", ahead being the number of
+ * entries of the view that rank ahead of the given one (SSB order), "RAH NOK" if
+ * the index could not be read, or "RAH ERR".
+ *
+ * @param client_fd The TCP client file descriptor.
+ * @param addr Address of the client.
+ */
+void process_rank_ahead_command(int client_fd, struct sockaddr_in *addr) {
+    char line[MAX_BUFFER_SIZE], reply[MAX_BUFFER_SIZE];
+    char *fields[7];
+    ScoreEntry probe = { 0 };
+    int n = split_tcp_request(line, fields, 7);
+    int mode = parse_score_view(n == 6 ? fields[5] : NULL);
+    int entry_mode = n >= 5 ? parse_score_view(fields[4]) : -1;
+    if ((n != 5 && n != 6) || mode < 0 || entry_mode < 0 || entry_mode == MODE_ALL || !is_number(fields[1]) ||
+        !is_number(fields[2]) || !parse_plid(fields[3], &probe.plid)) {
+        send(client_fd, "RAH ERR\n", 8, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RAH ERR");}
+        return;
+    }
+    probe.end_time = strtoll(fields[1], NULL, 10);
+    probe.SSS = atoi(fields[2]);
+    probe.mode = entry_mode;
+    trace_mark(TRACE_PARSE);
+
+    int ahead, total;
+    int ok = score_count_ahead(&probe, mode, &ahead, &total);
+    trace_mark(TRACE_LOOKUP);
+    int len = ok ? snprintf(reply, sizeof(reply), "RAH OK %d %d\n", ahead, total) : snprintf(reply, sizeof(reply), "RAH NOK\n");
+    send(client_fd, reply, len, MSG_NOSIGNAL);
+    trace_mark(TRACE_SEND);
+    if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
+}
+
+/**
+ * @brief Processes the shard top-K request: "STK ALL|DAY|WEEK [generation]".
+ *
+ * Used by a cluster proxy to merge a global scoreboard. Answers "RTK SAME gen"
+ * if the board is still at the given generation, "RTK EMPTY gen" if it has no
+ * entries, or "RTK OK gen fname size data" with one "END SSS PLID KEY N MODE"
+ * line per entry, best first, END being the time of the win (seconds since the
+ * epoch) so boards from several shards can be merged in SSB order. "RTK NOK" if
+ * the board could not be read, "RTK ERR" if the request is invalid.
+ *
+ * @param client_fd The TCP client file descriptor.
+ * @param addr Address of the client.
+ */
+void process_shard_top_command(int client_fd, struct sockaddr_in *addr) {
+    char line[MAX_BUFFER_SIZE], reply[MAX_BUFFER_SIZE];
+    char *fields[4];
+    int n = split_tcp_request(line, fields, 4);
+    int window = n >= 2 && strcmp(fields[1], "ALL") != 0 ? scoreboard_window_find(fields[1]) : -1;
+    if ((n != 2 && n != 3) || (window < 0 && strcmp(fields[1], "ALL") != 0)) {
+        send(client_fd, "RTK ERR\n", 8, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTK ERR");}
+        return;
+    }
+    trace_mark(TRACE_PARSE);
+
+    ScoreEntry top[SCOREBOARD_SIZE];
+    char generation[48];
+    int count = scoreboard_top(window, top, generation, sizeof(generation));
+    trace_mark(TRACE_LOOKUP);
+    if (count < 0) {
+        send(client_fd, "RTK NOK\n", 8, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RTK NOK");}
+        return;
+    }
+    if (count == 0 || (n == 3 && strcmp(fields[2], generation) == 0)) {
+        int len = snprintf(reply, sizeof(reply), "RTK %s %s\n", count == 0 ? "EMPTY" : "SAME", generation);
+        send(client_fd, reply, len, MSG_NOSIGNAL);
+        trace_mark(TRACE_SEND);
+        if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
+        return;
+    }
+
+    char payload[SCOREBOARD_PAYLOAD_MAX + SCOREBOARD_SIZE * 24], status[64];
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        len += snprintf(payload + len, sizeof(payload) - len, "%s%ld ", i > 0 ? "\n" : "", (long)top[i].end_time);
+        len += format_score_entry(&top[i], payload + len, sizeof(payload) - len);
+    }
+    snprintf(status, sizeof(status), "OK %s", generation);
+    trace_mark(TRACE_RENDER);
+
+    if(verbose){printf("TCP sent to %s:%d: RTK %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), status);}
+    send_data_to_client(client_fd, "RTK", status, window < 0 ? "scoreboard.txt" : scoreboard_window_fname(window), payload, len);
+}
+
+/**
+ * @brief Processes the replication status request: "SRP".
+ *
+ * Answers "RRP role position lag_records lag_ms replicas", role being PRIMARY,
+ * REPLICA or STANDALONE. A primary reports its stream position and the lag of its
+ * furthest-behind replica; a replica, the last record it applied and how long
+ * after its publication it was applied. "RRP NOK" if the status could not be read.
+ * 
+ * @param client_fd The TCP client file descriptor.
+ * @param addr Address of the client.
+ */
+void process_replication_command(int client_fd, struct sockaddr_in *addr) {
+    char line[MAX_BUFFER_SIZE], reply[MAX_BUFFER_SIZE];
+    char *fields[2];
+    if (split_tcp_request(line, fields, 2) != 1) {
+        send(client_fd, "RRP ERR\n", 8, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RRP ERR");}
+        return;
+    }
+
+    ReplicationStatus status;
+    if (!replication_status(&status)) {
+        send(client_fd, "RRP NOK\n", 8, MSG_NOSIGNAL);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RRP NOK");}
+        return;
+    }
+    const char *role = status.role == REPL_PRIMARY ? "PRIMARY" : status.role == REPL_REPLICA ? "REPLICA" : "STANDALONE";
+    int len = snprintf(reply, sizeof(reply), "RRP %s %llu %llu %lld %d\n", role, (unsigned long long)status.position,
+                       (unsigned long long)status.lag_records, (long long)status.lag_ms, status.replicas);
+    send(client_fd, reply, len, MSG_NOSIGNAL);
+    trace_mark(TRACE_SEND);
+    if(verbose){printf("TCP sent to %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), reply);}
 }
 
 /**
@@ -652,212 +1339,548 @@ void process_scoreboard_command(int client_fd, struct sockaddr_in *addr) {
  * @param client_fd The TCP client file descriptor.
  */
 void process_show_trials_command(int client_fd, struct sockaddr_in *addr) {
-    char PLID[7];
-    char filename[128];
+    char PLID[7] = "";
+    uint32_t plid;
+    char filename[320];
+    char trials_fname[64];
+    char *trials = NULL;
+    size_t trials_len = 0;
 
     sscanf(buffer, "STR %6s", PLID);
-    if (!validate_plid(PLID)) {
+    if (!parse_plid(PLID, &plid)) {
         send(client_fd, "RST NOK\n", 8, 0);
         if(verbose){
             printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RST NOK");
         }
         return;
     }
+    snprintf(trials_fname, sizeof(trials_fname), "trials_%s.txt", PLID);
+    trace_mark(TRACE_PARSE);
 
-    // Checks time update
-    int time_status = check_and_update_game_time(PLID, NULL, client_fd, 0, "STR");
-    if (time_status == -1) {
-        // Time up, treat as finished game
-        if (!FindLastGame(PLID, filename)) {
-            send(client_fd, "RST NOK\n", 8, 0);
-
-            if(verbose){
-                printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RST NOK");
-            }
-            return;
-        }
-        char temp_filename[64];
-        snprintf(temp_filename, sizeof(temp_filename), "trials_%s.txt", PLID);
-        if (!extract_trials_from_game_file(filename, temp_filename, NULL)) {
-            
-            send(client_fd, "RST NOK\n", 8, 0);
-            if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RST NOK");}
-            return;
-        }
-        send_file_to_client(client_fd, "FIN", temp_filename);
-        remove(temp_filename);
+    // Read the live game from the shared table. Workers never modify game state:
+    // an expired game is reported as finished and left for the UDP loop to close.
+    PlayerGame snapshot;
+    PlayerGame *game = NULL;
+    FILE *source = NULL;
+    int active = snapshot_game(plid, &snapshot);
+    if (active < 0) {
+        send(client_fd, "RST NOK\n", 8, 0);
+        if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RST NOK; game table stuck");}
         return;
     }
-
-    PlayerGame *game = get_game(PLID);
-    // Handles file processing
-    char temp_filename[64];
-    snprintf(temp_filename, sizeof(temp_filename), "trials_%s.txt", PLID);
-
-    if (game) {
+    if (active) {
+        int remaining = snapshot.remaining_time - (int)(gs_clock.now - snapshot.last_update_time);
+        if (remaining > 0) {
+            snapshot.remaining_time = remaining;
+            game = &snapshot;
+        }
         snprintf(filename, sizeof(filename), "GAMES/GAME_%s.txt", PLID);
-    } else {
-        if (!FindLastGame(PLID, filename)) {
-            send(client_fd, "RST NOK\n", 8, 0);
-            if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RST NOK");}
-            return;
+        source = fopen(filename, "r");
+    }
+
+    // Finished games (or one that ended since the snapshot) come from the archive,
+    // or from a per-game file the compactor has not folded in yet
+    char *record = NULL;
+    size_t record_len;
+    if (!source) {
+        game = NULL;
+        if (archive_read_last(plid, &record, &record_len)) {
+            source = fmemopen(record, record_len, "r");
+        } else if (FindLastGame(PLID, filename)) {
+            source = fopen(filename, "r");
         }
     }
 
-    if (!extract_trials_from_game_file(filename, temp_filename, game)) {
+    trace_mark(TRACE_LOOKUP);
+    int rendered = source && render_trials(source, game, &trials, &trials_len);
+    trace_mark(TRACE_RENDER);
+    if (source) fclose(source);
+    free(record);
+    if (!rendered) {
         send(client_fd, "RST NOK\n", 8, 0);
         if(verbose){printf("TCP sent to %s:%d: %s\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), "RST NOK");}
         return;
     }
 
     const char *status = game ? "ACT" : "FIN";
-    send_file_to_client(client_fd, status, temp_filename);
-    remove(temp_filename);
+    send_data_to_client(client_fd, "RST", status, trials_fname, trials, trials_len);
+    free(trials);
 }
 
 /**
- * @brief Handles incoming UDP commands from the player.
+ * @brief Handles one datagram received on the UDP port.
+ *
+ * The datagram is checked against its source's rate limit first: offenders are
+ * dropped unanswered, before any parsing. A cluster proxy (--trusted-proxy) is
+ * exempt, as it limits each of its clients itself. A datagram starting with a byte up to
+ * WIRE_MAX_VERSION is a binary frame, decoded straight into request; a text
+ * request is parsed from the shared buffer into the same fields. Either is
+ * answered in its own protocol (send_reply).
+ * 
+ * @param data The datagram.
+ * @param len Its length (less than MAX_BUFFER_SIZE).
+ * @param addr Address of the client.
  */
-void handle_udp_commands() {
-    struct sockaddr_in addr;
-    addrlen = sizeof(addr);
+void handle_udp_datagram(const char *data, size_t len, struct sockaddr_in *addr) {
+    if (!rate_limiter_allow(&rate_limiter, addr->sin_addr.s_addr, gs_clock.mono_ms)) return;
+
+    addrlen = sizeof(*addr);
+    if (wire_is_binary(data, len)) {
+        // Frames of another version are answered (WIRE_BADVERSION) whatever their
+        // op, since ops are only defined per version, so the client can fall back;
+        // anything shorter, and unknown ops of this version, are dropped
+        if (!wire_decode_request((const uint8_t *)data, len, &request)) return;
+        if (request.version == WIRE_VERSION && (request.op == 0 || request.op >= WIRE_OPS)) return;
+        reply_tag[0] = '\0';
+        trace_begin_command(wire_command(request.op), request.plid);
+        if (verbose) {
+            printf("UDP Received from %s:%d: v%d %s %06u\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port),
+                   request.version, wire_command(request.op), request.plid <= WIRE_PLID_MAX ? request.plid : 0);
+        }
+        if (request.version != WIRE_VERSION) {
+            request.version = WIRE_VERSION;
+            send_status(addr, WIRE_BADVERSION);
+            trace_mark(TRACE_DONE);
+            return;
+        }
+    } else {
+        memcpy(buffer, data, len);
+        buffer[len] = '\0';
+        take_echo_token();
+        trace_begin(buffer);
 
-    memset(buffer, 0, MAX_BUFFER_SIZE);
+        if (verbose) {
+            printf("UDP Received from %s:%d: %s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), buffer);
+        }
 
-    int n = recvfrom(udp_fd, buffer, MAX_BUFFER_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
-    if (n == -1) {
-        perror("recvfrom failed");
-        return;
+        char command[4];
+        int op = 0;
+        if (sscanf(buffer, "%3s", command) == 1) {
+            for (op = WIRE_OPS - 1; op > 0 && strcmp(command, wire_command(op)) != 0; op--) ;
+        }
+        if (op == 0) {
+            trace_mark(TRACE_DONE);
+            return;
+        }
+        parse_text_request(op);
     }
+    trace_mark(TRACE_PARSE);
 
-    if (verbose) {
-        printf("UDP Received from %s:%d: %s", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), buffer);
+    switch (request.op) {
+        case WIRE_SNG: process_start_command(addr); break;
+        case WIRE_TRY: process_try_command(addr); break;
+        case WIRE_DBG: process_debug_command(addr); break;
+        case WIRE_QUT: process_quit_command(addr); break;
     }
+    trace_mark(TRACE_DONE);
+}
 
-    buffer[n] = '\0';
-
-    char command[4];
-    int cmd_scanned = sscanf(buffer, "%3s", command);
-    if (cmd_scanned != 1) return;
+/**
+ * @brief Handles incoming UDP commands from the player.
+ *
+ * Reads up to UDP_BATCH queued datagrams with one recvmmsg and handles them in
+ * order. (With --io-uring, the ring delivers the datagrams instead.)
+ */
+void handle_udp_commands() {
+    static char datagrams[UDP_BATCH][MAX_BUFFER_SIZE];
+    static struct sockaddr_in addrs[UDP_BATCH];
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iovs[UDP_BATCH];
+
+    for (int i = 0; i < UDP_BATCH; i++) {
+        iovs[i].iov_base = datagrams[i];
+        iovs[i].iov_len = MAX_BUFFER_SIZE - 1;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int count = recvmmsg(udp_fd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (count == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) perror("recvfrom failed");
+        return;
+    }
 
-    if (strcmp(command, "SNG") == 0) {
-        process_start_command(&addr);
-    } else if (strcmp(command, "TRY") == 0) {
-        process_try_command(&addr);
-    } else if (strcmp(command, "DBG") == 0) {
-        process_debug_command(&addr);
-    } else if (strcmp(command,"QUT") == 0) {
-        process_quit_command(&addr);
+    for (int i = 0; i < count; i++) {
+        handle_udp_datagram(datagrams[i], msgs[i].msg_len, &addrs[i]);
     }
 }
 
+/**
+ * @brief Checks whether a TCP request line asks to keep the connection open.
+ *
+ * Clients opt in by appending the keep-alive token (" K") to STR/SSB requests.
+ * Servers that predate keep-alive ignore the extra token and simply close.
+ *
+ * @param line The request line, without the trailing newline.
+ * @return 1 if the connection should stay open after the reply, 0 otherwise.
+ */
+int wants_keepalive(const char *line) {
+    size_t len = strlen(line);
+    size_t tlen = strlen(KEEPALIVE_TOKEN);
+    return len > tlen && strcmp(line + len - tlen, KEEPALIVE_TOKEN) == 0;
+}
+
 /**
  * @brief Handles incoming TCP connection requests from the player.
+ *
+ * Requests are newline-terminated. A connection serves a single request unless the
+ * client opts in to keep-alive, in which case pipelined STR/SSB requests are served
+ * in order until the client closes, stops asking for keep-alive, stays idle for
+ * TCP_IDLE_TIMEOUT seconds or reaches TCP_MAX_REQUESTS.
  * 
  * @param client_fd The TCP client file descriptor.
  * @param client_addr The address of the connected client.
  */
 void handle_tcp_connection(int client_fd, struct sockaddr_in *client_addr) {
     char local_buffer[MAX_BUFFER_SIZE];
-    int n = recv(client_fd, local_buffer, sizeof(local_buffer), 0);
-    if (n <= 0) {
-        if (n < 0) perror("recv failed");
-        return;
-    }
+    int len = 0;
+    int served = 0;
 
-    local_buffer[n] = '\0';
-    if (verbose) {
-        printf("TCP connection from %s:%d -> %s\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), local_buffer);
+    struct timeval tv = { .tv_sec = TCP_IDLE_TIMEOUT, .tv_usec = 0 };
+    if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        perror("setsockopt failed");
     }
-    
-    strncpy(buffer, local_buffer, MAX_BUFFER_SIZE);
 
-    if (strncmp(local_buffer, "STR", 3) == 0) {
-        process_show_trials_command(client_fd, client_addr);
-    } else if (strncmp(local_buffer, "SSB", 3) == 0) {
-        process_scoreboard_command(client_fd, client_addr);
-    } else {
-        printf("Unknown TCP request\n");
-        send(client_fd, "RST NOK\n", 8, 0);
+    while (served < TCP_MAX_REQUESTS) {
+        char *eol = memchr(local_buffer, '\n', len);
+        if (!eol) {
+            int n = (len < (int)sizeof(local_buffer) - 1) ? recv(client_fd, local_buffer + len, sizeof(local_buffer) - 1 - len, 0) : 0;
+            if (n > 0) {
+                len += n;
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("recv failed");
+            if (n < 0 && verbose && served > 0) {
+                printf("TCP connection from %s:%d idle, closing\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
+            }
+            // Legacy clients may not terminate their only request; serve what arrived.
+            if (len == 0 || served > 0) break;
+            eol = local_buffer + len;
+            len++;
+        }
+
+        *eol = '\0';
+        if (eol > local_buffer && eol[-1] == '\r') eol[-1] = '\0';
+        int line_len = eol - local_buffer + 1;
+
+        if (verbose) {
+            printf("TCP connection from %s:%d -> %s\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), local_buffer);
+        }
+
+        strncpy(buffer, local_buffer, MAX_BUFFER_SIZE);
+        clock_tick();
+        trace_begin(buffer);
+        int keepalive = wants_keepalive(local_buffer);
+        served++;
+
+        if (strncmp(local_buffer, "STR", 3) == 0) {
+            process_show_trials_command(client_fd, client_addr);
+        } else if (strncmp(local_buffer, "SSB", 3) == 0) {
+            process_scoreboard_command(client_fd, client_addr);
+        } else if (strncmp(local_buffer, "SRK", 3) == 0 || strncmp(local_buffer, "SBE", 3) == 0) {
+            process_rank_command(client_fd, client_addr);
+        } else if (strncmp(local_buffer, "SPG", 3) == 0 || strncmp(local_buffer, "SPE", 3) == 0) {
+            process_page_command(client_fd, client_addr);
+        } else if (strncmp(local_buffer, "SAH", 3) == 0) {
+            process_rank_ahead_command(client_fd, client_addr);
+        } else if (strncmp(local_buffer, "SRP", 3) == 0) {
+            process_replication_command(client_fd, client_addr);
+        } else if (strncmp(local_buffer, "STK", 3) == 0) {
+            process_shard_top_command(client_fd, client_addr);
+        } else {
+            printf("Unknown TCP request\n");
+            send(client_fd, "RST NOK\n", 8, 0);
+            trace_mark(TRACE_DONE);
+            break;
+        }
+        trace_mark(TRACE_DONE);
+
+        if (!keepalive || drain_requested) break;
+
+        len -= line_len;
+        memmove(local_buffer, local_buffer + line_len, len);
     }
 }
 
 /**
- * @brief Generates a random 4-color secret key.
+ * @brief Forks a worker process to serve one TCP connection.
+ *
+ * The parent's copy of the descriptor is closed; the worker drops the descriptors
+ * of connections still queued or being rejected, so they close as soon as the
+ * parent (or their own worker) is done with them.
  * 
- * @param secret_key The array to store the generated secret key.
+ * @param client_fd The accepted connection.
+ * @param client_addr Address of the client.
  */
-void generate_secret_key(char *secret_key) {
-    // Possible colors
-    const char colors[] = {'R', 'G', 'B', 'Y', 'O', 'P'};
-    srand(time(NULL));
-    for (int i = 0; i < COLOR_SEQUENCE_LEN; i++) {
-        secret_key[i] = colors[rand() % 6];
+static void start_tcp_worker(int client_fd, struct sockaddr_in *client_addr) {
+    fflush(stdout);  // Otherwise the worker re-emits the parent's buffered log on exit
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        close(client_fd);
+        return;
+    } else if (pid == 0) {
+        close(tcp_fd);
+        if (uring_active) close(uring_fd());
+        for (int i = 0; i < MAX_PLAYERS; i++) {
+            if (game_fds[i] != -1) close(game_fds[i]);
+        }
+        for (int i = 0; i < tcp_queue_len; i++) {
+            close(tcp_queue[(tcp_queue_head + i) % TCP_QUEUE_MAX].fd);
+        }
+        for (int i = 0; i < tcp_reject_count; i++) {
+            close(tcp_rejects[i].fd);
+        }
+        close(signal_pipe[0]);
+        close(signal_pipe[1]);
+        drain_requested = handed_off;
+        replication_child();
+        trace_child();
+        handle_tcp_connection(client_fd, client_addr);
+        close(client_fd);
+        trace_flush();
+        exit(0);
+    }
+    for (int i = 0; i < tcp_max_workers; i++) {
+        if (tcp_worker_pids[i] == 0) {
+            tcp_worker_pids[i] = pid;
+            break;
+        }
     }
-    secret_key[COLOR_SEQUENCE_LEN] = '\0';
+    tcp_workers++;
+    close(client_fd);
 }
 
 /**
- * @brief Calculates the number of black and white pegs for a given guess.
+ * @brief Answers a rejected connection once its request line has arrived.
+ *
+ * STR gets "RST NOK", SSB "RSS EMPTY", SRK "RRK NOK", SPG "RPG EMPTY", SRP
+ * "RRP ERR" and STK "RTK ERR", the replies a client already handles (and the
+ * proxy's SBE, SPE and SAH the matching NOK or EMPTY); the connection is then
+ * closed.
  * 
- * @param guess The player's guess for the secret key.
- * @param secret_key The secret key.
- * @param nB Pointer to store the number of black pegs (correct color and position).
- * @param nW Pointer to store the number of white pegs (correct color, wrong position).
+ * @param conn The rejected connection.
+ * @param force Answer even if the request has not arrived (deadline reached).
+ * @return 1 if the connection was answered and closed, 0 if it should wait.
  */
-void calculate_nB_nW(const char *guess, const char *secret_key, int *nB, int *nW) {
-    *nB = *nW = 0;
+static int answer_tcp_reject(PendingConn *conn, int force) {
+    char request[MAX_BUFFER_SIZE];
+    int n = recv(conn->fd, request, sizeof(request) - 1, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !force) return 0;
+
+    if (n > 0 || (n < 0 && force)) {
+        // Drain what was sent, so closing does not reset the connection under our reply
+        if (n > 0 && strncmp(request, "SSB", 3) == 0) {
+            send(conn->fd, "RSS EMPTY\n", 10, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "SRK", 3) == 0) {
+            send(conn->fd, "RRK NOK\n", 8, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "SBE", 3) == 0) {
+            send(conn->fd, "RBE NOK\n", 8, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "SAH", 3) == 0) {
+            send(conn->fd, "RAH NOK\n", 8, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "SPG", 3) == 0) {
+            send(conn->fd, "RPG EMPTY\n", 10, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "SPE", 3) == 0) {
+            send(conn->fd, "RPE EMPTY\n", 10, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "SRP", 3) == 0) {
+            send(conn->fd, "RRP ERR\n", 8, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else if (n > 0 && strncmp(request, "STK", 3) == 0) {
+            send(conn->fd, "RTK ERR\n", 8, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else {
+            send(conn->fd, "RST NOK\n", 8, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        if (verbose) {
+            printf("TCP rejected %s:%d: server busy\n", inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port));
+        }
+    }
+    close(conn->fd);
+    return 1;
+}
 
-    char temp_guess[COLOR_SEQUENCE_LEN + 1];
-    char temp_secret_key[COLOR_SEQUENCE_LEN + 1];
+/**
+ * @brief Admits, queues or rejects a newly accepted TCP connection.
+ *
+ * Up to tcp_max_workers connections are served at once, each by its own worker
+ * process. Beyond that, up to tcp_queue_limit connections wait in FIFO order for a
+ * worker to finish; once the queue is full too, new connections are rejected.
+ * 
+ * @param client_fd The accepted connection.
+ * @param client_addr Address of the client.
+ */
+void admit_tcp_connection(int client_fd, struct sockaddr_in *client_addr) {
+    if (tcp_workers < tcp_max_workers && tcp_queue_len == 0) {
+        start_tcp_worker(client_fd, client_addr);
+        return;
+    }
 
-    strncpy(temp_guess, guess, COLOR_SEQUENCE_LEN);
-    strncpy(temp_secret_key, secret_key, COLOR_SEQUENCE_LEN);
-    
-    temp_guess[COLOR_SEQUENCE_LEN] = '\0';
-    temp_secret_key[COLOR_SEQUENCE_LEN] = '\0';
+    PendingConn conn = { .fd = client_fd, .addr = *client_addr, .since = gs_clock.now };
+    if (tcp_queue_len < tcp_queue_limit) {
+        tcp_queue[(tcp_queue_head + tcp_queue_len++) % TCP_QUEUE_MAX] = conn;
+        return;
+    }
 
-    for (int i = 0; i < COLOR_SEQUENCE_LEN; i++) {
-        if (temp_guess[i] == temp_secret_key[i]) {
-            (*nB)++;
-            temp_guess[i] = temp_secret_key[i] = '*';
+    tcp_rejected++;
+    if (!answer_tcp_reject(&conn, 0)) {
+        // Waiting means a place in select()'s read set, which ends at FD_SETSIZE
+        if (tcp_reject_count < TCP_REJECT_MAX && client_fd < FD_SETSIZE) {
+            tcp_rejects[tcp_reject_count++] = conn;  // Answered when its request arrives
+        } else {
+            close(client_fd);
         }
     }
+}
 
-    for (int i = 0; i < COLOR_SEQUENCE_LEN; i++) {
-        if (temp_guess[i] != '*') {
-            for (int j = 0; j < COLOR_SEQUENCE_LEN; j++) {
-                if (temp_guess[i] == temp_secret_key[j] && temp_secret_key[j] != '*') {
-                    (*nW)++;
-                    temp_secret_key[j] = '*';
-                    break;
-                }
-            }
+/**
+ * @brief Collects finished workers and hands their slots to queued connections.
+ */
+void reap_tcp_workers() {
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        if (pid == compactor_pid) {
+            compactor_pid = 0;
+            continue;
         }
+        for (int i = 0; i < tcp_max_workers; i++) {
+            if (tcp_worker_pids[i] == pid) tcp_worker_pids[i] = 0;
+        }
+        tcp_workers--;
+    }
+
+    while (tcp_workers < tcp_max_workers && tcp_queue_len > 0) {
+        PendingConn conn = tcp_queue[tcp_queue_head];
+        tcp_queue_head = (tcp_queue_head + 1) % TCP_QUEUE_MAX;
+        tcp_queue_len--;
+        start_tcp_worker(conn.fd, &conn.addr);
     }
 }
 
 /**
- * @brief Entry point for the game server, initializing UDP and TCP listeners.
+ * @brief Adds the rejected connections still waiting for their request to a select set.
  * 
- * @param argc Argument count.
- * @param argv Argument vector.
- * @return Exit status of the program.
+ * @param read_fds The set passed to select.
+ * @param max_fd The highest descriptor in the set so far.
+ * @return The highest descriptor in the set.
  */
-int main(int argc, char *argv[]) {
-    char GSPort[] = DEFAULT_PORT;
-    signal(SIGINT, cleanup_and_exit);
+int add_tcp_rejects(fd_set *read_fds, int max_fd) {
+    for (int i = 0; i < tcp_reject_count; i++) {
+        FD_SET(tcp_rejects[i].fd, read_fds);
+        if (tcp_rejects[i].fd > max_fd) max_fd = tcp_rejects[i].fd;
+    }
+    return max_fd;
+}
 
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-p") == 0 && i+1 < argc) {
-            strcpy(GSPort, argv[++i]);
-        } else if (strcmp(argv[i], "-v") == 0) {
-            verbose = 1;
+/**
+ * @brief Answers rejected connections whose request arrived or whose time ran out.
+ * 
+ * @param read_fds The set returned by select.
+ */
+void service_tcp_rejects(fd_set *read_fds) {
+    time_t now = gs_clock.now;
+    for (int i = 0; i < tcp_reject_count; ) {
+        PendingConn *conn = &tcp_rejects[i];
+        int expired = now - conn->since >= TCP_REJECT_TIMEOUT;
+        if ((FD_ISSET(conn->fd, read_fds) || expired) && answer_tcp_reject(conn, expired)) {
+            tcp_rejects[i] = tcp_rejects[--tcp_reject_count];
+        } else {
+            i++;
         }
     }
+}
 
-    printf("Starting Game Server on port: %s\n", GSPort);
+/**
+ * @brief Makes the main loop's select() return.
+ *
+ * A signal that lands between the checks at the top of the loop and select() does
+ * not interrupt anything; the byte left in the self-pipe wakes it up instead.
+ */
+static void wake_main_loop() {
+    int saved_errno = errno;
+    ssize_t n = write(signal_pipe[1], "", 1);  // A full pipe already holds a wakeup
+    (void)n;
+    errno = saved_errno;
+}
+
+/**
+ * @brief SIGCHLD handler: wake the main loop so finished workers get reaped.
+ */
+static void handle_child_exit(int signum) {
+    (void)signum;
+    wake_main_loop();
+}
+
+/**
+ * @brief SIGUSR1 handler of TCP workers: close the connection after the current
+ * request. Also interrupts a worker waiting idle for its next request.
+ */
+static void handle_drain_request(int signum) {
+    (void)signum;
+    drain_requested = 1;
+}
+
+/**
+ * @brief SIGUSR2 handler: promote this replica once the main loop wakes up.
+ */
+static void handle_promote_request(int signum) {
+    (void)signum;
+    promote_requested = 1;
+    wake_main_loop();
+}
+
+/**
+ * @brief Stops serving after a successful handoff.
+ *
+ * The sockets now belong to the new process. This one only finishes the TCP
+ * connections it already accepted: busy workers are asked to close after their
+ * current request, and queued connections still get a worker.
+ */
+static void begin_drain() {
+    if (uring_active) uring_close();
+    replication_close();
+    close(udp_fd);
+    close(tcp_fd);
+    close(control_fd);
+    udp_fd = tcp_fd = control_fd = -1;
+    handed_off = 1;
+
+    for (int i = 0; i < tcp_max_workers; i++) {
+        if (tcp_worker_pids[i] != 0) kill(tcp_worker_pids[i], SIGUSR1);
+    }
+}
+
+/**
+ * @brief Forks the background process folding old per-game files into the archives.
+ *
+ * Started before the sockets are opened, so it holds none of them.
+ */
+static void start_archive_compactor() {
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed (archive compactor)");
+        return;
+    } else if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        errno = 0;
+        if (nice(10) == -1 && errno != 0) perror("nice");
+        compact_game_archives();
+        exit(0);
+    }
+    compactor_pid = pid;
+}
 
+/**
+ * @brief Creates and binds the UDP socket and the listening TCP socket.
+ *
+ * Exits the program if either cannot be set up.
+ * 
+ * @param GSPort The port to serve on.
+ */
+static void open_server_sockets(const char *GSPort) {
     struct addrinfo hints_udp, *res_udp;
     memset(&hints_udp, 0, sizeof(hints_udp));
     hints_udp.ai_family = AF_INET;
@@ -922,7 +1945,7 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    if (listen(tcp_fd, 5) == -1) {
+    if (listen(tcp_fd, tcp_backlog) == -1) {
         perror("listen failed");
         close(tcp_fd);
         freeaddrinfo(res_tcp);
@@ -931,24 +1954,228 @@ int main(int argc, char *argv[]) {
 
     freeaddrinfo(res_tcp);
     printf("TCP server listening on port %s\n", GSPort);
+}
+
+/**
+ * @brief Entry point for the game server, initializing UDP and TCP listeners.
+ * 
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return Exit status of the program.
+ */
+int main(int argc, char *argv[]) {
+    char GSPort[] = DEFAULT_PORT;
+    int seeded = 0;
+    unsigned rate = RATE_DEFAULT, burst = RATE_DEFAULT_BURST;
+    int takeover = 0;
+    int use_uring = 0;
+    const char *trace_path = NULL;
+    const char *replicate_port = NULL, *primary = NULL;
+    signal(SIGINT, cleanup_and_exit);
+    clock_tick();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i+1 < argc) {
+            strcpy(GSPort, argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            rng_seed(strtoull(argv[++i], NULL, 10));
+            seeded = 1;
+        } else if (strcmp(argv[i], "--rate") == 0 && i+1 < argc) {
+            rate = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--burst") == 0 && i+1 < argc) {
+            burst = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--trusted-proxy") == 0 && i+1 < argc) {
+            if (!rate_limiter_trust(&rate_limiter, argv[++i])) exit(1);
+        } else if (strcmp(argv[i], "--backlog") == 0 && i+1 < argc) {
+            tcp_backlog = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tcp-workers") == 0 && i+1 < argc) {
+            tcp_max_workers = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+        } else if (strcmp(argv[i], "--tcp-queue") == 0 && i+1 < argc) {
+            tcp_queue_limit = atoi(argv[++i]);
+            if (tcp_queue_limit < 0) tcp_queue_limit = 0;
+            if (tcp_queue_limit > TCP_QUEUE_MAX) tcp_queue_limit = TCP_QUEUE_MAX;
+        } else if (strcmp(argv[i], "--handoff") == 0 && i+1 < argc) {
+            handoff_path = argv[++i];
+        } else if (strcmp(argv[i], "--takeover") == 0) {
+            takeover = 1;
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            use_uring = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--replicate") == 0 && i+1 < argc) {
+            replicate_port = argv[++i];
+        } else if (strcmp(argv[i], "--replica-of") == 0 && i+1 < argc) {
+            primary = argv[++i];
+        }
+    }
+    tcp_worker_pids = calloc(tcp_max_workers, sizeof(pid_t));
+    if (!tcp_worker_pids) {
+        perror("calloc");
+        exit(1);
+    }
+    if (takeover && !handoff_path) {
+        fprintf(stderr, "Error: --takeover needs --handoff PATH of the running server\n");
+        exit(1);
+    }
+    if (primary && takeover) {
+        fprintf(stderr, "Error: a replica cannot take over a running server\n");
+        exit(1);
+    }
+    rate_limiter_configure(&rate_limiter, rate, burst, verbose);
+
+    if (!seeded && !rng_seed_random()) {
+        exit(1);
+    }
+    refill_key_pool();
+
+    printf("Starting Game Server on port: %s\n", GSPort);
+
+    // A replica's scores come from its primary
+    if (!init_scoreboard_cache(!primary) || !init_game_table() || !replication_init()) {
+        exit(1);
+    }
+
+    start_archive_compactor();
+
+    // A server taking over keeps tracing after its predecessor's events
+    if (trace_path && !trace_open(trace_path, takeover)) {
+        exit(1);
+    }
+
+    if (takeover) {
+        if (!handoff_receive(handoff_path, &udp_fd, &tcp_fd)) exit(1);
+    } else {
+        open_server_sockets(GSPort);
+    }
+    if (primary && !replication_follow(primary)) exit(1);
+    if (replicate_port && !replication_listen(replicate_port)) exit(1);
+
+    // A replica leaves the UDP socket alone until promoted
+    if (use_uring && !primary) {
+        if (uring_init(udp_fd)) {
+            printf("[*] Using the io_uring backend.\n");
+        } else {
+            printf("[!] io_uring unavailable; using the select loop.\n");
+        }
+    }
+    if (handoff_path) {
+        control_fd = handoff_listen(handoff_path);
+        if (control_fd == -1) exit(1);
+    }
+
+    // SIGCHLD wakes up select() so finished workers are reaped promptly
+    if (pipe2(signal_pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+        perror("pipe failed");
+        exit(1);
+    }
+    struct sigaction sa_child;
+    memset(&sa_child, 0, sizeof(sa_child));
+    sa_child.sa_handler = handle_child_exit;
+    sigaction(SIGCHLD, &sa_child, NULL);
 
-    fd_set read_fds;
-    int max_fd = (udp_fd > tcp_fd) ? udp_fd : tcp_fd;
+    // Inherited by workers, so a drain request can never kill one before it is ready
+    struct sigaction sa_drain;
+    memset(&sa_drain, 0, sizeof(sa_drain));
+    sa_drain.sa_handler = handle_drain_request;
+    sigaction(SIGUSR1, &sa_drain, NULL);
+
+    struct sigaction sa_promote;
+    memset(&sa_promote, 0, sizeof(sa_promote));
+    sa_promote.sa_handler = handle_promote_request;
+    sigaction(SIGUSR2, &sa_promote, NULL);
+
+    fd_set read_fds, write_fds;
 
     while (1) {
+        reap_tcp_workers();
+        if (handed_off && tcp_workers == 0 && tcp_queue_len == 0 && tcp_reject_count == 0) {
+            printf("[*] All TCP connections finished.\n");
+            cleanup_and_exit(0);
+        }
+
+        if (promote_requested) {
+            promote_requested = 0;
+            if (replication_role() == REPL_REPLICA) {
+                // Datagrams sent here before the promotion are stale
+                char stale[MAX_BUFFER_SIZE];
+                while (recv(udp_fd, stale, sizeof(stale), MSG_DONTWAIT) >= 0) ;
+                replication_promote();
+                if (use_uring && uring_init(udp_fd)) printf("[*] Using the io_uring backend.\n");
+            }
+        }
+
         FD_ZERO(&read_fds);
-        FD_SET(udp_fd, &read_fds);
-        FD_SET(tcp_fd, &read_fds);
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        int serving_udp = !handed_off && replication_role() != REPL_REPLICA;
+        if (!handed_off) {
+            FD_SET(tcp_fd, &read_fds);
+            max_fd = tcp_fd;
+            if (serving_udp) {
+                // With io_uring, datagrams arrive as completions on the ring
+                int datagram_fd = uring_active ? uring_fd() : udp_fd;
+                FD_SET(datagram_fd, &read_fds);
+                if (datagram_fd > max_fd) max_fd = datagram_fd;
+            }
+            if (control_fd != -1) {
+                FD_SET(control_fd, &read_fds);
+                if (control_fd > max_fd) max_fd = control_fd;
+            }
+            max_fd = replication_add_fds(&read_fds, &write_fds, max_fd);
+        }
+        max_fd = add_tcp_rejects(&read_fds, max_fd);
+        FD_SET(signal_pipe[0], &read_fds);
+        if (signal_pipe[0] > max_fd) max_fd = signal_pipe[0];
+
+        // Nothing else to do: make the events so far visible in the trace file
+        trace_flush();
+
+        // Rejected connections expire and a draining server polls for its last workers
+        struct timeval tick = { .tv_sec = TCP_REJECT_TIMEOUT, .tv_usec = 0 };
+        struct timeval *timeout = (tcp_reject_count > 0 || handed_off) ? &tick : NULL;
+
+        // Wake up when the oldest score of a rolling scoreboard slides out
+        int expiry = scoreboard_expire(gs_clock.now);
+        if (expiry >= 0 && !handed_off && (!timeout || expiry < timeout->tv_sec)) {
+            tick.tv_sec = expiry;
+            timeout = &tick;
+        }
+
+        // Idle replication links are pinged so replicas can measure their lag
+        int ping = handed_off ? -1 : replication_timeout();
+        if (ping >= 0 && (!timeout || ping < timeout->tv_sec)) {
+            tick.tv_sec = ping;
+            timeout = &tick;
+        }
+        int activity = select(max_fd + 1, &read_fds, &write_fds, NULL, timeout);
+        clock_tick();
 
-        int activity = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-        
         if (activity < 0) {
-            perror("Select error");
+            if (errno != EINTR) perror("Select error");
             continue;
         }
 
-        if (FD_ISSET(udp_fd, &read_fds)) {
-            handle_udp_commands();
+        if (FD_ISSET(signal_pipe[0], &read_fds)) {
+            char wakeups[64];
+            while (read(signal_pipe[0], wakeups, sizeof(wakeups)) > 0) ;
+        }
+
+        service_tcp_rejects(&read_fds);
+
+        if (handed_off) continue;
+
+        replication_service(&read_fds, &write_fds);
+
+        if (serving_udp && (uring_active ? FD_ISSET(uring_fd(), &read_fds) : FD_ISSET(udp_fd, &read_fds))) {
+            if (uring_active) {
+                uring_process();
+            } else {
+                handle_udp_commands();
+            }
+            // Replace any key taken by SNG now that the reply is out
+            refill_key_pool();
         }
 
         if (FD_ISSET(tcp_fd, &read_fds)) {
@@ -961,18 +2188,16 @@ int main(int argc, char *argv[]) {
                 continue;
             }
 
-            pid_t pid = fork();
-            if (pid < 0) {
-                perror("fork failed");
-                close(client_fd);
-                continue;
-            } else if (pid == 0) {
-                close(tcp_fd);
-                handle_tcp_connection(client_fd, &client_addr);
-                close(client_fd);
-                exit(0);
-            } else {
-                close(client_fd);
+            admit_tcp_connection(client_fd, &client_addr);
+        }
+
+        if (control_fd != -1 && FD_ISSET(control_fd, &read_fds)) {
+            // Datagrams the ring already holds must be in the snapshot
+            if (uring_active) uring_quiesce();
+            if (handoff_send(control_fd, udp_fd, tcp_fd)) {
+                begin_drain();
+            } else if (uring_active) {
+                uring_resume();
             }
         }
     }
@@ -980,17 +2205,6 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
-/**
- * @brief Formats a secret key for display.
- * 
- * @param formatted_key The formatted key to output.
- * @param secret_key The secret key to format.
- */
-void format_secret_key(char *formatted_key, const char *secret_key) {
-    snprintf(formatted_key, 8, "%c %c %c %c", 
-             secret_key[0], secret_key[1], secret_key[2], secret_key[3]);
-}
-
 /**
  * @brief Finds the last game file for a given player.
  * 
@@ -1029,13 +2243,23 @@ void cleanup_and_exit(int signum) {
 
     if (udp_fd > 0) close(udp_fd);
     if (tcp_fd > 0) close(tcp_fd);
+    if (control_fd > 0) {
+        close(control_fd);
+        unlink(handoff_path);  // After a handoff the path belongs to the new server
+    }
 
-    PlayerGame *current = player_games;
-    while (current != NULL) {
-        PlayerGame *next = current->next;
-        free(current);
-        current = next;
+    if (tcp_rejected > 0) {
+        printf("[*] Rejected %lu TCP connections while saturated.\n", tcp_rejected);
     }
+    if (rate_limiter.drops > 0) {
+        printf("[*] Rate limiter dropped %lu UDP datagrams.\n", rate_limiter.drops);
+    }
+    replication_close();
+
+    trace_flush();
+    if (game_table) munmap(game_table, MAX_PLAYERS * sizeof(PlayerGame));
+    memset(game_buckets, 0, sizeof(game_buckets));
+    free_games = NULL;
 
     printf("Resources cleaned up successfully. Exiting.\n");
     exit(0);
@@ -1,15 +1,71 @@
 #ifndef GS_H
 #define GS_H
 
-#define MAX_PLAYERS 100
+#define MAX_PLAYERS 1024      // Slots in the shared active-game table
+#define TCP_IDLE_TIMEOUT 30   // Seconds a keep-alive connection may stay idle
+#define TCP_MAX_REQUESTS 100  // Requests served over a single keep-alive connection
+#define KEY_POOL_SIZE 64      // Pre-generated secret keys
+#define RECENT_GAMES 256      // Ended games remembered to answer retransmitted TRY/QUT (power of two)
+#define SCOREBOARD_SIZE 10    // Entries returned by SSB
+#define SCOREBOARD_PAYLOAD_MAX (SCOREBOARD_SIZE * 64)
+#define SCORE_INDEX_CAPACITY (1 << 20)  // Scores held by the rank index; the lowest is evicted beyond
+#define SCORE_INDEX_MAX_DEPTH 128       // Longest path a reader follows before assuming a torn read
+#define SEQLOCK_READ_TRIES (1 << 20)    // Seqlock reads before a reader gives up on a stuck writer
+#define SEQLOCK_YIELD_EVERY 256         // Reads between sched_yield() calls while a write is in progress
+#define SCORE_PAGE_MAX 100              // Entries returned by one SPG page
+#define PLID_SPACE 1000000              // PLIDs are six digits
+#define SCORE_MAX 100                   // Scores range from 0 to SCORE_MAX
+#define SCORE_WINDOWS 2                 // Rolling scoreboards: last day, last week
+#define SCORE_WINDOW_CAPACITY 65536     // Scores held per window; the oldest leaves early beyond
+#define UDP_BATCH 64          // Datagrams read per wakeup (one recvmmsg)
+#define TCP_DEFAULT_BACKLOG 128  // listen() backlog (--backlog)
+#define TCP_DEFAULT_WORKERS 32   // Concurrent TCP worker processes (--tcp-workers)
+#define TCP_DEFAULT_QUEUE 64     // Accepted connections waiting for a worker (--tcp-queue)
+#define TCP_QUEUE_MAX 1024       // Upper bound for --tcp-queue
+#define TCP_REJECT_MAX 64        // Rejected connections waiting for their request line
+#define TCP_REJECT_TIMEOUT 1     // Seconds a rejected connection may take to send it
+#define HANDOFF_MAGIC 0x47534846 // "GSHF"
+#define HANDOFF_VERSION 1
+#define HANDOFF_TIMEOUT 5        // Seconds either side waits during a handoff
+#define URING_ENTRIES 512        // Submission queue of the io_uring backend (--io-uring)
+#define URING_SEND_SLOTS 128     // UDP replies in flight through io_uring
+#define URING_WRITE_SLOTS 128    // Game file appends in flight through io_uring
+#define GAME_FD_HEADROOM 256     // Descriptors under FD_SETSIZE kept free of game files for sockets
+#define ARCHIVE_RECORD_MAGIC 0x43455247  // "GREC"
+#define ARCHIVE_INDEX_MAGIC 0x58444947   // "GIDX"
+#define TRACE_MAGIC 0x52545347           // "GSTR"
+#define TRACE_VERSION 1
+#define TRACE_RING_EVENTS 4096           // Events buffered per process before a flush (--trace)
+#define REPL_MAGIC 0x4c505247            // "GRPL"
+#define REPL_VERSION 2
+#define REPL_MAX_REPLICAS 8              // Replicas a primary streams to at once (--replicate)
+#define REPL_BACKLOG_MAX (64 << 20)      // Unsent bytes a replica may fall behind by before it is dropped
+#define REPL_PING_INTERVAL 1             // Seconds between pings on an idle replication link
+#define REPL_PAYLOAD_MAX 16384           // Largest record payload (a game file)
 
 #include <time.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sched.h>
 #include "../common.h"
+#include "../code.h"
+#include "../wire.h"
+#include "../ratelimit.h"
+#include "../gsclient.h"
+
+// Seconds the request that ended a game is answered again: the client's last
+// retransmission leaves at most GS_MAX_RETRANSMITS timeouts of GS_RTO_MAX_MS
+// after the first send, so a later repeat is a new request, not a lost reply.
+#define END_REPLAY_WINDOW ((GS_RTO_MAX_MS * GS_MAX_RETRANSMITS + 999) / 1000)
 
 
 #define WIN "W"
@@ -17,45 +73,410 @@
 #define QUIT "Q"
 #define TIMEOUT "T"
 
-#define PLAY "P"
-#define DEBUG "D"
+#define MODE_PLAY 0
+#define MODE_DEBUG 1
+#define MODE_ALL 2            // Score views: both modes together
+
+#define GAME_BUCKETS 1024     // Hash buckets for active games (power of two)
 
 typedef struct PlayerGame {
-    char PLID[7];
-    char mode[7];
-    char secret_key[5];
+    unsigned seq;            // Seqlock for readers in forked TCP workers
+    uint32_t plid;
+    uint8_t in_use;
+    uint8_t mode;            // MODE_PLAY or MODE_DEBUG
+    uint8_t geometry;        // Index in geometries[] (pegs x colors)
+    uint8_t current_trial;
+    Code secret_key;
+    Code trials[MAX_TRIALS]; // Codes tried so far (current_trial - 1 of them)
     int total_duration;
     int remaining_time;
     int elapsed_time;
-    int current_trial;
-    int expected_trial;
-    char last_guess[5]; 
     time_t last_update_time;
     time_t start_time;
-    struct PlayerGame *next; // Linked list pointer to the next player
+    struct sockaddr_in source; // Sender of the SNG/DBG that started it
+    struct PlayerGame *next; // Next game in the same hash bucket (or free list)
 } PlayerGame;
 
+typedef struct {
+    uint32_t plid;
+    Code secret_key;
+    Code last_guess;    // The winning or failing guess (W, F)
+    uint8_t trial;      // Its trial number
+    uint8_t pegs;
+    char status;        // W, F or Q
+    struct sockaddr_in source; // Sender of the request that ended it
+    time_t end_time;    // 0 for an empty slot
+} RecentGame;
+
 typedef struct {
     int SSS;            // Score (number of attempts)
-    char PLID[7];
-    char secret_key[5];
-    int total_plays;
-    char mode[16];
+    uint32_t plid;
+    Code secret_key;
+    uint8_t total_plays;
+    uint8_t mode;       // MODE_PLAY or MODE_DEBUG
+    uint8_t geometry;   // Index in geometries[] (pegs x colors)
+    int64_t end_time;   // When the game was won
 } ScoreEntry;
 
+/*
+ * Order-statistic index over every score: a treap ordered by score (descending),
+ * then end time, PLID and mode, whose nodes count the PLAY and DEBUG entries of
+ * their subtree. Nodes are numbered from 1 (0 is "none") so the index can live in
+ * a shared mapping read by the TCP workers.
+ */
+typedef struct {
+    ScoreEntry entry;
+    int32_t left, right;
+    uint32_t priority;
+    uint32_t count[2];  // Entries of each mode in this subtree
+} ScoreNode;
+
+typedef struct {
+    unsigned seq;                     // Seqlock; the UDP loop is the only writer
+    int32_t root;
+    int32_t used;                     // Nodes handed out so far
+    uint64_t rng;                     // Treap priorities
+    int32_t best[2][PLID_SPACE];      // Best entry of each player, per mode
+    ScoreNode nodes[SCORE_INDEX_CAPACITY + 1];
+} ScoreIndex;
+
+/*
+ * Hot-restart snapshot: a header (sent along with the sockets), then one
+ * fixed-layout record per active game.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t games;
+} HandoffHeader;
+
+typedef struct {
+    uint32_t plid;
+    uint8_t mode;
+    uint8_t geometry;
+    uint8_t current_trial;
+    uint32_t secret_key;
+    uint32_t trials[MAX_TRIALS];
+    int32_t total_duration;
+    int32_t remaining_time;
+    int32_t elapsed_time;
+    int64_t last_update_time;
+    int64_t start_time;
+} GameSnapshot;
+
+/*
+ * Replication stream (--replicate PORT / --replica-of HOST:PORT): fixed-layout
+ * records, each optionally followed by a payload, from the primary to a replica.
+ * A replica first receives every active game (with its game file) and every
+ * recorded score, then the changes as they happen. It acknowledges what it has
+ * applied with ReplAck records.
+ */
+#define REPL_HELLO 0          // First record; seq is the stream position
+#define REPL_SYNC_GAME 1      // Initial sync: an active game, payload is its game file
+#define REPL_SYNC_SCORE 2     // Initial sync: a recorded score
+#define REPL_SYNC_DONE 3      // Initial sync complete
+#define REPL_START 4          // A game started (game file created)
+#define REPL_TRIAL 5          // A trial was written to a game file
+#define REPL_SCORE 6          // A win was recorded
+#define REPL_END 7            // A game ended (status)
+#define REPL_PING 8           // Idle link keep-alive; carries the primary's clock
+
+#define REPL_STANDALONE 0     // Roles
+#define REPL_PRIMARY 1
+#define REPL_REPLICA 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;         // Position in the primary's stream
+    int64_t sent_ms;      // Primary's wall clock when the record was published
+    uint8_t type;
+    char status;          // REPL_END: W, F, Q or T
+    uint8_t nB, nW;       // REPL_TRIAL
+    uint32_t guess;       // REPL_TRIAL
+    int32_t elapsed;      // REPL_TRIAL: elapsed time written with the trial
+    uint32_t length;      // Bytes of payload following the record
+    uint64_t dir_dev;     // REPL_HELLO: the primary's working directory (st_dev, st_ino)
+    uint64_t dir_ino;
+    GameSnapshot game;    // State of the game before the change
+    ScoreEntry score;     // REPL_SYNC_SCORE
+} ReplRecord;
+
+typedef struct {
+    uint64_t seq;         // Last record applied
+    int64_t sent_ms;      // Its sent_ms
+} ReplAck;
+
+typedef struct {
+    int fd;
+    char *out;            // Records not sent yet (from sent to len)
+    size_t len, sent, size;
+    uint64_t acked;       // Last record the replica applied
+    int64_t acked_ms;
+    char ack[sizeof(ReplAck)];
+    int ack_len;
+} ReplicaLink;
+
+typedef struct {
+    unsigned seq;         // Seqlock; the UDP loop is the only writer
+    int role;
+    uint64_t position;    // Primary: last record published; replica: last applied
+    uint64_t lag_records; // Primary: records the furthest-behind replica has not applied
+    int64_t lag_ms;       // Primary: age of that replica's last ack; replica: apply delay
+    int64_t applied_ms;   // Replica: when the last record arrived
+    int64_t sent_ms;      // Replica: sent_ms of the last record
+    int replicas;         // Primary: connected replicas
+} ReplicationStatus;
+
+/*
+ * Player archive (GAMES/<PLID>.arc): records of finished games, then their index
+ * sorted by end time, then the trailer locating the index.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t length;    // Bytes of game file text following the header
+    int64_t end_time;
+    char status;        // W, F, Q or T
+    char pad[7];
+} ArchiveRecord;
+
+typedef struct {
+    uint64_t offset;    // Of the record header
+    uint32_t length;
+    char status;
+    char pad[3];
+    int64_t end_time;
+} ArchiveEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t index_offset;
+} ArchiveTrailer;
+
+/*
+ * Request trace (--trace FILE): a TraceHeader, then TraceEvent records appended by
+ * the main process and the TCP workers. Each event marks the end of one phase of a
+ * request; TRACE_RECV marks its start.
+ */
+#define TRACE_RECV 0      // Request received
+#define TRACE_PARSE 1     // Request parsed (text) or decoded (binary)
+#define TRACE_LOOKUP 2    // Game state found (or created)
+#define TRACE_DUPSCAN 3   // Duplicate-trial scan done
+#define TRACE_SCORE 4     // nB/nW computed
+#define TRACE_PERSIST 5   // Game/score/archive files written
+#define TRACE_RENDER 6    // Reply rendered (STR view, UDP reply text or frame)
+#define TRACE_SEND 7      // Reply sent (queued, with io_uring)
+#define TRACE_DONE 8      // Request finished
+#define TRACE_PHASES 9
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t pad;
+} TraceHeader;
+
+typedef struct {
+    uint64_t ts_ns;     // CLOCK_MONOTONIC
+    uint32_t request;   // Request number within the process
+    uint32_t pid;
+    uint32_t plid;      // 0 if the request carries none
+    char command[3];    // e.g. "TRY", "SSB"
+    uint8_t phase;
+} TraceEvent;
+
+typedef struct {
+    time_t now;             // Wall clock, whole seconds
+    uint32_t mono_ms;       // Monotonic milliseconds
+    char date[11];          // YYYY-MM-DD, local time
+    char time[9];           // HH:MM:SS
+    char date_compact[9];   // DDMMYYYY, as in score file names
+    char time_compact[7];   // HHMMSS
+} CachedClock;
+
+typedef struct {
+    int fd;
+    struct sockaddr_in addr;
+    time_t since;       // When the connection was accepted
+} PendingConn;
+
+typedef struct {
+    unsigned seq;               // Seqlock sequence, odd while an update is in progress
+    unsigned long generation;   // Bumped on every recorded score
+    int count;
+    ScoreEntry top[SCOREBOARD_SIZE];
+    size_t len;
+    char payload[SCOREBOARD_PAYLOAD_MAX];
+} ScoreboardCache;
+
+/*
+ * Rolling-window scoreboard ("SSB DAY", "SSB WEEK"). The scores won within the
+ * window sit in a ring, oldest first; the ring slots of each score value are also
+ * chained oldest first, so the oldest entry of the window is always the head of
+ * its score's chain and expires in O(1). The top entries are the chain heads
+ * walked from SCORE_MAX down. Only the UDP loop touches the ring; the rendered
+ * board is a shared ScoreboardCache.
+ */
+typedef struct {
+    const char *name;        // As requested: "SSB <name>"
+    const char *fname;       // File name announced in the reply
+    time_t span;             // Seconds covered
+    ScoreEntry *ring;
+    int32_t *next;           // Next ring slot with the same score, -1 at the end
+    int head, len;
+    int32_t first[SCORE_MAX + 1], last[SCORE_MAX + 1];  // Chain ends per score, -1 if empty
+    ScoreboardCache *cache;
+} ScoreWindow;
+
+/*
+ * Single-writer seqlock used for state shared with forked TCP workers.
+ * Writers bracket updates with begin/end; readers copy the data and retry
+ * while seqlock_read_retry reports a concurrent update. A reader gives up after
+ * SEQLOCK_READ_TRIES attempts (seqlock_read_begin returns 0), so a writer that
+ * died mid-update fails its readers' requests instead of spinning them forever:
+ *
+ *     unsigned seq, tries = 0;
+ *     do {
+ *         if (!seqlock_read_begin(&x->seq, &seq, &tries)) return -1;
+ *         ... copy ...
+ *     } while (seqlock_read_retry(&x->seq, seq));
+ */
+static inline void seqlock_write_begin(unsigned *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(unsigned *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline int seqlock_read_begin(const unsigned *seq, unsigned *start, unsigned *tries) {
+    do {
+        if (++*tries > SEQLOCK_READ_TRIES) return 0;
+        if (*tries % SEQLOCK_YIELD_EVERY == 0) sched_yield();  // Let a preempted writer finish
+    } while ((*start = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1);
+    return 1;
+}
+
+static inline int seqlock_read_retry(const unsigned *seq, unsigned start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+extern int verbose;
+extern int uring_active;
+extern int trace_enabled;
+extern CachedClock gs_clock;
+
+void trace_record(uint8_t phase);
+void trace_start(const char *request);
+void trace_start_command(const char *command, uint32_t plid);
+
+/**
+ * @brief Marks the end of a phase of the current request; a single branch when
+ * tracing is off.
+ */
+static inline void trace_mark(uint8_t phase) {
+    if (__builtin_expect(trace_enabled, 0)) trace_record(phase);
+}
+
+/**
+ * @brief Starts tracing a new request (TRACE_RECV).
+ *
+ * @param request The request line; its command and PLID label the events.
+ */
+static inline void trace_begin(const char *request) {
+    if (__builtin_expect(trace_enabled, 0)) trace_start(request);
+}
+
+/**
+ * @brief Starts tracing a new request already decoded (binary frames).
+ */
+static inline void trace_begin_command(const char *command, uint32_t plid) {
+    if (__builtin_expect(trace_enabled, 0)) trace_start_command(command, plid);
+}
+extern PlayerGame *game_table;
+
 void handle_udp_commands();
+void handle_udp_datagram(const char *data, size_t len, struct sockaddr_in *addr);
 void handle_tcp_connection(int client_fd, struct sockaddr_in *client_addr);
-void generate_secret_key(char *secret_key);
-PlayerGame *find_or_create_game(const char *PLID, const char *time_str, const char *mode);
-PlayerGame *get_game(const char *PLID);
-void remove_game(const char *PLID, const char *status);
-void send_file_to_client(int client_fd, const char *status, const char *filepath);
-void format_secret_key(char *formatted_key, const char *secret_key);
-void calculate_nB_nW(const char *guess, const char *secret_key, int *nB, int *nW);
+int wants_keepalive(const char *line);
+Code generate_secret_key(int geometry);
+uint64_t rng_next();
+void rng_seed(uint64_t seed);
+int rng_seed_random();
+void refill_key_pool();
+PlayerGame *find_or_create_game(uint32_t plid, int total_duration, uint8_t mode, uint8_t geometry);
+PlayerGame *get_game(uint32_t plid);
+int init_game_table();
+int snapshot_game(uint32_t plid, PlayerGame *out);
+void capture_game(const PlayerGame *game, GameSnapshot *snap);
+PlayerGame *restore_game(const GameSnapshot *snap);
+void remove_game(uint32_t plid, const char *status);
+void create_game_file(PlayerGame *game);
+void update_game_file(const PlayerGame *game, Code guess, int time_elapsed, int nB, int nW);
+int render_trials(FILE *source_file, PlayerGame *game, char **out, size_t *out_len);
+void send_udp_reply(struct sockaddr_in *addr, const char *reply, size_t len);
+void send_reply(struct sockaddr_in *addr, WireReply *reply, int pegs);
+void send_data_to_client(int client_fd, const char *code, const char *status, const char *fname, const char *data, size_t size);
+void admit_tcp_connection(int client_fd, struct sockaddr_in *client_addr);
+void reap_tcp_workers();
+void service_tcp_rejects(fd_set *read_fds);
+int add_tcp_rejects(fd_set *read_fds, int max_fd);
+int handoff_listen(const char *path);
+int handoff_send(int control_fd, int udp, int tcp);
+int handoff_receive(const char *path, int *udp, int *tcp);
+int uring_init(int udp);
+int uring_fd();
+void uring_process();
+void uring_submit();
+int uring_send(const char *data, size_t len, const struct sockaddr_in *addr);
+int uring_write(int fd, const char *data, size_t len);
+void uring_flush_writes();
+void uring_quiesce();
+void uring_resume();
+void uring_close();
+int archive_append(uint32_t plid, const char *text, size_t len, time_t end_time, char status);
+int archive_read_last(uint32_t plid, char **text, size_t *len);
+void compact_game_archives();
+int trace_open(const char *path, int append);
+void trace_child();
+void trace_flush();
+void clock_tick();
+const CachedClock *clock_at(time_t when, CachedClock *scratch);
+int replication_init();
+int replication_listen(const char *port);
+int replication_follow(const char *primary);
+int replication_role();
+void replicate_game(uint8_t type, const PlayerGame *game);
+void replicate_trial(const PlayerGame *game, Code guess, int nB, int nW, int elapsed);
+void replicate_end(uint32_t plid, char status);
+int replication_add_fds(fd_set *read_fds, fd_set *write_fds, int max_fd);
+void replication_service(fd_set *read_fds, fd_set *write_fds);
+int replication_timeout();
+void replication_promote();
+int replication_status(ReplicationStatus *out);
+void replication_child();
+void replication_close();
 void cleanup_and_exit(int signum);
 void create_score_file(PlayerGame *game);
 ScoreEntry* load_scores(int *count);
 int compare_scores(const void *a, const void *b);
+int init_scoreboard_cache(int load);
+void scoreboard_load(ScoreEntry *scores, int count);
+void scoreboard_add(const ScoreEntry *entry);
+size_t scoreboard_snapshot(char *out, unsigned long *generation);
+int scoreboard_window_find(const char *name);
+const char *scoreboard_window_fname(int window);
+size_t scoreboard_window_snapshot(int window, char *out);
+int scoreboard_top(int window, ScoreEntry *out, char *generation, size_t size);
+int scoreboard_expire(time_t now);
+int format_score_entry(const ScoreEntry *e, char *out, size_t size);
+int score_rank(uint32_t plid, int mode, ScoreEntry *entry, int *rank, int *total);
+int score_page(int first, int count, int mode, ScoreEntry *out, int *total);
+int score_count_ahead(const ScoreEntry *probe, int mode, int *ahead, int *total);
+
 
 int calculate_score(int total_trials, int game_duration, int max_duration);
 int FindLastGame(const char *PLID, char *filename);
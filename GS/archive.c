@@ -0,0 +1,443 @@
+#include "GS.h"
+#include "../common.h"
+#include <fcntl.h>
+#include <sys/file.h>
+
+/*
+ * Per-player archive of finished games: GAMES/<PLID>.arc.
+ *
+ * The file holds one record per game (an ArchiveRecord header followed by the text
+ * of the former per-game file), then an index of ArchiveEntry sorted by end time,
+ * then an ArchiveTrailer locating the index. Appending a game truncates the file
+ * to the end of the records (dropping the old index and trailer), writes its record
+ * there and writes the grown index and trailer after it, so a valid trailer always
+ * ends the file. A missing or torn trailer (a crash mid-append) is recovered by
+ * walking the records from the start.
+ *
+ * The UDP loop and the compactor append under an exclusive flock; TCP workers read
+ * under a shared one. The compactor reads the per-game files before taking the lock,
+ * so the UDP loop only ever waits for the appends themselves.
+ */
+
+/**
+ * @brief Opens and locks the archive of a player.
+ *
+ * @param plid The player's ID.
+ * @param writable Open for appending (created if missing) under an exclusive lock.
+ * @return The descriptor, or -1 if the archive cannot be opened.
+ */
+static int archive_open(uint32_t plid, int writable) {
+    char path[64];
+    snprintf(path, sizeof(path), "GAMES/%06u.arc", plid);
+
+    int fd = writable ? open(path, O_RDWR | O_CREAT, 0666) : open(path, O_RDONLY);
+    if (fd == -1) {
+        if (writable || errno != ENOENT) perror("Failed to open game archive");
+        return -1;
+    }
+    while (flock(fd, writable ? LOCK_EX : LOCK_SH) == -1) {
+        if (errno != EINTR) {
+            perror("Failed to lock game archive");
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * @brief Reads exactly len bytes at offset.
+ */
+static int read_at(int fd, void *data, size_t len, uint64_t offset) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Writes exactly len bytes at offset.
+ */
+static int write_at(int fd, const void *data, size_t len, uint64_t offset) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads the trailer and checks it describes an index ending the file.
+ *
+ * @return 1 if the trailer is valid, 0 otherwise (empty or torn archive).
+ */
+static int read_trailer(int fd, ArchiveTrailer *trailer) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*trailer)) return 0;
+
+    uint64_t size = st.st_size;
+    if (!read_at(fd, trailer, sizeof(*trailer), size - sizeof(*trailer))) return 0;
+    return trailer->magic == ARCHIVE_INDEX_MAGIC &&
+           trailer->index_offset + (uint64_t)trailer->count * sizeof(ArchiveEntry) + sizeof(*trailer) == size;
+}
+
+/**
+ * @brief Inserts an entry into an index, keeping it sorted by end time.
+ */
+static void index_insert(ArchiveEntry *entries, uint32_t *count, const ArchiveEntry *entry) {
+    uint32_t i = *count;
+    while (i > 0 && entries[i - 1].end_time > entry->end_time) {
+        entries[i] = entries[i - 1];
+        i--;
+    }
+    entries[i] = *entry;
+    (*count)++;
+}
+
+/**
+ * @brief Loads the whole index of an archive.
+ *
+ * @param fd The locked archive.
+ * @param count Set to the number of games.
+ * @param data_end Set to where the records end (the next record goes there).
+ * @param extra Room to reserve for entries the caller will insert.
+ * @return The malloc'd index (the caller frees it), or NULL on failure.
+ */
+static ArchiveEntry *load_index(int fd, uint32_t *count, uint64_t *data_end, uint32_t extra) {
+    ArchiveTrailer trailer;
+    ArchiveEntry *entries;
+
+    if (read_trailer(fd, &trailer)) {
+        entries = malloc(((size_t)trailer.count + extra + 1) * sizeof(ArchiveEntry));
+        if (!entries) {
+            perror("malloc archive index");
+            return NULL;
+        }
+        if (!read_at(fd, entries, (size_t)trailer.count * sizeof(ArchiveEntry), trailer.index_offset)) {
+            free(entries);
+            return NULL;
+        }
+        *count = trailer.count;
+        *data_end = trailer.index_offset;
+        return entries;
+    }
+
+    // No usable trailer: rebuild the index from the records that are complete
+    struct stat st;
+    if (fstat(fd, &st) == -1) return NULL;
+    uint32_t capacity = 64 + extra;
+    entries = malloc(capacity * sizeof(ArchiveEntry));
+    if (!entries) {
+        perror("malloc archive index");
+        return NULL;
+    }
+
+    uint64_t offset = 0;
+    *count = 0;
+    ArchiveRecord record;
+    while (offset + sizeof(record) <= (uint64_t)st.st_size &&
+           read_at(fd, &record, sizeof(record), offset) &&
+           record.magic == ARCHIVE_RECORD_MAGIC &&
+           offset + sizeof(record) + record.length <= (uint64_t)st.st_size) {
+        if (*count + extra + 1 >= capacity) {
+            capacity *= 2;
+            ArchiveEntry *grown = realloc(entries, capacity * sizeof(ArchiveEntry));
+            if (!grown) {
+                perror("realloc archive index");
+                free(entries);
+                return NULL;
+            }
+            entries = grown;
+        }
+        ArchiveEntry entry = { .offset = offset, .length = record.length, .status = record.status, .end_time = record.end_time };
+        index_insert(entries, count, &entry);
+        offset += sizeof(record) + record.length;
+    }
+    if (st.st_size > 0) {
+        printf("[*] Recovered %u games from an archive without a valid index.\n", *count);
+    }
+    *data_end = offset;
+    return entries;
+}
+
+/**
+ * @brief Writes one game record at data_end.
+ *
+ * The file is first cut back to data_end: the old index and trailer go before any
+ * record byte lands on them, so a crash before store_index leaves an archive
+ * without a trailer (recovered from the records) rather than a stale trailer
+ * describing record bytes as index entries.
+ *
+ * @param entry Set to the index entry of the record.
+ * @return The new end of the records, or 0 on failure.
+ */
+static uint64_t put_record(int fd, uint64_t data_end, const char *text, size_t len, time_t end_time, char status, ArchiveEntry *entry) {
+    ArchiveRecord record = { .magic = ARCHIVE_RECORD_MAGIC, .length = len, .end_time = end_time, .status = status };
+    struct iovec iov[2] = {
+        { .iov_base = &record, .iov_len = sizeof(record) },
+        { .iov_base = (void *)text, .iov_len = len },
+    };
+    if (ftruncate(fd, data_end) == -1) {
+        perror("Failed to truncate game archive");
+        return 0;
+    }
+    ssize_t n = pwritev(fd, iov, 2, data_end);
+    if (n != (ssize_t)(sizeof(record) + len)) {
+        // A short write leaves a torn record that recovery ignores; retry it whole
+        if (n < 0 || !write_at(fd, &record, sizeof(record), data_end) || !write_at(fd, text, len, data_end + sizeof(record))) {
+            perror("Failed to write game archive");
+            return 0;
+        }
+    }
+    *entry = (ArchiveEntry){ .offset = data_end, .length = len, .status = status, .end_time = end_time };
+    return data_end + sizeof(record) + len;
+}
+
+/**
+ * @brief Writes the index and trailer after the records.
+ */
+static int store_index(int fd, uint64_t data_end, const ArchiveEntry *entries, uint32_t count) {
+    ArchiveTrailer trailer = { .magic = ARCHIVE_INDEX_MAGIC, .count = count, .index_offset = data_end };
+    size_t index_len = (size_t)count * sizeof(ArchiveEntry);
+    if (!write_at(fd, entries, index_len, data_end) || !write_at(fd, &trailer, sizeof(trailer), data_end + index_len)) {
+        perror("Failed to write game archive index");
+        return 0;
+    }
+    // Only shrinks after recovering from a torn append without writing a record
+    if (ftruncate(fd, data_end + index_len + sizeof(trailer)) == -1) {
+        perror("Failed to truncate game archive");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Appends a finished game to its player's archive.
+ *
+ * @param plid The player's ID.
+ * @param text The game file contents.
+ * @param len Length of the contents.
+ * @param end_time When the game ended.
+ * @param status The status letter of the game (W, F, Q or T).
+ * @return 1 on success, 0 on failure.
+ */
+int archive_append(uint32_t plid, const char *text, size_t len, time_t end_time, char status) {
+    int fd = archive_open(plid, 1);
+    if (fd == -1) return 0;
+
+    uint32_t count;
+    uint64_t data_end;
+    ArchiveEntry *entries = load_index(fd, &count, &data_end, 1);
+    int ok = 0;
+    if (entries) {
+        ArchiveEntry entry;
+        data_end = put_record(fd, data_end, text, len, end_time, status, &entry);
+        if (data_end) {
+            index_insert(entries, &count, &entry);
+            ok = store_index(fd, data_end, entries, count);
+        }
+        free(entries);
+    }
+    close(fd);
+    return ok;
+}
+
+/**
+ * @brief Reads the most recent game of a player from the archive.
+ *
+ * Reads the trailer, the last index entry and the record it points to.
+ *
+ * @param plid The player's ID.
+ * @param text Set to a malloc'd copy of the game file contents; the caller frees it.
+ * @param len Set to the length of the contents.
+ * @return 1 if a game was found, 0 otherwise.
+ */
+int archive_read_last(uint32_t plid, char **text, size_t *len) {
+    int fd = archive_open(plid, 0);
+    if (fd == -1) return 0;
+
+    ArchiveEntry last;
+    ArchiveTrailer trailer;
+    int found = 0;
+    if (read_trailer(fd, &trailer)) {
+        found = trailer.count > 0 &&
+                read_at(fd, &last, sizeof(last), trailer.index_offset + (uint64_t)(trailer.count - 1) * sizeof(last));
+    } else {
+        uint32_t count;
+        uint64_t data_end;
+        ArchiveEntry *entries = load_index(fd, &count, &data_end, 0);
+        if (entries && count > 0) {
+            last = entries[count - 1];
+            found = 1;
+        }
+        free(entries);
+    }
+
+    if (found) {
+        *text = malloc(last.length + 1);
+        found = *text && read_at(fd, *text, last.length, last.offset + sizeof(ArchiveRecord));
+        if (found) {
+            (*text)[last.length] = '\0';
+            *len = last.length;
+        } else {
+            free(*text);
+        }
+    }
+    close(fd);
+    return found;
+}
+
+/**
+ * @brief A per-game file read by the compactor, waiting to be archived.
+ */
+typedef struct {
+    char *text;
+    size_t len;
+    time_t end_time;
+    char status;
+} CompactFile;
+
+/**
+ * @brief Reads a per-game file named <YYYYmmdd>_<HHMMSS>_<status>.txt.
+ *
+ * @return 1 if the file was read into game, 0 if it is not a game file or is empty.
+ */
+static int read_game_file(const char *path, const char *name, CompactFile *game) {
+    struct tm t = {0};
+    if (sscanf(name, "%4d%2d%2d_%2d%2d%2d_%c.txt", &t.tm_year, &t.tm_mon, &t.tm_mday,
+               &t.tm_hour, &t.tm_min, &t.tm_sec, &game->status) != 7) {
+        return 0;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    game->end_time = mktime(&t);
+
+    FILE *file = fopen(path, "r");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    game->text = NULL;
+    game->len = 0;
+    if (size > 0 && (game->text = malloc(size))) game->len = fread(game->text, 1, size, file);
+    fclose(file);
+    if (game->len == 0) {
+        free(game->text);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Folds the per-game files of one player directory into the archive.
+ *
+ * Every file is read first; the archive is then locked only to append the records
+ * and write the index once. Each file is removed once the index holding it is
+ * written; a file whose game is already indexed (a compaction interrupted before
+ * removing it) is just removed.
+ *
+ * @return The number of games moved into the archive.
+ */
+static int compact_player(uint32_t plid, const char *dir) {
+    struct dirent **files;
+    int n = scandir(dir, &files, NULL, alphasort);
+    if (n < 0) return 0;
+
+    CompactFile *games = calloc(n > 0 ? n : 1, sizeof(CompactFile));
+    char *done = calloc(n > 0 ? n : 1, 1);  // Files whose game is in the index
+    char path[320];
+    int moved = 0, ok = 0;
+
+    for (int i = 0; i < n && games; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]->d_name);
+        if (!read_game_file(path, files[i]->d_name, &games[i])) games[i].text = NULL;
+    }
+
+    int fd = games && done ? archive_open(plid, 1) : -1;
+    uint32_t count = 0;
+    uint64_t data_end = 0;
+    ArchiveEntry *entries = fd == -1 ? NULL : load_index(fd, &count, &data_end, n);
+    for (int i = 0; i < n && entries; i++) {
+        CompactFile *game = &games[i];
+        if (!game->text) continue;
+
+        int duplicate = 0;
+        for (uint32_t j = 0; j < count && !duplicate; j++) {
+            duplicate = entries[j].end_time == game->end_time && entries[j].status == game->status &&
+                        entries[j].length == game->len;
+        }
+        if (!duplicate) {
+            ArchiveEntry entry;
+            uint64_t end = put_record(fd, data_end, game->text, game->len, game->end_time, game->status, &entry);
+            if (!end) break;
+            data_end = end;
+            index_insert(entries, &count, &entry);
+            moved++;
+        }
+        done[i] = 1;
+    }
+    // Also rewrites the index after a failed put_record, which has already dropped it
+    if (entries) ok = store_index(fd, data_end, entries, count);
+    free(entries);
+    if (fd != -1) close(fd);
+
+    // Remove the files only once the index covering them is on disk
+    if (ok) {
+        for (int i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i]->d_name);
+            if (done[i]) unlink(path);
+        }
+        rmdir(dir);  // Fails harmlessly if anything was left behind
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (games) free(games[i].text);
+        free(files[i]);
+    }
+    free(games);
+    free(done);
+    free(files);
+    return moved;
+}
+
+/**
+ * @brief Folds every per-game file left under GAMES/<PLID>/ into the player archives.
+ *
+ * Runs in a background process at startup; safe against the server appending to
+ * the same archives meanwhile.
+ */
+void compact_game_archives() {
+    DIR *games = opendir("GAMES");
+    if (!games) return;
+
+    struct dirent *entry;
+    int players = 0, moved = 0;
+    while ((entry = readdir(games)) != NULL) {
+        uint32_t plid;
+        char dir[300];
+        struct stat st;
+        if (!parse_plid(entry->d_name, &plid)) continue;
+        snprintf(dir, sizeof(dir), "GAMES/%s", entry->d_name);
+        if (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode)) continue;
+
+        moved += compact_player(plid, dir);
+        players++;
+    }
+    closedir(games);
+
+    if (moved > 0) {
+        printf("[*] Compactor archived %d games of %d players.\n", moved, players);
+    }
+}
@@ -0,0 +1,60 @@
+#include "GS.h"
+#include "../common.h"
+
+/*
+ * Cached clock. The event loop ticks it once per wakeup (and a TCP worker once per
+ * request); everything handling that event reads the same instant from gs_clock
+ * instead of calling time() again. The local date and time strings used in game
+ * and score files are only reformatted when the second changes.
+ */
+CachedClock gs_clock;
+
+/**
+ * @brief Formats the date and time strings of a cached clock for its `now`.
+ */
+static void clock_format(CachedClock *c) {
+    struct tm t;
+    localtime_r(&c->now, &t);
+    strftime(c->date, sizeof(c->date), "%Y-%m-%d", &t);
+    strftime(c->time, sizeof(c->time), "%H:%M:%S", &t);
+    strftime(c->date_compact, sizeof(c->date_compact), "%d%m%Y", &t);
+    strftime(c->time_compact, sizeof(c->time_compact), "%H%M%S", &t);
+}
+
+/**
+ * @brief Reads the clocks once for the current event.
+ */
+void clock_tick() {
+    static int initialized = 0;
+    if (!initialized) {
+        tzset();  // Once: localtime_r does not look at TZ again
+        initialized = 1;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    gs_clock.mono_ms = (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+
+    time_t now = time(NULL);
+    if (now != gs_clock.now) {
+        gs_clock.now = now;
+        clock_format(&gs_clock);
+    }
+}
+
+/**
+ * @brief Returns the formatted local time of a timestamp.
+ *
+ * Timestamps taken during the current event match gs_clock and cost nothing;
+ * others are formatted into scratch.
+ *
+ * @param when The timestamp.
+ * @param scratch Storage used when `when` is not the cached second.
+ * @return &gs_clock or scratch.
+ */
+const CachedClock *clock_at(time_t when, CachedClock *scratch) {
+    if (when == gs_clock.now) return &gs_clock;
+    scratch->now = when;
+    clock_format(scratch);
+    return scratch;
+}
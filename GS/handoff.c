@@ -0,0 +1,207 @@
+#include "GS.h"
+#include "../common.h"
+#include <sys/un.h>
+
+/*
+ * Hot restart: a running GS listens on a Unix socket (--handoff PATH). A new GS
+ * started with --takeover connects to it and receives, in one exchange, the
+ * listening UDP and TCP sockets (SCM_RIGHTS) and a binary snapshot of the active
+ * games. The old process stops reading the sockets before taking the snapshot, so
+ * datagrams arriving meanwhile simply wait in the shared socket for the new one.
+ * It only gives them up once the new process acknowledges the whole snapshot.
+ */
+
+/**
+ * @brief Writes exactly len bytes to a stream socket.
+ */
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads exactly len bytes from a stream socket.
+ */
+static int read_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Fills a Unix socket address for path.
+ *
+ * @return 1 on success, 0 if the path is too long.
+ */
+static int handoff_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Handoff socket path too long: %s\n", path);
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+/**
+ * @brief Starts listening for takeover requests.
+ *
+ * @param path Path of the Unix socket; a stale socket file is replaced.
+ * @return The listening descriptor, or -1 on failure.
+ */
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (!handoff_address(path, &addr)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("Handoff socket creation failed");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1) {
+        perror("Handoff socket bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Hands the listening sockets and the active games to a new GS process.
+ *
+ * Called by the main loop when the handoff socket is readable. While this runs no
+ * request is processed, so the snapshot is exactly the state the new process
+ * continues from.
+ *
+ * @param control_fd The listening handoff socket.
+ * @param udp The UDP socket to hand over.
+ * @param tcp The listening TCP socket to hand over.
+ * @return 1 if the new process took over (the caller must stop serving), 0 otherwise.
+ */
+int handoff_send(int control_fd, int udp, int tcp) {
+    int fd = accept(control_fd, NULL, NULL);
+    if (fd == -1) {
+        perror("Handoff accept failed");
+        return 0;
+    }
+    struct timeval tv = { .tv_sec = HANDOFF_TIMEOUT, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    HandoffHeader header = { .magic = HANDOFF_MAGIC, .version = HANDOFF_VERSION, .games = 0 };
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (game_table[i].in_use) header.games++;
+    }
+
+    // The header travels with both descriptors
+    int fds[2] = { udp, tcp };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int ok = sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(header);
+    for (int i = 0; ok && i < MAX_PLAYERS; i++) {
+        PlayerGame *game = &game_table[i];
+        if (!game->in_use) continue;
+
+        GameSnapshot snap;
+        capture_game(game, &snap);
+        ok = write_all(fd, &snap, sizeof(snap));
+    }
+
+    char ack = 0;
+    ok = ok && read_all(fd, &ack, 1) && ack == 'K';
+    close(fd);
+
+    if (!ok) {
+        printf("[!] Handoff failed; still serving.\n");
+        return 0;
+    }
+    printf("[*] Handed %u active games and the sockets over to the new server.\n", header.games);
+    return 1;
+}
+
+/**
+ * @brief Takes over the sockets and active games of a running GS.
+ *
+ * @param path Path of the running server's handoff socket.
+ * @param udp Receives the UDP socket.
+ * @param tcp Receives the listening TCP socket.
+ * @return 1 on success, 0 on failure (the old server keeps serving).
+ */
+int handoff_receive(const char *path, int *udp, int *tcp) {
+    struct sockaddr_un addr;
+    if (!handoff_address(path, &addr)) return 0;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("Handoff connect failed");
+        if (fd != -1) close(fd);
+        return 0;
+    }
+    struct timeval tv = { .tv_sec = HANDOFF_TIMEOUT, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    HandoffHeader header;
+    int fds[2];
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+
+    ssize_t n = recvmsg(fd, &msg, 0);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != sizeof(header) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        fprintf(stderr, "Handoff failed: no sockets received\n");
+        close(fd);
+        return 0;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    if (header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION) {
+        fprintf(stderr, "Handoff failed: incompatible snapshot version %u\n", header.version);
+        close(fds[0]);
+        close(fds[1]);
+        close(fd);
+        return 0;
+    }
+
+    int restored = 0;
+    for (uint32_t i = 0; i < header.games; i++) {
+        GameSnapshot snap;
+        if (!read_all(fd, &snap, sizeof(snap))) break;
+        if (restore_game(&snap)) restored++;
+    }
+
+    if (restored != (int)header.games || !write_all(fd, "K", 1)) {
+        fprintf(stderr, "Handoff failed: snapshot incomplete (%d of %u games)\n", restored, header.games);
+        close(fds[0]);
+        close(fds[1]);
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    *udp = fds[0];
+    *tcp = fds[1];
+    printf("[*] Took over %d active games from the running server.\n", restored);
+    return 1;
+}
@@ -0,0 +1,709 @@
+#include "GS.h"
+#include "../common.h"
+#include <netinet/tcp.h>
+
+/*
+ * Primary/replica replication.
+ *
+ * A primary (--replicate PORT) accepts replicas on a loopback TCP port. A new
+ * replica is first sent the active games, each with its game file, and every score
+ * of the rank index; from then on every change the UDP loop persists (game
+ * started, trial written, win recorded, game ended) is published to all replicas
+ * as it happens. Records are queued per replica and written without blocking; a
+ * replica that falls REPL_BACKLOG_MAX bytes behind is dropped.
+ *
+ * A replica (--replica-of HOST:PORT) applies the records through the functions the
+ * UDP loop itself uses, so its game table, game files, archives, score files and
+ * scoreboards follow the primary's, and its TCP workers serve STR, SSB, SRK and
+ * SPG. It leaves UDP alone until it is promoted (SIGUSR2), typically after its
+ * primary died; it then serves games from the state it had applied.
+ *
+ * Since it writes GAMES/ and SCORES/ like the primary does, a replica must run in
+ * a working directory of its own: in the primary's, every trial and game would be
+ * written to the same files twice. The primary's HELLO names its directory, and a
+ * replica started in the same one refuses to follow it.
+ */
+
+#define REPL_INBOX_SIZE (sizeof(ReplRecord) + REPL_PAYLOAD_MAX + 65536)
+
+static int repl_role = REPL_STANDALONE;
+static ReplicationStatus *repl_status = NULL;  // Shared with the TCP workers (SRP)
+
+// Primary side
+static int listen_fd = -1;
+static const char *listen_port = NULL;  // --replicate; a replica listens once promoted
+static ReplicaLink links[REPL_MAX_REPLICAS];
+static int link_count = 0;
+static uint64_t repl_head = 0;          // Last record published
+static time_t last_publish = 0;
+
+// Replica side
+static int primary_fd = -1;
+static char inbox[REPL_INBOX_SIZE];     // Received bytes not applied yet
+static size_t inbox_len = 0;
+static uint64_t applied = 0;            // Last record applied
+static int64_t applied_sent_ms = 0;
+static int64_t applied_ms = 0;          // When it was applied
+static ScoreEntry *sync_scores = NULL;  // Scores of the initial sync, loaded at REPL_SYNC_DONE
+static int sync_count = 0, sync_capacity = 0;
+
+static void apply_record(const ReplRecord *r, const char *payload);
+
+/**
+ * @brief Wall clock in milliseconds (lag is measured across processes).
+ */
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Maps the status shared with the TCP workers.
+ *
+ * Must be called before any TCP worker is forked.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int replication_init() {
+    repl_status = mmap(NULL, sizeof(ReplicationStatus), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (repl_status == MAP_FAILED) {
+        perror("mmap replication status");
+        repl_status = NULL;
+        return 0;
+    }
+    memset(repl_status, 0, sizeof(ReplicationStatus));
+    return 1;
+}
+
+/**
+ * @brief Publishes the role, position and lag for SRP.
+ */
+static void update_status() {
+    if (!repl_status) return;
+    int64_t now = now_ms();
+
+    seqlock_write_begin(&repl_status->seq);
+    repl_status->role = repl_role;
+    repl_status->replicas = link_count;
+    if (repl_role == REPL_REPLICA) {
+        repl_status->position = applied;
+        repl_status->lag_records = 0;
+        repl_status->lag_ms = applied_ms > 0 ? applied_ms - applied_sent_ms : 0;
+        repl_status->applied_ms = applied_ms;
+        repl_status->sent_ms = applied_sent_ms;
+    } else {
+        repl_status->position = repl_head;
+        repl_status->lag_records = 0;
+        repl_status->lag_ms = 0;
+        for (int i = 0; i < link_count; i++) {
+            uint64_t behind = repl_head - links[i].acked;
+            if (behind > repl_status->lag_records) {
+                repl_status->lag_records = behind;
+                repl_status->lag_ms = now - links[i].acked_ms;
+            }
+        }
+    }
+    seqlock_write_end(&repl_status->seq);
+}
+
+/**
+ * @brief Copies the replication status (safe from the TCP workers).
+ *
+ * A replica that has heard nothing from its primary for two ping intervals reports
+ * the age of the last record it applied as its lag.
+ *
+ * @param out Receives the status.
+ * @return 1, or 0 if the status stayed mid-update (see SEQLOCK_READ_TRIES).
+ */
+int replication_status(ReplicationStatus *out) {
+    memset(out, 0, sizeof(*out));
+    if (!repl_status) return 1;
+    unsigned seq, tries = 0;
+    do {
+        if (!seqlock_read_begin(&repl_status->seq, &seq, &tries)) return 0;
+        memcpy(out, repl_status, sizeof(*out));
+    } while (seqlock_read_retry(&repl_status->seq, seq));
+
+    int64_t now = now_ms();
+    if (out->role == REPL_REPLICA && (out->applied_ms == 0 || now - out->applied_ms > 2000 * REPL_PING_INTERVAL)) {
+        out->lag_ms = out->sent_ms > 0 ? now - out->sent_ms : -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Returns REPL_STANDALONE, REPL_PRIMARY or REPL_REPLICA.
+ */
+int replication_role() {
+    return repl_role;
+}
+
+/**
+ * @brief Opens the loopback listener replicas connect to.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+static int open_listener(const char *port) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int errcode = getaddrinfo("127.0.0.1", port, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo (replication) error: %s\n", gai_strerror(errcode));
+        return 0;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    if (listen_fd == -1 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+        bind(listen_fd, res->ai_addr, res->ai_addrlen) == -1 || listen(listen_fd, REPL_MAX_REPLICAS) == -1) {
+        perror("Replication listener failed");
+        if (listen_fd != -1) close(listen_fd);
+        listen_fd = -1;
+        freeaddrinfo(res);
+        return 0;
+    }
+    freeaddrinfo(res);
+    repl_role = REPL_PRIMARY;
+    printf("[*] Accepting replicas on 127.0.0.1:%s\n", port);
+    update_status();
+    return 1;
+}
+
+/**
+ * @brief Makes this server a primary accepting replicas on a loopback port.
+ *
+ * A replica only remembers the port and starts listening once promoted.
+ *
+ * @param port The replication port.
+ * @return 1 on success, 0 on failure.
+ */
+int replication_listen(const char *port) {
+    listen_port = port;
+    if (repl_role == REPL_REPLICA) return 1;
+    return open_listener(port);
+}
+
+/**
+ * @brief Closes a replica's link and forgets it.
+ */
+static void drop_link(int i, const char *why) {
+    printf("[!] Replica dropped: %s.\n", why);
+    close(links[i].fd);
+    free(links[i].out);
+    links[i] = links[--link_count];
+}
+
+/**
+ * @brief Appends bytes to a replica's queue.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+static int queue_bytes(ReplicaLink *l, const void *data, size_t len) {
+    if (l->sent > 0 && l->sent == l->len) l->sent = l->len = 0;
+    if (l->len + len > l->size) {
+        size_t size = l->size ? l->size : 65536;
+        while (size < l->len + len) size *= 2;
+        char *out = realloc(l->out, size);
+        if (!out) return 0;
+        l->out = out;
+        l->size = size;
+    }
+    memcpy(l->out + l->len, data, len);
+    l->len += len;
+    return 1;
+}
+
+/**
+ * @brief Writes as much of a replica's queue as its socket takes without blocking.
+ *
+ * @return 1 if the link is fine, 0 if it failed.
+ */
+static int flush_link(ReplicaLink *l) {
+    while (l->sent < l->len) {
+        ssize_t n = send(l->fd, l->out + l->sent, l->len - l->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+        if (n <= 0) return 0;
+        l->sent += n;
+    }
+    l->sent = l->len = 0;
+    return 1;
+}
+
+/**
+ * @brief Initializes a record of the given type.
+ */
+static void fill_record(ReplRecord *r, uint8_t type, uint64_t seq) {
+    memset(r, 0, sizeof(*r));
+    r->magic = REPL_MAGIC;
+    r->version = REPL_VERSION;
+    r->type = type;
+    r->seq = seq;
+    r->sent_ms = now_ms();
+}
+
+/**
+ * @brief Numbers a record and queues it for every replica.
+ */
+static void publish(ReplRecord *r) {
+    r->seq = ++repl_head;
+    last_publish = gs_clock.now;
+    for (int i = link_count - 1; i >= 0; i--) {
+        ReplicaLink *l = &links[i];
+        if (!queue_bytes(l, r, sizeof(*r))) {
+            drop_link(i, "out of memory");
+        } else if (l->len - l->sent > REPL_BACKLOG_MAX) {
+            drop_link(i, "too far behind");
+        } else if (!flush_link(l)) {
+            drop_link(i, "link failed");
+        }
+    }
+}
+
+/**
+ * @brief Publishes a started game (REPL_START) or a recorded win (REPL_SCORE).
+ *
+ * @param type REPL_START or REPL_SCORE.
+ * @param game The game, as persisted.
+ */
+void replicate_game(uint8_t type, const PlayerGame *game) {
+    if (link_count == 0) return;
+    ReplRecord r;
+    fill_record(&r, type, 0);
+    capture_game(game, &r.game);
+    publish(&r);
+}
+
+/**
+ * @brief Publishes a trial written to a game file.
+ *
+ * @param game The game, before the trial is counted.
+ * @param guess The guess.
+ * @param nB Black pegs.
+ * @param nW White pegs.
+ * @param elapsed Elapsed time written with the trial.
+ */
+void replicate_trial(const PlayerGame *game, Code guess, int nB, int nW, int elapsed) {
+    if (link_count == 0) return;
+    ReplRecord r;
+    fill_record(&r, REPL_TRIAL, 0);
+    capture_game(game, &r.game);
+    r.guess = guess;
+    r.nB = nB;
+    r.nW = nW;
+    r.elapsed = elapsed;
+    publish(&r);
+}
+
+/**
+ * @brief Publishes the end of a game.
+ *
+ * @param plid The player's ID.
+ * @param status W, F, Q or T.
+ */
+void replicate_end(uint32_t plid, char status) {
+    if (link_count == 0) return;
+    ReplRecord r;
+    fill_record(&r, REPL_END, 0);
+    r.game.plid = plid;
+    r.status = status;
+    publish(&r);
+}
+
+/**
+ * @brief Accepts a replica and queues the initial sync: the active games with their
+ * game files, then every score of the rank index.
+ */
+static void accept_replica() {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = accept(listen_fd, (struct sockaddr *)&addr, &len);
+    if (fd == -1) {
+        perror("Replica accept failed");
+        return;
+    }
+    if (link_count == REPL_MAX_REPLICAS) {
+        printf("[!] Replica refused: already streaming to %d.\n", REPL_MAX_REPLICAS);
+        close(fd);
+        return;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    ReplicaLink *l = &links[link_count++];
+    memset(l, 0, sizeof(*l));
+    l->fd = fd;
+    l->acked_ms = now_ms();
+
+    ReplRecord r;
+    struct stat dir;
+    fill_record(&r, REPL_HELLO, repl_head);
+    if (stat(".", &dir) == 0) {
+        r.dir_dev = dir.st_dev;
+        r.dir_ino = dir.st_ino;
+    }
+    int ok = queue_bytes(l, &r, sizeof(r));
+
+    // Appends queued by the io_uring backend must reach the files first
+    if (uring_active) uring_flush_writes();
+    static char file[REPL_PAYLOAD_MAX];
+    int games = 0;
+    for (int i = 0; ok && i < MAX_PLAYERS; i++) {
+        if (!game_table[i].in_use) continue;
+        fill_record(&r, REPL_SYNC_GAME, repl_head);
+        capture_game(&game_table[i], &r.game);
+
+        char filename[64];
+        snprintf(filename, sizeof(filename), "GAMES/GAME_%06u.txt", r.game.plid);
+        FILE *f = fopen(filename, "r");
+        if (f) {
+            r.length = fread(file, 1, sizeof(file), f);
+            fclose(f);
+        }
+        ok = queue_bytes(l, &r, sizeof(r)) && queue_bytes(l, file, r.length);
+        games++;
+    }
+
+    ScoreEntry page[SCORE_PAGE_MAX];
+    int total, n, scores = 0;
+    while (ok && (n = score_page(scores + 1, SCORE_PAGE_MAX, MODE_ALL, page, &total)) > 0) {
+        for (int i = 0; ok && i < n; i++) {
+            fill_record(&r, REPL_SYNC_SCORE, repl_head);
+            r.score = page[i];
+            ok = queue_bytes(l, &r, sizeof(r));
+        }
+        scores += n;
+    }
+
+    fill_record(&r, REPL_SYNC_DONE, repl_head);
+    ok = ok && queue_bytes(l, &r, sizeof(r));
+    if (!ok || !flush_link(l)) {
+        drop_link(link_count - 1, "initial sync failed");
+        return;
+    }
+    printf("[*] Replica connected from %s:%d; syncing %d active games and %d scores.\n",
+           inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), games, scores);
+}
+
+/**
+ * @brief Reads a replica's acknowledgements.
+ *
+ * @return 1 if the link is fine, 0 if it closed or failed.
+ */
+static int read_acks(ReplicaLink *l) {
+    char data[1024];
+    ssize_t n = recv(l->fd, data, sizeof(data), MSG_DONTWAIT);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    if (n == 0) return 0;
+
+    for (ssize_t i = 0; i < n; ) {
+        int take = sizeof(l->ack) - l->ack_len;
+        if (take > n - i) take = n - i;
+        memcpy(l->ack + l->ack_len, data + i, take);
+        l->ack_len += take;
+        i += take;
+        if (l->ack_len == sizeof(l->ack)) {
+            ReplAck ack;
+            memcpy(&ack, l->ack, sizeof(ack));
+            l->acked = ack.seq;
+            l->acked_ms = ack.sent_ms;
+            l->ack_len = 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Connects to a primary and makes this server its replica.
+ *
+ * @param primary The primary's replication address, "host:port".
+ * @return 1 on success, 0 on failure.
+ */
+int replication_follow(const char *primary) {
+    char host[256];
+    const char *colon = strrchr(primary, ':');
+    if (!colon || colon == primary || colon - primary >= (int)sizeof(host)) {
+        fprintf(stderr, "Invalid primary '%s' (expected host:port)\n", primary);
+        return 0;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - primary), primary);
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int errcode = getaddrinfo(host, colon + 1, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo (primary) error: %s\n", gai_strerror(errcode));
+        return 0;
+    }
+    primary_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (primary_fd == -1 || connect(primary_fd, res->ai_addr, res->ai_addrlen) == -1) {
+        perror("Connecting to the primary failed");
+        if (primary_fd != -1) close(primary_fd);
+        primary_fd = -1;
+        freeaddrinfo(res);
+        return 0;
+    }
+    freeaddrinfo(res);
+
+    // Acknowledgements are tiny; a primary that stops reading them has failed
+    struct timeval tv = { .tv_sec = HANDOFF_TIMEOUT, .tv_usec = 0 };
+    setsockopt(primary_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(primary_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // The HELLO comes first; refuse to write into the primary's own files
+    ReplRecord hello;
+    struct stat dir;
+    if (recv(primary_fd, &hello, sizeof(hello), MSG_WAITALL) != sizeof(hello) || hello.magic != REPL_MAGIC ||
+        hello.version != REPL_VERSION || hello.type != REPL_HELLO) {
+        fprintf(stderr, "No valid greeting from the primary at %s\n", primary);
+        close(primary_fd);
+        primary_fd = -1;
+        return 0;
+    }
+    if (stat(".", &dir) == 0 && dir.st_dev == hello.dir_dev && dir.st_ino == hello.dir_ino) {
+        fprintf(stderr, "A replica cannot share the primary's working directory; start it in another one\n");
+        close(primary_fd);
+        primary_fd = -1;
+        return 0;
+    }
+
+    repl_role = REPL_REPLICA;
+    printf("[*] Replicating from %s.\n", primary);
+    apply_record(&hello, NULL);
+    update_status();
+    return 1;
+}
+
+/**
+ * @brief Loads the scores received during the initial sync.
+ */
+static void load_sync_scores() {
+    if (!sync_scores) return;
+    scoreboard_load(sync_scores, sync_count);
+    free(sync_scores);
+    sync_scores = NULL;
+    sync_count = sync_capacity = 0;
+}
+
+/**
+ * @brief Closes the link to the primary; the replica keeps serving what it has.
+ */
+static void lose_primary(const char *why) {
+    close(primary_fd);
+    primary_fd = -1;
+    inbox_len = 0;
+    load_sync_scores();
+    printf("[!] Lost the primary (%s) after record %llu; serving reads until promoted (SIGUSR2).\n",
+           why, (unsigned long long)applied);
+}
+
+/**
+ * @brief Applies one record from the primary.
+ *
+ * @param r The record.
+ * @param payload Its payload (r->length bytes).
+ */
+static void apply_record(const ReplRecord *r, const char *payload) {
+    PlayerGame *game;
+    switch (r->type) {
+    case REPL_HELLO:
+        printf("[*] Primary at record %llu; synchronizing.\n", (unsigned long long)r->seq);
+        break;
+    case REPL_SYNC_GAME:
+        game = restore_game(&r->game);
+        if (game && r->length > 0) {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "GAMES/GAME_%06u.txt", game->plid);
+            FILE *f = fopen(filename, "w");
+            if (!f || fwrite(payload, 1, r->length, f) != r->length) perror("Failed to write replicated game file");
+            if (f) fclose(f);
+        }
+        break;
+    case REPL_SYNC_SCORE:
+        if (sync_count == sync_capacity) {
+            int capacity = sync_capacity ? 2 * sync_capacity : 1024;
+            ScoreEntry *scores = realloc(sync_scores, capacity * sizeof(ScoreEntry));
+            if (!scores) {
+                perror("realloc sync scores");
+                break;
+            }
+            sync_scores = scores;
+            sync_capacity = capacity;
+        }
+        if (r->score.geometry < NUM_GEOMETRIES) sync_scores[sync_count++] = r->score;
+        break;
+    case REPL_SYNC_DONE: {
+        int scores = sync_count, games = 0;
+        load_sync_scores();
+        for (int i = 0; i < MAX_PLAYERS; i++) games += game_table[i].in_use;
+        printf("[*] Synchronized with the primary: %d active games, %d scores.\n", games, scores);
+        break;
+    }
+    case REPL_START:
+        game = restore_game(&r->game);
+        if (game) create_game_file(game);
+        break;
+    case REPL_TRIAL:
+        // As the UDP loop does: write the trial, then count it unless it won
+        game = restore_game(&r->game);
+        if (game && game->current_trial >= 1 && game->current_trial <= MAX_TRIALS) {
+            update_game_file(game, r->guess, r->elapsed, r->nB, r->nW);
+            seqlock_write_begin(&game->seq);
+            game->trials[game->current_trial - 1] = r->guess;
+            if (r->nB != geometries[game->geometry].pegs) game->current_trial++;
+            seqlock_write_end(&game->seq);
+        }
+        break;
+    case REPL_SCORE:
+        game = restore_game(&r->game);
+        if (game) create_score_file(game);
+        break;
+    case REPL_END: {
+        char status[2] = { r->status, '\0' };
+        remove_game(r->game.plid, status);
+        break;
+    }
+    }
+    applied = r->seq;
+    applied_sent_ms = r->sent_ms;
+}
+
+/**
+ * @brief Applies every complete record received from the primary and acknowledges them.
+ */
+static void receive_records() {
+    ssize_t n = recv(primary_fd, inbox + inbox_len, sizeof(inbox) - inbox_len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0) {
+        lose_primary(n == 0 ? "link closed" : strerror(errno));
+        return;
+    }
+    inbox_len += n;
+
+    size_t done = 0;
+    int count = 0;
+    while (inbox_len - done >= sizeof(ReplRecord)) {
+        ReplRecord r;
+        memcpy(&r, inbox + done, sizeof(r));
+        if (r.magic != REPL_MAGIC || r.version != REPL_VERSION || r.length > REPL_PAYLOAD_MAX) {
+            lose_primary("incompatible stream");
+            return;
+        }
+        if (inbox_len - done < sizeof(r) + r.length) break;
+        apply_record(&r, inbox + done + sizeof(r));
+        done += sizeof(r) + r.length;
+        count++;
+    }
+    memmove(inbox, inbox + done, inbox_len - done);
+    inbox_len -= done;
+    if (count == 0) return;
+
+    applied_ms = now_ms();
+    ReplAck ack = { .seq = applied, .sent_ms = applied_sent_ms };
+    if (send(primary_fd, &ack, sizeof(ack), MSG_NOSIGNAL) != sizeof(ack)) {
+        lose_primary("acknowledgement failed");
+    }
+}
+
+/**
+ * @brief Adds the replication sockets to the select sets.
+ *
+ * @return The highest descriptor in the sets.
+ */
+int replication_add_fds(fd_set *read_fds, fd_set *write_fds, int max_fd) {
+    int fds[REPL_MAX_REPLICAS + 2];
+    int n = 0;
+    if (listen_fd != -1) fds[n++] = listen_fd;
+    if (primary_fd != -1) fds[n++] = primary_fd;
+    for (int i = 0; i < link_count; i++) {
+        fds[n++] = links[i].fd;
+        if (links[i].sent < links[i].len) FD_SET(links[i].fd, write_fds);
+    }
+    for (int i = 0; i < n; i++) {
+        FD_SET(fds[i], read_fds);
+        if (fds[i] > max_fd) max_fd = fds[i];
+    }
+    return max_fd;
+}
+
+/**
+ * @brief Accepts replicas, moves queued records and acknowledgements, applies
+ * records from the primary and pings idle links.
+ *
+ * @param read_fds The set returned by select.
+ * @param write_fds The set returned by select.
+ */
+void replication_service(fd_set *read_fds, fd_set *write_fds) {
+    if (repl_role == REPL_STANDALONE) return;
+    if (listen_fd != -1 && FD_ISSET(listen_fd, read_fds)) accept_replica();
+
+    for (int i = link_count - 1; i >= 0; i--) {
+        if (FD_ISSET(links[i].fd, read_fds) && !read_acks(&links[i])) {
+            drop_link(i, "link closed");
+        } else if (FD_ISSET(links[i].fd, write_fds) && !flush_link(&links[i])) {
+            drop_link(i, "link failed");
+        }
+    }
+
+    if (link_count > 0 && gs_clock.now - last_publish >= REPL_PING_INTERVAL) {
+        ReplRecord r;
+        fill_record(&r, REPL_PING, 0);
+        publish(&r);
+    }
+
+    if (primary_fd != -1 && FD_ISSET(primary_fd, read_fds)) receive_records();
+    update_status();
+}
+
+/**
+ * @brief Seconds until the next ping is due, or -1 if no replica is connected.
+ */
+int replication_timeout() {
+    if (link_count == 0) return -1;
+    int wait = REPL_PING_INTERVAL - (int)(gs_clock.now - last_publish);
+    return wait > 0 ? wait : 0;
+}
+
+/**
+ * @brief Turns a replica into a server of its own.
+ *
+ * The state applied so far is kept; the stream position continues from the last
+ * record applied. With --replicate, it starts accepting replicas itself.
+ */
+void replication_promote() {
+    if (repl_role != REPL_REPLICA) return;
+    if (primary_fd != -1) {
+        close(primary_fd);
+        primary_fd = -1;
+    }
+    load_sync_scores();
+    repl_head = applied;
+    repl_role = REPL_STANDALONE;
+    printf("[*] Promoted after record %llu; serving games.\n", (unsigned long long)applied);
+    if (listen_port) open_listener(listen_port);
+    update_status();
+}
+
+/**
+ * @brief Closes the inherited replication sockets in a freshly forked worker.
+ */
+void replication_child() {
+    if (listen_fd != -1) close(listen_fd);
+    if (primary_fd != -1) close(primary_fd);
+    for (int i = 0; i < link_count; i++) close(links[i].fd);
+}
+
+/**
+ * @brief Closes every replication link and the listener.
+ */
+void replication_close() {
+    while (link_count > 0) drop_link(link_count - 1, "server stopping");
+    if (listen_fd != -1) close(listen_fd);
+    if (primary_fd != -1) close(primary_fd);
+    listen_fd = primary_fd = -1;
+}
@@ -0,0 +1,102 @@
+#!/bin/bash
+# Exercises primary/replica replication on this machine:
+#   - games finished and a game left open before the replica connects reach it
+#     through the initial sync,
+#   - games played afterwards (and another open game) are applied live,
+#   - a replica started in the primary's own directory refuses to run,
+#   - once the primary is killed, SIGUSR2 promotes the replica, which then
+#     finishes both open games.
+# Prints one line per check and exits 1 if any failed.
+#
+# Usage: GS/replica.sh [GAMES [PORT]]
+
+GAMES=${1:-20}
+PORT=${2:-58200}
+REPLICA_PORT=$((PORT + 1))
+REPL_PORT=$((PORT + 10))
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+PIDS=""
+trap 'kill $PIDS 2>/dev/null; wait 2>/dev/null; rm -rf "$WORK"' EXIT INT TERM
+
+make -s -C "$ROOT" >/dev/null || exit 1
+
+FAILED=0
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "[*] $1: $2"
+    else
+        echo "[!] $1: got '$2', expected '$3'"
+        FAILED=1
+    fi
+}
+
+# One UDP request, one reply line
+udp() {
+    exec 4<>"/dev/udp/127.0.0.1/$1"
+    printf '%s\n' "$2" >&4
+    timeout 2 head -1 <&4
+    exec 4<&-
+}
+
+# One TCP request; prints the reply without its status line
+tcp() {
+    exec 3<>"/dev/tcp/127.0.0.1/$1"
+    printf '%s\n' "$2" >&3
+    tail -n +2 <&3
+    exec 3<&-
+}
+
+# Role reported by SRP
+role() {
+    exec 3<>"/dev/tcp/127.0.0.1/$1"
+    printf 'SRP\n' >&3
+    head -1 <&3 | cut -d' ' -f2
+    exec 3<&-
+}
+
+archives() { ls "$WORK/$1/GAMES" | grep '\.arc$'; }
+
+mkdir -p "$WORK"/primary/{GAMES,SCORES} "$WORK"/replica/{GAMES,SCORES}
+(cd "$WORK/primary" && exec "$ROOT/GS/GS" -p "$PORT" --rate 0 --replicate "$REPL_PORT" >gs.log 2>&1) &
+PRIMARY=$!
+PIDS="$PIDS $PRIMARY"
+sleep 0.3
+
+# Before the replica: finished games and an open debug game with one trial
+"$ROOT/player/player" -p "$PORT" -r "$GAMES" -s minimax >/dev/null 2>&1
+archives primary >"$WORK/before"
+check "open game on the primary" "$(udp "$PORT" 'DBG 424242 600 R G B Y')" "RDB OK"
+check "its first trial" "$(udp "$PORT" 'TRY 424242 R R R R 1')" "RTR OK 1 1 0"
+
+(cd "$WORK/primary" && exec "$ROOT/GS/GS" -p "$((PORT + 2))" --replica-of "127.0.0.1:$REPL_PORT" >"$WORK/shared.log" 2>&1)
+check "replica in the primary's directory exits with" "$?" 1
+
+(cd "$WORK/replica" && exec "$ROOT/GS/GS" -p "$REPLICA_PORT" --replica-of "127.0.0.1:$REPL_PORT" >gs.log 2>&1) &
+REPLICA=$!
+PIDS="$PIDS $REPLICA"
+sleep 0.5
+
+# After it: more games and another open game, streamed as they happen
+"$ROOT/player/player" -p "$PORT" -r "$GAMES" -s minimax >/dev/null 2>&1
+check "second open game" "$(udp "$PORT" 'DBG 434343 600 O P O P')" "RDB OK"
+check "its first trial" "$(udp "$PORT" 'TRY 434343 P O P O 1')" "RTR OK 1 0 4"
+sleep 0.5
+
+check "replica ignores UDP before promotion" "$(udp "$REPLICA_PORT" 'TRY 424242 R G B Y 2')" ""
+# The initial sync carries the scoreboard, not the history of finished games
+check "streamed archives on the replica" "$(archives replica | wc -l)" "$GAMES"
+check "missing from the replica" "$(archives primary | cat "$WORK/before" - | sort | uniq -u | comm -23 - <(archives replica) | wc -l)" 0
+check "scoreboards differ in lines" "$(diff <(tcp "$PORT" SSB) <(tcp "$REPLICA_PORT" SSB) | grep -c '^[<>]')" 0
+
+kill "$PRIMARY"
+wait "$PRIMARY" 2>/dev/null
+kill -USR2 "$REPLICA"
+sleep 0.3
+
+check "promoted replica role" "$(role "$REPLICA_PORT")" "STANDALONE"
+check "synced game finished after promotion" "$(udp "$REPLICA_PORT" 'TRY 424242 R G B Y 2')" "RTR OK 2 4 0"
+check "streamed game finished after promotion" "$(udp "$REPLICA_PORT" 'TRY 434343 O P O P 2')" "RTR OK 2 4 0"
+
+exit $FAILED
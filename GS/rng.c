@@ -0,0 +1,103 @@
+#include "GS.h"
+#include "../common.h"
+#include <sys/random.h>
+
+/*
+ * Fast per-process PRNG (xoshiro256**) and a pool of pre-generated secret keys.
+ *
+ * Only the UDP loop creates games, so one generator per GS process is enough; it
+ * is seeded once at startup, from getrandom() or from --seed for reproducible runs.
+ */
+static uint64_t rng_state[4];
+
+static Code key_pool[KEY_POOL_SIZE];
+static int key_pool_count = 0;
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Returns the next 64-bit output of the generator.
+ */
+uint64_t rng_next() {
+    uint64_t *s = rng_state;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+/**
+ * @brief Seeds the generator from a 64-bit value (expanded with splitmix64).
+ *
+ * @param seed The seed; the same seed always yields the same sequence of keys.
+ */
+void rng_seed(uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        rng_state[i] = z ^ (z >> 31);
+    }
+    key_pool_count = 0;
+}
+
+/**
+ * @brief Seeds the generator from the kernel's random source.
+ *
+ * @return int 1 on success, 0 if getrandom failed.
+ */
+int rng_seed_random() {
+    uint64_t seed;
+    if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) {
+        perror("getrandom");
+        return 0;
+    }
+    rng_seed(seed);
+    return 1;
+}
+
+/**
+ * @brief Draws one uniformly random code of the given geometry.
+ */
+static Code draw_key(const Geometry *g) {
+    // One draw covers all pegs: map the 64-bit output onto [0, C^P) and split in base C
+    uint32_t value = (uint32_t)(((unsigned __int128)rng_next() * g->space) >> 64);
+    return code_from_index(g, value);
+}
+
+/**
+ * @brief Tops up the pool of classic (4x6) secret keys.
+ *
+ * Called by the main loop after requests have been answered, so SNG itself only
+ * pops a ready key.
+ */
+void refill_key_pool() {
+    while (key_pool_count < KEY_POOL_SIZE) {
+        key_pool[key_pool_count++] = draw_key(&geometries[GEOMETRY_CLASSIC]);
+    }
+}
+
+/**
+ * @brief Generates a random secret key for a game of the given geometry.
+ *
+ * Classic games take a key from the pre-generated pool, drawing one directly only
+ * if the pool ran dry; the rarer variant games always draw directly.
+ * 
+ * @param geometry Index of the game's geometry in geometries[].
+ * @return Code The secret key.
+ */
+Code generate_secret_key(int geometry) {
+    if (geometry == GEOMETRY_CLASSIC && key_pool_count > 0) {
+        return key_pool[--key_pool_count];
+    }
+    return draw_key(&geometries[geometry]);
+}
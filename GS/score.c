@@ -18,16 +18,13 @@ void create_score_file(PlayerGame *game) {
     int game_duration = game->elapsed_time;
     int score = calculate_score(game->current_trial, game_duration, game->total_duration); // Assuming max_duration is 300 seconds
 
-    // Generate timestamp for the file name
-    struct tm *t = localtime(&game->last_update_time);
-    char end_date[9];  // DDMMYYYY
-    char end_time_str[7]; // HHMMSS
-    strftime(end_date, sizeof(end_date), "%d%m%Y", t);
-    strftime(end_time_str, sizeof(end_time_str), "%H%M%S", t);
+    // Timestamp of the file name; the game was just updated, so usually the cached second
+    CachedClock scratch;
+    const CachedClock *end = clock_at(game->last_update_time, &scratch);
 
     // Create the file name: SCORES/SSS_PLID_DDMMYYYY_HHMMSS.txt
     char filename[128];
-    snprintf(filename, sizeof(filename), "SCORES/%03d_%s_%s_%s.txt", score, game->PLID, end_date, end_time_str);
+    snprintf(filename, sizeof(filename), "SCORES/%03d_%06u_%s_%s.txt", score, game->plid, end->date_compact, end->time_compact);
 
     FILE *file = fopen(filename, "w");
     if (!file) {
@@ -35,19 +32,30 @@ void create_score_file(PlayerGame *game) {
         return;
     }
 
-    char mode[16];
-    if(!strcmp(game->mode, "D")) {
-        strcpy(mode, "DEBUG");
-    }
-    else {
-        strcpy(mode, "PLAY");
-    }
+    const Geometry *g = &geometries[game->geometry];
+    char secret_key[CODE_STR_LEN];
+    code_to_string(game->secret_key, g->pegs, secret_key);
 
-    // Write the score information to the file
-    fprintf(file, "%03d %s %s %d %s", score, game->PLID, game->secret_key, game->current_trial, mode);
+    // Write the score information to the file; variant games add their PxC geometry
+    fprintf(file, "%03d %06u %s %d %s", score, game->plid, secret_key, game->current_trial,
+            game->mode == MODE_DEBUG ? "DEBUG" : "PLAY");
+    if (game->geometry != GEOMETRY_CLASSIC) {
+        fprintf(file, " %dx%d", g->pegs, g->colors);
+    }
     fclose(file);
 
     printf("[*] Score file created: %s\n", filename);
+    replicate_game(REPL_SCORE, game);
+
+    ScoreEntry entry;
+    entry.SSS = score;
+    entry.plid = game->plid;
+    entry.secret_key = game->secret_key;
+    entry.total_plays = game->current_trial;
+    entry.mode = game->mode;
+    entry.geometry = game->geometry;
+    entry.end_time = game->last_update_time;
+    scoreboard_add(&entry);
 }
 
 
@@ -79,6 +87,8 @@ int calculate_score(int total_trials, int game_duration, int max_duration) {
  * @brief Comparator function for sorting score entries in descending order.
  *
  * Used by qsort() to sort ScoreEntry structures in descending order of score (SSS).
+ * Equal scores are ordered by earlier win, then PLID and mode, as in the rank
+ * index, so every board built from the same scores lists them the same way.
  *
  * @param a Pointer to the first ScoreEntry.
  * @param b Pointer to the second ScoreEntry.
@@ -88,9 +98,41 @@ int compare_scores(const void *a, const void *b) {
     const ScoreEntry *sa = (const ScoreEntry*)a;
     const ScoreEntry *sb = (const ScoreEntry*)b;
     // descending order
-    return sb->SSS - sa->SSS;
+    if (sa->SSS != sb->SSS) return sb->SSS - sa->SSS;
+    if (sa->end_time != sb->end_time) return sa->end_time < sb->end_time ? -1 : 1;
+    if (sa->plid != sb->plid) return sa->plid < sb->plid ? -1 : 1;
+    return (int)sa->mode - (int)sb->mode;
+}
+
+
+/**
+ * @brief Recovers the end time of a game from its score file name.
+ *
+ * @param name File name, SSS_PLID_DDMMYYYY_HHMMSS.txt (local time).
+ * @return The end time, or 0 if the name does not follow the pattern.
+ */
+static time_t score_file_time(const char *name) {
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    if (sscanf(name, "%*3d_%*6d_%2d%2d%4d_%2d%2d%2d", &t.tm_mday, &t.tm_mon, &t.tm_year,
+               &t.tm_hour, &t.tm_min, &t.tm_sec) != 6) {
+        return 0;
+    }
+    t.tm_mon -= 1;
+    t.tm_year -= 1900;
+    t.tm_isdst = -1;
+    time_t when = mktime(&t);
+    return when == (time_t)-1 ? 0 : when;
 }
 
+/**
+ * @brief Comparator ordering score entries by end time, oldest first (then in rank order).
+ */
+static int compare_end_times(const void *a, const void *b) {
+    const ScoreEntry *sa = a, *sb = b;
+    if (sa->end_time != sb->end_time) return sa->end_time < sb->end_time ? -1 : 1;
+    return compare_scores(a, b);
+}
 
 /**
  * @brief Loads all score files from the SCORES directory into an array.
@@ -132,9 +174,15 @@ ScoreEntry* load_scores(int *count) {
 
         char line[MAX_BUFFER_SIZE];
         if (fgets(line, sizeof(line), f)) {
-            int SSS, N;
-            char PLID[7], CCCC[5], mode[16];
-            if (sscanf(line, "%d %6s %4s %d %15s", &SSS, PLID, CCCC, &N, mode) == 5) {
+            int SSS, N, pegs, colors = NUM_COLORS;
+            char PLID[7], CCCC[CODE_STR_LEN], mode[16];
+            uint32_t plid;
+            Code secret_key = CODE_INVALID;
+            int fields = sscanf(line, "%d %6s %6s %d %15s %dx%d", &SSS, PLID, CCCC, &N, mode, &pegs, &colors);
+            if (fields == 5) pegs = strlen(CCCC);
+            int geometry = fields >= 5 ? geometry_find(pegs, colors) : -1;
+            if (geometry >= 0) secret_key = geometries[geometry].parse(CCCC);
+            if (secret_key != CODE_INVALID && parse_plid(PLID, &plid)) {
                 // Ensure capacity
                 if (score_count >= capacity) {
                     int new_cap = capacity == 0 ? 64 : capacity * 2;
@@ -153,11 +201,12 @@ ScoreEntry* load_scores(int *count) {
 
                 ScoreEntry *entry = &scores[score_count++];
                 entry->SSS = SSS;
-                strncpy(entry->PLID, PLID, 6); entry->PLID[6] = '\0';
-                strncpy(entry->secret_key, CCCC, 4); entry->secret_key[4] = '\0';
+                entry->plid = plid;
+                entry->secret_key = secret_key;
                 entry->total_plays = N;
-                strcpy(entry->mode, mode);
-
+                entry->mode = strcmp(mode, "DEBUG") == 0 ? MODE_DEBUG : MODE_PLAY;
+                entry->geometry = geometry;
+                entry->end_time = score_file_time(filelist[i]->d_name);
             }
         }
 
@@ -168,4 +217,645 @@ ScoreEntry* load_scores(int *count) {
 
     *count = score_count;
     return scores;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Shared, pre-rendered top 10 used to answer SSB without touching SCORES/.
+ *
+ * Lives in an anonymous shared mapping so forked TCP workers (including kept-alive
+ * ones) always see the current board. The UDP loop is the only writer; readers
+ * copy the payload under the seqlock.
+ */
+static ScoreboardCache *scoreboard_cache = NULL;
+
+/**
+ * @brief Start of this server process (microseconds), prefixed to generations
+ *        handed out by STK so they never repeat across restarts.
+ */
+static unsigned long board_epoch = 0;
+
+/**
+ * @brief Rank index over every recorded score, shared with the TCP workers the same way.
+ */
+static ScoreIndex *score_index = NULL;
+
+static void score_index_add(const ScoreEntry *entry);
+
+/**
+ * @brief Rolling-window boards served by "SSB DAY" and "SSB WEEK".
+ */
+static ScoreWindow score_windows[SCORE_WINDOWS] = {
+    { .name = "DAY", .fname = "scoreboard_day.txt", .span = 24 * 3600 },
+    { .name = "WEEK", .fname = "scoreboard_week.txt", .span = 7 * 24 * 3600 },
+};
+
+static void window_add(ScoreWindow *w, const ScoreEntry *entry);
+static void window_render(ScoreWindow *w);
+
+/**
+ * @brief Formats a score entry the way score files and scoreboards show it.
+ *
+ * "SSS PLID KEY N MODE", plus " PxC" for variant geometries; no newline.
+ *
+ * @return The length of the formatted entry.
+ */
+int format_score_entry(const ScoreEntry *e, char *out, size_t size) {
+    const Geometry *g = &geometries[e->geometry];
+    char secret_key[CODE_STR_LEN], variant[16] = "";
+    code_to_string(e->secret_key, g->pegs, secret_key);
+    if (e->geometry != GEOMETRY_CLASSIC) {
+        snprintf(variant, sizeof(variant), " %dx%d", g->pegs, g->colors);
+    }
+    return snprintf(out, size, "%03d %06u %s %d %s%s", e->SSS, e->plid, secret_key, e->total_plays,
+                    e->mode == MODE_DEBUG ? "DEBUG" : "PLAY", variant);
+}
+
+/**
+ * @brief Re-renders the cached "RSS OK" payload from the cached top entries.
+ *
+ * Format matches the former top_scoreboard.txt: one entry per line, no trailing newline.
+ */
+static void render_scoreboard(ScoreboardCache *c) {
+    size_t len = 0;
+    for (int i = 0; i < c->count; i++) {
+        if (i > 0) c->payload[len++] = '\n';
+        len += format_score_entry(&c->top[i], c->payload + len, sizeof(c->payload) - len);
+    }
+    c->len = len;
+}
+
+/**
+ * @brief Creates the shared scoreboard cache and fills it from the SCORES directory.
+ *
+ * Must be called before any TCP worker is forked.
+ *
+ * @param load Read the SCORES directory; a replica starts empty and is filled by
+ *             its primary (scoreboard_load).
+ * @return int 1 on success, 0 on failure.
+ */
+int init_scoreboard_cache(int load) {
+    scoreboard_cache = mmap(NULL, sizeof(ScoreboardCache), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (scoreboard_cache == MAP_FAILED) {
+        perror("mmap scoreboard cache");
+        scoreboard_cache = NULL;
+        return 0;
+    }
+    memset(scoreboard_cache, 0, sizeof(ScoreboardCache));
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    board_epoch = (unsigned long)tv.tv_sec * 1000000UL + tv.tv_usec;
+
+    // Zero-filled on demand: only the nodes and players in use take memory
+    score_index = mmap(NULL, sizeof(ScoreIndex), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (score_index == MAP_FAILED) {
+        perror("mmap score index");
+        score_index = NULL;
+        return 0;
+    }
+    score_index->rng = 0x9e3779b97f4a7c15ULL;
+
+    ScoreboardCache *window_caches = mmap(NULL, SCORE_WINDOWS * sizeof(ScoreboardCache), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (window_caches == MAP_FAILED) {
+        perror("mmap window scoreboards");
+        return 0;
+    }
+    for (int i = 0; i < SCORE_WINDOWS; i++) {
+        ScoreWindow *w = &score_windows[i];
+        w->cache = &window_caches[i];
+        w->ring = malloc(SCORE_WINDOW_CAPACITY * sizeof(ScoreEntry));
+        w->next = malloc(SCORE_WINDOW_CAPACITY * sizeof(int32_t));
+        if (!w->ring || !w->next) {
+            perror("malloc window scoreboard");
+            return 0;
+        }
+        memset(w->first, -1, sizeof(w->first));
+        memset(w->last, -1, sizeof(w->last));
+    }
+
+    int score_count = 0;
+    ScoreEntry *scores = load ? load_scores(&score_count) : NULL;
+    scoreboard_load(scores, score_count);
+    free(scores);
+    return 1;
+}
+
+/**
+ * @brief Fills the empty scoreboards and rank index with a set of scores.
+ *
+ * @param scores The scores, in any order (the array is reordered).
+ * @param count The number of scores.
+ */
+void scoreboard_load(ScoreEntry *scores, int count) {
+    if (!scoreboard_cache) return;
+    if (scores) {
+        for (int i = 0; i < count; i++) score_index_add(&scores[i]);
+
+        // Windows take their entries oldest first; scoreboard_expire drops the old ones
+        qsort(scores, count, sizeof(ScoreEntry), compare_end_times);
+        for (int w = 0; w < SCORE_WINDOWS; w++) {
+            for (int i = 0; i < count; i++) window_add(&score_windows[w], &scores[i]);
+        }
+
+        qsort(scores, count, sizeof(ScoreEntry), compare_scores);
+    }
+
+    int limit = count < SCOREBOARD_SIZE ? count : SCOREBOARD_SIZE;
+    seqlock_write_begin(&scoreboard_cache->seq);
+    if (scores) memcpy(scoreboard_cache->top, scores, limit * sizeof(ScoreEntry));
+    scoreboard_cache->count = scores ? limit : 0;
+    scoreboard_cache->generation++;
+    render_scoreboard(scoreboard_cache);
+    seqlock_write_end(&scoreboard_cache->seq);
+    scoreboard_expire(gs_clock.now);
+    for (int w = 0; w < SCORE_WINDOWS; w++) window_render(&score_windows[w]);
+}
+
+/**
+ * @brief Records a new score in the cached top 10 and bumps the generation.
+ *
+ * @param entry The new score entry.
+ */
+void scoreboard_add(const ScoreEntry *entry) {
+    ScoreboardCache *c = scoreboard_cache;
+    if (!c) return;
+    score_index_add(entry);
+    for (int w = 0; w < SCORE_WINDOWS; w++) {
+        window_add(&score_windows[w], entry);
+        window_render(&score_windows[w]);
+    }
+
+    // Find the insertion point in rank order
+    int pos = c->count;
+    while (pos > 0 && compare_scores(&c->top[pos - 1], entry) > 0) pos--;
+    seqlock_write_begin(&c->seq);
+    c->generation++;
+    if (pos >= SCOREBOARD_SIZE) {
+        // Outside the top 10 the board is unchanged, but the generation still counts the score
+        seqlock_write_end(&c->seq);
+        return;
+    }
+
+    int last = c->count < SCOREBOARD_SIZE ? c->count : SCOREBOARD_SIZE - 1;
+    memmove(&c->top[pos + 1], &c->top[pos], (last - pos) * sizeof(ScoreEntry));
+    c->top[pos] = *entry;
+    if (c->count < SCOREBOARD_SIZE) c->count++;
+    render_scoreboard(c);
+    seqlock_write_end(&c->seq);
+}
+
+/**
+ * @brief Copies a rendered scoreboard under its seqlock.
+ *
+ * @return The payload length; 0 (answered as an empty board, as when busy) if
+ *         the board stayed mid-update.
+ */
+static size_t copy_scoreboard(const ScoreboardCache *c, char *out, unsigned long *generation) {
+    unsigned seq, tries = 0;
+    size_t len;
+    do {
+        if (!seqlock_read_begin(&c->seq, &seq, &tries)) return 0;
+        len = c->len;
+        if (len > sizeof(c->payload)) len = 0;  // torn read, retried below
+        memcpy(out, c->payload, len);
+        if (generation) *generation = c->generation;
+    } while (seqlock_read_retry(&c->seq, seq));
+    return len;
+}
+
+/**
+ * @brief Copies the current rendered scoreboard into out.
+ *
+ * @param out Buffer of at least SCOREBOARD_PAYLOAD_MAX bytes.
+ * @param generation If not NULL, set to the generation of the copied board.
+ * @return size_t Length of the payload, 0 if the scoreboard is empty.
+ */
+size_t scoreboard_snapshot(char *out, unsigned long *generation) {
+    ScoreboardCache *c = scoreboard_cache;
+    if (!c) return 0;
+    return copy_scoreboard(c, out, generation);
+}
+
+/**
+ * @brief Removes the oldest entry of a window, which heads its score's chain.
+ */
+static void window_drop_oldest(ScoreWindow *w) {
+    int32_t slot = w->head;
+    int score = w->ring[slot].SSS;
+    w->first[score] = w->next[slot];
+    if (w->first[score] == -1) w->last[score] = -1;
+    w->head = (w->head + 1) % SCORE_WINDOW_CAPACITY;
+    w->len--;
+}
+
+/**
+ * @brief Appends a score to a window, dropping the oldest entry if the ring is full.
+ *
+ * Entries are expected roughly in end-time order (scores are recorded as games end).
+ */
+static void window_add(ScoreWindow *w, const ScoreEntry *entry) {
+    if (entry->SSS < 0 || entry->SSS > SCORE_MAX) return;
+    if (w->len == SCORE_WINDOW_CAPACITY) window_drop_oldest(w);
+
+    int32_t slot = (w->head + w->len) % SCORE_WINDOW_CAPACITY;
+    w->ring[slot] = *entry;
+    w->next[slot] = -1;
+    if (w->last[entry->SSS] != -1) {
+        w->next[w->last[entry->SSS]] = slot;
+    } else {
+        w->first[entry->SSS] = slot;
+    }
+    w->last[entry->SSS] = slot;
+    w->len++;
+}
+
+/**
+ * @brief Re-renders a window's shared board from the heads of its score chains.
+ *
+ * O(SCOREBOARD_SIZE + SCORE_MAX): ties keep the earlier win first, as in SSB.
+ */
+static void window_render(ScoreWindow *w) {
+    ScoreboardCache *c = w->cache;
+    seqlock_write_begin(&c->seq);
+    c->count = 0;
+    for (int score = SCORE_MAX; score >= 0 && c->count < SCOREBOARD_SIZE; score--) {
+        for (int32_t slot = w->first[score]; slot != -1 && c->count < SCOREBOARD_SIZE; slot = w->next[slot]) {
+            c->top[c->count++] = w->ring[slot];
+        }
+    }
+    c->generation++;
+    render_scoreboard(c);
+    seqlock_write_end(&c->seq);
+}
+
+/**
+ * @brief Drops the scores that have slid out of each window.
+ *
+ * Called by the UDP loop before waiting; each expiry is O(1).
+ *
+ * @param now The current time.
+ * @return Seconds until the next entry expires, or -1 if every window is empty.
+ */
+int scoreboard_expire(time_t now) {
+    int next = -1;
+    for (int i = 0; i < SCORE_WINDOWS; i++) {
+        ScoreWindow *w = &score_windows[i];
+        if (!w->cache) continue;
+
+        int expired = 0;
+        while (w->len > 0 && w->ring[w->head].end_time + w->span <= now) {
+            window_drop_oldest(w);
+            expired = 1;
+        }
+        if (expired) window_render(w);
+
+        if (w->len > 0) {
+            int wait = w->ring[w->head].end_time + w->span - now;
+            if (next == -1 || wait < next) next = wait;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Looks up a window by the name SSB takes ("DAY", "WEEK").
+ *
+ * @return The window, or -1 if there is none by that name.
+ */
+int scoreboard_window_find(const char *name) {
+    for (int i = 0; i < SCORE_WINDOWS; i++) {
+        if (strcmp(score_windows[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief File name announced when sending a window's board.
+ */
+const char *scoreboard_window_fname(int window) {
+    return score_windows[window].fname;
+}
+
+/**
+ * @brief Copies a window's rendered board into out.
+ *
+ * @param window Index returned by scoreboard_window_find.
+ * @param out Buffer of at least SCOREBOARD_PAYLOAD_MAX bytes.
+ * @return Length of the payload, 0 if no score falls in the window.
+ */
+size_t scoreboard_window_snapshot(int window, char *out) {
+    ScoreboardCache *c = score_windows[window].cache;
+    if (!c) return 0;
+    return copy_scoreboard(c, out, NULL);
+}
+
+/**
+ * @brief Copies the top entries of a board together with its generation.
+ *
+ * @param window Index returned by scoreboard_window_find, or -1 for the all-time board.
+ * @param out Buffer of at least SCOREBOARD_SIZE entries, best first.
+ * @param generation Set to "EPOCH.N": changes whenever the board does, and
+ *                   differs between server processes.
+ * @param size Size of generation.
+ * @return The number of entries copied, -1 if the board stayed mid-update.
+ */
+int scoreboard_top(int window, ScoreEntry *out, char *generation, size_t size) {
+    const ScoreboardCache *c = window < 0 ? scoreboard_cache : score_windows[window].cache;
+    if (!c) {
+        snprintf(generation, size, "%lx.0", board_epoch);
+        return 0;
+    }
+    unsigned seq, tries = 0;
+    unsigned long gen;
+    int count;
+    do {
+        if (!seqlock_read_begin(&c->seq, &seq, &tries)) return -1;
+        count = c->count;
+        if (count < 0 || count > SCOREBOARD_SIZE) count = 0;  // torn read, retried below
+        memcpy(out, c->top, count * sizeof(ScoreEntry));
+        gen = c->generation;
+    } while (seqlock_read_retry(&c->seq, seq));
+    snprintf(generation, size, "%lx.%lu", board_epoch, gen);
+    return count;
+}
+
+/**
+ * @brief Orders score entries: higher score first, then earlier win, PLID and mode.
+ *
+ * @return Negative if a ranks ahead of b, positive if behind, 0 if they are equal.
+ */
+static int score_order(const ScoreEntry *a, const ScoreEntry *b) {
+    return compare_scores(a, b);
+}
+
+/**
+ * @brief Number of entries of the given view in the subtree rooted at node n.
+ *
+ * Out-of-range nodes (only seen by a torn read) count as empty.
+ */
+static inline uint32_t subtree_count(const ScoreIndex *x, int32_t n, int mode) {
+    if (n <= 0 || n > SCORE_INDEX_CAPACITY) return 0;
+    const ScoreNode *node = &x->nodes[n];
+    return mode == MODE_ALL ? node->count[MODE_PLAY] + node->count[MODE_DEBUG] : node->count[mode];
+}
+
+/**
+ * @brief Recomputes the subtree counts of node n from its children.
+ */
+static void update_counts(ScoreIndex *x, int32_t n) {
+    ScoreNode *node = &x->nodes[n];
+    for (int m = 0; m < 2; m++) {
+        node->count[m] = subtree_count(x, node->left, m) + subtree_count(x, node->right, m) + (node->entry.mode == m);
+    }
+}
+
+static int32_t rotate_right(ScoreIndex *x, int32_t n) {
+    int32_t l = x->nodes[n].left;
+    x->nodes[n].left = x->nodes[l].right;
+    x->nodes[l].right = n;
+    update_counts(x, n);
+    update_counts(x, l);
+    return l;
+}
+
+static int32_t rotate_left(ScoreIndex *x, int32_t n) {
+    int32_t r = x->nodes[n].right;
+    x->nodes[n].right = x->nodes[r].left;
+    x->nodes[r].left = n;
+    update_counts(x, n);
+    update_counts(x, r);
+    return r;
+}
+
+/**
+ * @brief Inserts node n into the treap rooted at t.
+ *
+ * @return The new root of the subtree.
+ */
+static int32_t treap_insert(ScoreIndex *x, int32_t t, int32_t n) {
+    if (t == 0) return n;
+    ScoreNode *node = &x->nodes[t];
+    node->count[x->nodes[n].entry.mode]++;
+    if (score_order(&x->nodes[n].entry, &node->entry) < 0) {
+        node->left = treap_insert(x, node->left, n);
+        if (x->nodes[node->left].priority > node->priority) t = rotate_right(x, t);
+    } else {
+        node->right = treap_insert(x, node->right, n);
+        if (x->nodes[node->right].priority > node->priority) t = rotate_left(x, t);
+    }
+    return t;
+}
+
+/**
+ * @brief Unlinks the lowest-ranked entry (the rightmost node) to make room.
+ *
+ * @return The freed node.
+ */
+static int32_t treap_remove_last(ScoreIndex *x) {
+    int32_t last = x->root;
+    while (x->nodes[last].right) last = x->nodes[last].right;
+    int mode = x->nodes[last].entry.mode;
+
+    int32_t *link = &x->root;
+    while (*link != last) {
+        x->nodes[*link].count[mode]--;
+        link = &x->nodes[*link].right;
+    }
+    *link = x->nodes[last].left;
+
+    // The lowest entry overall can only be its player's best if it is their only one
+    int32_t *best = &x->best[mode][x->nodes[last].entry.plid];
+    if (*best == last) *best = 0;
+    return last;
+}
+
+/**
+ * @brief Adds a score to the rank index; called by the UDP loop only.
+ *
+ * Once SCORE_INDEX_CAPACITY entries are held, the lowest one gives up its node,
+ * so ranks stay exact for everything above it.
+ *
+ * @param entry The new score entry.
+ */
+static void score_index_add(const ScoreEntry *entry) {
+    ScoreIndex *x = score_index;
+    if (!x || entry->plid >= PLID_SPACE || entry->mode > MODE_DEBUG) return;
+
+    int32_t n;
+    seqlock_write_begin(&x->seq);
+    if (x->used < SCORE_INDEX_CAPACITY) {
+        n = ++x->used;
+    } else {
+        int32_t last = x->root;
+        while (x->nodes[last].right) last = x->nodes[last].right;
+        if (score_order(entry, &x->nodes[last].entry) >= 0) {
+            seqlock_write_end(&x->seq);
+            return;
+        }
+        n = treap_remove_last(x);
+    }
+
+    x->rng ^= x->rng << 13;
+    x->rng ^= x->rng >> 7;
+    x->rng ^= x->rng << 17;
+
+    ScoreNode *node = &x->nodes[n];
+    node->entry = *entry;
+    node->left = node->right = 0;
+    node->priority = (uint32_t)(x->rng >> 32);
+    node->count[MODE_PLAY] = entry->mode == MODE_PLAY;
+    node->count[MODE_DEBUG] = entry->mode == MODE_DEBUG;
+    x->root = treap_insert(x, x->root, n);
+
+    int32_t *best = &x->best[entry->mode][entry->plid];
+    if (*best == 0 || score_order(entry, &x->nodes[*best].entry) < 0) *best = n;
+    seqlock_write_end(&x->seq);
+}
+
+/**
+ * @brief Finds the node holding the k-th entry (from 0) of a view.
+ *
+ * Runs under a seqlock read: every index is checked and the walk is bounded, so a
+ * concurrent update can only make it return a wrong node, which the caller retries.
+ *
+ * @return The node, or 0 if k is out of range or the read was torn.
+ */
+static int32_t select_entry(const ScoreIndex *x, uint32_t k, int mode) {
+    int32_t t = x->root;
+    for (int steps = 0; t > 0 && t <= SCORE_INDEX_CAPACITY && steps < SCORE_INDEX_MAX_DEPTH; steps++) {
+        const ScoreNode *node = &x->nodes[t];
+        uint32_t left = subtree_count(x, node->left, mode);
+        if (k < left) {
+            t = node->left;
+            continue;
+        }
+        k -= left;
+        if (mode == MODE_ALL || node->entry.mode == mode) {
+            if (k == 0) return t;
+            k--;
+        }
+        t = node->right;
+    }
+    return 0;
+}
+
+/**
+ * @brief Looks up the rank of a player's best score.
+ *
+ * O(log n): one descent from the root, adding up the entries ranked ahead.
+ *
+ * @param plid The player.
+ * @param mode MODE_PLAY, MODE_DEBUG or MODE_ALL.
+ * @param entry Set to the player's best entry in that view.
+ * @param rank Set to its rank, from 1.
+ * @param total Set to the number of entries in the view.
+ * @return 1 if the player has a score in the view, 0 otherwise, -1 if the index
+ *         stayed mid-update.
+ */
+int score_rank(uint32_t plid, int mode, ScoreEntry *entry, int *rank, int *total) {
+    const ScoreIndex *x = score_index;
+    if (!x || plid >= PLID_SPACE) return 0;
+
+    unsigned seq, tries = 0;
+    int found;
+    do {
+        if (!seqlock_read_begin(&x->seq, &seq, &tries)) return -1;
+        found = 0;
+
+        int32_t best = 0;
+        for (int m = MODE_PLAY; m <= MODE_DEBUG; m++) {
+            int32_t candidate = x->best[m][plid];
+            if ((mode != MODE_ALL && mode != m) || candidate <= 0 || candidate > SCORE_INDEX_CAPACITY) continue;
+            if (best == 0 || score_order(&x->nodes[candidate].entry, &x->nodes[best].entry) < 0) best = candidate;
+        }
+        if (best == 0) continue;
+        *entry = x->nodes[best].entry;
+
+        uint32_t ahead = 0;
+        int32_t t = x->root;
+        for (int steps = 0; t > 0 && t <= SCORE_INDEX_CAPACITY && steps < SCORE_INDEX_MAX_DEPTH; steps++) {
+            const ScoreNode *node = &x->nodes[t];
+            int order = score_order(entry, &node->entry);
+            if (order < 0) {
+                t = node->left;
+            } else if (order > 0) {
+                ahead += subtree_count(x, node->left, mode) + (mode == MODE_ALL || node->entry.mode == mode);
+                t = node->right;
+            } else {
+                ahead += subtree_count(x, node->left, mode);
+                found = 1;
+                break;
+            }
+        }
+        *rank = ahead + 1;
+        *total = subtree_count(x, x->root, mode);
+    } while (seqlock_read_retry(&x->seq, seq));
+    return found;
+}
+
+/**
+ * @brief Counts the entries of a view that rank ahead of a given entry.
+ *
+ * The entry need not be in the index (a cluster proxy ranks a player held by
+ * another node): O(log n), one descent like score_rank.
+ *
+ * @param probe The entry; SSS, end_time, plid and mode are compared.
+ * @param mode MODE_PLAY, MODE_DEBUG or MODE_ALL.
+ * @param ahead Set to the number of entries ranked ahead of probe.
+ * @param total Set to the number of entries in the view.
+ * @return 1, or 0 if the index stayed mid-update.
+ */
+int score_count_ahead(const ScoreEntry *probe, int mode, int *ahead, int *total) {
+    const ScoreIndex *x = score_index;
+    *ahead = *total = 0;
+    if (!x) return 1;
+
+    unsigned seq, tries = 0;
+    do {
+        if (!seqlock_read_begin(&x->seq, &seq, &tries)) return 0;
+        uint32_t count = 0;
+        int32_t t = x->root;
+        for (int steps = 0; t > 0 && t <= SCORE_INDEX_CAPACITY && steps < SCORE_INDEX_MAX_DEPTH; steps++) {
+            const ScoreNode *node = &x->nodes[t];
+            if (score_order(probe, &node->entry) <= 0) {
+                t = node->left;
+            } else {
+                count += subtree_count(x, node->left, mode) + (mode == MODE_ALL || node->entry.mode == mode);
+                t = node->right;
+            }
+        }
+        *ahead = count;
+        *total = subtree_count(x, x->root, mode);
+    } while (seqlock_read_retry(&x->seq, seq));
+    return 1;
+}
+
+/**
+ * @brief Copies a page of a score view, in rank order.
+ *
+ * @param first Rank of the first entry wanted, from 1.
+ * @param count Entries wanted (at most SCORE_PAGE_MAX).
+ * @param mode MODE_PLAY, MODE_DEBUG or MODE_ALL.
+ * @param out Receives the entries.
+ * @param total Set to the number of entries in the view.
+ * @return The number of entries copied, -1 if the index stayed mid-update.
+ */
+int score_page(int first, int count, int mode, ScoreEntry *out, int *total) {
+    const ScoreIndex *x = score_index;
+    *total = 0;
+    if (!x || first < 1 || count < 1) return 0;
+    if (count > SCORE_PAGE_MAX) count = SCORE_PAGE_MAX;
+
+    unsigned seq, tries = 0;
+    int n;
+    do {
+        if (!seqlock_read_begin(&x->seq, &seq, &tries)) return -1;
+        *total = subtree_count(x, x->root, mode);
+        for (n = 0; n < count && first - 1 + n < *total; n++) {
+            int32_t t = select_entry(x, first - 1 + n, mode);
+            if (t == 0) break;
+            out[n] = x->nodes[t].entry;
+        }
+    } while (seqlock_read_retry(&x->seq, seq));
+    return n;
+}
@@ -0,0 +1,119 @@
+#include "GS.h"
+#include "../common.h"
+#include <fcntl.h>
+
+/*
+ * Per-request phase tracing (--trace FILE).
+ *
+ * Every process that serves requests (the main loop and each TCP worker) buffers
+ * its events in its own ring and appends the ring to the trace file when it fills
+ * up, when the server goes idle and on exit. The file is opened with O_APPEND and
+ * a flush is a single write of whole records, so processes never interleave within
+ * a record. With tracing off, trace_mark/trace_begin cost one branch.
+ */
+int trace_enabled = 0;
+static int trace_fd = -1;
+static TraceEvent trace_ring[TRACE_RING_EVENTS];
+static int trace_count = 0;
+static uint32_t trace_request = 0;  // Number of the current request
+static uint32_t trace_plid = 0;     // PLID of the current request
+static char trace_command[3];
+static uint32_t trace_pid;
+
+/**
+ * @brief Opens the trace file and enables tracing.
+ *
+ * @param path The trace file.
+ * @param append Keep the events already in the file (a server taking over from
+ *               another one that traces to the same file).
+ * @return 1 on success, 0 on failure.
+ */
+int trace_open(const char *path, int append) {
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | (append ? 0 : O_TRUNC), 0666);
+    if (trace_fd == -1) {
+        perror("Failed to open trace file");
+        return 0;
+    }
+    if (lseek(trace_fd, 0, SEEK_END) == 0) {
+        TraceHeader header = { .magic = TRACE_MAGIC, .version = TRACE_VERSION, .event_size = sizeof(TraceEvent) };
+        if (write(trace_fd, &header, sizeof(header)) != sizeof(header)) {
+            perror("Failed to write trace file");
+            close(trace_fd);
+            trace_fd = -1;
+            return 0;
+        }
+    }
+    trace_pid = getpid();
+    trace_enabled = 1;
+    return 1;
+}
+
+/**
+ * @brief Appends the buffered events to the trace file.
+ */
+void trace_flush() {
+    if (trace_fd == -1 || trace_count == 0) return;
+    ssize_t len = trace_count * sizeof(TraceEvent);
+    if (write(trace_fd, trace_ring, len) != len) perror("Failed to write trace file");
+    trace_count = 0;
+}
+
+/**
+ * @brief Resets the inherited ring in a freshly forked worker.
+ *
+ * The events belong to the parent, which flushes them itself.
+ */
+void trace_child() {
+    trace_count = 0;
+    trace_request = 0;
+    trace_pid = getpid();
+}
+
+/**
+ * @brief Records the end of a phase of the current request.
+ *
+ * @param phase One of the TRACE_* phases.
+ */
+void trace_record(uint8_t phase) {
+    if (trace_count == TRACE_RING_EVENTS) trace_flush();
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    TraceEvent *e = &trace_ring[trace_count++];
+    e->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    e->request = trace_request;
+    e->pid = trace_pid;
+    e->plid = trace_plid;
+    memcpy(e->command, trace_command, sizeof(e->command));
+    e->phase = phase;
+}
+
+/**
+ * @brief Starts a new request and records its TRACE_RECV event.
+ *
+ * @param command The command ("TRY"); only its first 3 characters are kept.
+ * @param plid The PLID of the request, 0 if it has none.
+ */
+void trace_start_command(const char *command, uint32_t plid) {
+    trace_request++;
+    memset(trace_command, 0, sizeof(trace_command));
+    for (int i = 0; i < 3 && command[i] > ' '; i++) trace_command[i] = command[i];
+    trace_plid = plid;
+    trace_record(TRACE_RECV);
+}
+
+/**
+ * @brief Starts a new text request and records its TRACE_RECV event.
+ *
+ * @param request The request line ("CMD PLID ..."); need not be terminated after the PLID.
+ */
+void trace_start(const char *request) {
+    uint32_t plid = 0;
+    if (request[0] && request[1] && request[2] && request[3] == ' ') {
+        for (const char *p = request + 4; p < request + 10 && *p >= '0' && *p <= '9'; p++) {
+            plid = plid * 10 + (*p - '0');
+        }
+    }
+    trace_start_command(request, plid);
+}
@@ -0,0 +1,456 @@
+#include "GS.h"
+#include "../common.h"
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define GS_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/*
+ * Optional io_uring backend for the UDP loop (--io-uring).
+ *
+ * UDP_BATCH receives stay posted on the UDP socket; replies and game-file appends
+ * are queued as SQEs and submitted together once the completions at hand have
+ * been handled, so one io_uring_enter per wakeup replaces a syscall per datagram,
+ * reply and file line, and an append that has to wait for the disk runs in the
+ * kernel's workers instead of stalling the loop. A reply queued right after an
+ * append is linked to it, so the client never sees an answer before the trial is
+ * in the game file (TCP workers read it for STR). The ring descriptor joins the
+ * main select() in place of the UDP socket.
+ *
+ * Talks to the kernel through the raw system calls (no liburing). When the kernel
+ * or the build lacks io_uring, uring_init fails and GS keeps the portable loop.
+ */
+
+int uring_active = 0;
+
+#ifdef GS_HAVE_IO_URING
+
+#define URING_OP_RECV 1
+#define URING_OP_SEND 2
+#define URING_OP_WRITE 3
+#define URING_OP_CANCEL 4
+#define URING_DATA(op, slot) ((uint64_t)(op) << 32 | (uint32_t)(slot))
+
+typedef struct {
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in addr;
+    char data[MAX_BUFFER_SIZE];
+    int armed;
+} RecvSlot;
+
+typedef struct {
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in addr;
+    char data[MAX_BUFFER_SIZE + 8];
+} SendSlot;
+
+static struct {
+    int fd;
+    int udp;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_len, cq_ring_len, sqes_len;
+    unsigned queued;                  // SQEs not submitted yet
+    struct io_uring_sqe *last_write;  // Unsubmitted append the next reply is linked to
+    int quiescing;                    // Receives are being withdrawn (handoff)
+} ring;
+
+static RecvSlot recv_slots[UDP_BATCH];
+static SendSlot send_slots[URING_SEND_SLOTS];
+static char write_slots[URING_WRITE_SLOTS][MAX_BUFFER_SIZE];
+static int free_sends[URING_SEND_SLOTS], free_send_count;
+static int free_writes[URING_WRITE_SLOTS], free_write_count;
+static int recvs_armed, sends_in_flight, writes_in_flight;
+
+// Receive completions put aside while waiting for appends from inside a request (FIFO ring)
+static struct { int slot, res; } deferred[UDP_BATCH];
+static int deferred_head, deferred_count;
+
+/**
+ * @brief Checks whether the submission queue has no free entry.
+ */
+static int uring_sq_full() {
+    return *ring.sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) == ring.entries;
+}
+
+/**
+ * @brief Returns a cleared SQE at the tail of the submission queue.
+ *
+ * Submits what is queued first if the queue is full.
+ */
+static struct io_uring_sqe *uring_get_sqe() {
+    unsigned tail = *ring.sq_tail;
+    if (uring_sq_full()) {
+        uring_submit();
+        tail = *ring.sq_tail;
+    }
+    unsigned index = tail & *ring.sq_mask;
+    struct io_uring_sqe *sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring.queued++;
+    ring.last_write = NULL;
+    return sqe;
+}
+
+/**
+ * @brief Posts a receive on a free slot.
+ */
+static void uring_arm_recv(int slot) {
+    RecvSlot *r = &recv_slots[slot];
+    memset(&r->msg, 0, sizeof(r->msg));
+    r->iov.iov_base = r->data;
+    r->iov.iov_len = MAX_BUFFER_SIZE - 1;
+    r->msg.msg_name = &r->addr;
+    r->msg.msg_namelen = sizeof(r->addr);
+    r->msg.msg_iov = &r->iov;
+    r->msg.msg_iovlen = 1;
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = ring.udp;
+    sqe->addr = (uint64_t)(uintptr_t)&r->msg;
+    sqe->len = 1;
+    sqe->user_data = URING_DATA(URING_OP_RECV, slot);
+    r->armed = 1;
+    recvs_armed++;
+}
+
+/**
+ * @brief Submits the queued SQEs, optionally waiting for min_complete completions.
+ */
+static int uring_enter(unsigned min_complete) {
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    while (1) {
+        int n = syscall(__NR_io_uring_enter, ring.fd, ring.queued, min_complete, flags, NULL, 0);
+        if (n >= 0) {
+            ring.queued -= (unsigned)n < ring.queued ? (unsigned)n : ring.queued;
+            ring.last_write = NULL;
+            return 1;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EBUSY) {
+            // Completion queue full: the caller reaps, then submits again
+            return min_complete > 0;
+        }
+        perror("io_uring_enter");
+        return 0;
+    }
+}
+
+/**
+ * @brief Submits every queued SQE without waiting.
+ */
+void uring_submit() {
+    if (ring.queued > 0) uring_enter(0);
+}
+
+/**
+ * @brief Handles one datagram that arrived on a receive slot and posts it again.
+ */
+static void uring_finish_recv(int slot, int res) {
+    RecvSlot *r = &recv_slots[slot];
+    if (res > 0) {
+        handle_udp_datagram(r->data, res, &r->addr);
+    } else if (res < 0 && res != -ECANCELED) {
+        fprintf(stderr, "io_uring receive failed: %s\n", strerror(-res));
+    }
+    if (!ring.quiescing) uring_arm_recv(slot);
+}
+
+/**
+ * @brief Consumes the completions available.
+ *
+ * @param datagrams Handle received datagrams now; otherwise they are deferred
+ *                  (the caller is in the middle of a request).
+ */
+static void uring_reap(int datagrams) {
+    unsigned head = *ring.cq_head;
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe cqe = ring.cqes[head & *ring.cq_mask];
+        __atomic_store_n(ring.cq_head, ++head, __ATOMIC_RELEASE);
+
+        int op = cqe.user_data >> 32, slot = (uint32_t)cqe.user_data;
+        switch (op) {
+        case URING_OP_RECV:
+            recv_slots[slot].armed = 0;
+            recvs_armed--;
+            if (datagrams) {
+                uring_finish_recv(slot, cqe.res);
+            } else {
+                int i = (deferred_head + deferred_count++) % UDP_BATCH;
+                deferred[i].slot = slot;
+                deferred[i].res = cqe.res;
+            }
+            break;
+        case URING_OP_SEND:
+            free_sends[free_send_count++] = slot;
+            sends_in_flight--;
+            if (cqe.res < 0 && cqe.res != -ECANCELED) {
+                fprintf(stderr, "io_uring reply failed: %s\n", strerror(-cqe.res));
+            }
+            break;
+        case URING_OP_WRITE:
+            free_writes[free_write_count++] = slot;
+            writes_in_flight--;
+            if (cqe.res < 0) fprintf(stderr, "Game file append failed: %s\n", strerror(-cqe.res));
+            break;
+        }
+        // The completion of a datagram may have queued work that needs reaping below
+        head = *ring.cq_head;
+    }
+}
+
+/**
+ * @brief Sets up the ring and posts the receives.
+ *
+ * @param udp The UDP socket.
+ * @return 1 if the backend is active, 0 if io_uring is unavailable.
+ */
+int uring_init(int udp) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring.fd < 0) {
+        perror("io_uring_setup");
+        return 0;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        fprintf(stderr, "io_uring: kernel too old (features %#x)\n", p.features);
+        close(ring.fd);
+        return 0;
+    }
+
+    ring.sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring.cq_ring_len > ring.sq_ring_len) ring.sq_ring_len = ring.cq_ring_len;
+    ring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring.sq_ring = mmap(NULL, ring.sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    ring.sqes = mmap(NULL, ring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sq_ring == MAP_FAILED || ring.sqes == MAP_FAILED) {
+        perror("io_uring mmap");
+        close(ring.fd);
+        return 0;
+    }
+    ring.cq_ring = ring.sq_ring;  // IORING_FEAT_SINGLE_MMAP
+
+    char *sq = ring.sq_ring, *cq = ring.cq_ring;
+    ring.entries = p.sq_entries;
+    ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring.udp = udp;
+
+    for (int i = 0; i < URING_SEND_SLOTS; i++) free_sends[i] = i;
+    for (int i = 0; i < URING_WRITE_SLOTS; i++) free_writes[i] = i;
+    free_send_count = URING_SEND_SLOTS;
+    free_write_count = URING_WRITE_SLOTS;
+
+    // Room for the game files kept open (below FD_SETSIZE - GAME_FD_HEADROOM) and
+    // the connections queued for TCP workers, which never go through select()
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    for (int i = 0; i < UDP_BATCH; i++) uring_arm_recv(i);
+    if (!uring_enter(0)) {
+        uring_close();
+        return 0;
+    }
+    uring_active = 1;
+    return 1;
+}
+
+/**
+ * @brief Returns the ring descriptor, readable when completions are waiting.
+ */
+int uring_fd() {
+    return ring.fd;
+}
+
+/**
+ * @brief Handles every completion available (the ring descriptor was readable).
+ *
+ * Datagrams are dispatched as they complete and their slot posted again; all the
+ * replies and appends they queue are submitted together at the end.
+ */
+void uring_process() {
+    do {
+        // In arrival order: they completed before anything still in the CQ
+        while (deferred_count > 0) {
+            int i = deferred_head;
+            deferred_head = (deferred_head + 1) % UDP_BATCH;
+            deferred_count--;
+            uring_finish_recv(deferred[i].slot, deferred[i].res);
+        }
+        uring_reap(1);
+    } while (deferred_count > 0);
+    uring_submit();
+}
+
+/**
+ * @brief Queues a UDP reply.
+ *
+ * @return 1 if queued, 0 if no slot is free (the caller sends it directly).
+ */
+int uring_send(const char *data, size_t len, const struct sockaddr_in *addr) {
+    if (free_send_count == 0) uring_reap(0);
+    if (free_send_count == 0 || len > sizeof(send_slots[0].data)) return 0;
+
+    int slot = free_sends[--free_send_count];
+    SendSlot *s = &send_slots[slot];
+    memcpy(s->data, data, len);
+    s->addr = *addr;
+    s->iov.iov_base = s->data;
+    s->iov.iov_len = len;
+    memset(&s->msg, 0, sizeof(s->msg));
+    s->msg.msg_name = &s->addr;
+    s->msg.msg_namelen = sizeof(s->addr);
+    s->msg.msg_iov = &s->iov;
+    s->msg.msg_iovlen = 1;
+
+    // Sent only once the append queued just before it (the same request's) is done.
+    // With the queue full, getting an SQE would submit the append unlinked; wait for
+    // it instead.
+    struct io_uring_sqe *write = ring.last_write;
+    if (write && uring_sq_full()) {
+        uring_flush_writes();
+        write = NULL;
+    }
+    if (write) write->flags |= IOSQE_IO_LINK;
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = ring.udp;
+    sqe->addr = (uint64_t)(uintptr_t)&s->msg;
+    sqe->len = 1;
+    sqe->user_data = URING_DATA(URING_OP_SEND, slot);
+    sends_in_flight++;
+    return 1;
+}
+
+/**
+ * @brief Queues an append to a file opened with O_APPEND.
+ *
+ * Buffered writes to one file are serialized by the kernel, so appends land in the
+ * order they were queued.
+ *
+ * @return 1 if queued, 0 if no slot is free (the caller writes it directly).
+ */
+int uring_write(int fd, const char *data, size_t len) {
+    if (free_write_count == 0) uring_reap(0);
+    if (free_write_count == 0 || len > sizeof(write_slots[0])) return 0;
+
+    int slot = free_writes[--free_write_count];
+    memcpy(write_slots[slot], data, len);
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)write_slots[slot];
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;  // Current position, i.e. the end
+    sqe->user_data = URING_DATA(URING_OP_WRITE, slot);
+    ring.last_write = sqe;
+    writes_in_flight++;
+    return 1;
+}
+
+/**
+ * @brief Waits until every queued append has reached its file.
+ *
+ * Used before a finished game file is read back and archived. Datagrams completing
+ * meanwhile are kept for uring_process.
+ */
+void uring_flush_writes() {
+    while (writes_in_flight > 0) {
+        if (!uring_enter(1)) break;
+        uring_reap(0);
+    }
+}
+
+/**
+ * @brief Withdraws the posted receives before a handoff.
+ *
+ * Datagrams already received are handled, so the snapshot taken next includes
+ * them; anything arriving later stays in the socket for the new process.
+ */
+void uring_quiesce() {
+    ring.quiescing = 1;
+    for (int i = 0; i < UDP_BATCH; i++) {
+        if (!recv_slots[i].armed) continue;
+        struct io_uring_sqe *sqe = uring_get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = URING_DATA(URING_OP_RECV, i);
+        sqe->user_data = URING_DATA(URING_OP_CANCEL, i);
+    }
+    while (recvs_armed > 0 || deferred_count > 0) {
+        if (recvs_armed > 0 && !uring_enter(1)) break;
+        uring_process();
+    }
+    uring_flush_writes();
+}
+
+/**
+ * @brief Posts the receives again after a handoff that failed.
+ */
+void uring_resume() {
+    ring.quiescing = 0;
+    for (int i = 0; i < UDP_BATCH; i++) {
+        if (!recv_slots[i].armed) uring_arm_recv(i);
+    }
+    uring_submit();
+}
+
+/**
+ * @brief Waits for the replies and appends in flight, then tears the ring down.
+ */
+void uring_close() {
+    if (uring_active) {
+        if (!ring.quiescing) uring_quiesce();
+        while (sends_in_flight > 0 && uring_enter(1)) uring_reap(0);
+    }
+    munmap(ring.sq_ring, ring.sq_ring_len);
+    munmap(ring.sqes, ring.sqes_len);
+    close(ring.fd);
+    uring_active = 0;
+}
+
+#else
+
+int uring_init(int udp) {
+    fprintf(stderr, "io_uring: not supported by this build\n");
+    return 0;
+}
+
+int uring_fd() { return -1; }
+void uring_process() {}
+void uring_submit() {}
+int uring_send(const char *data, size_t len, const struct sockaddr_in *addr) { return 0; }
+int uring_write(int fd, const char *data, size_t len) { return 0; }
+void uring_flush_writes() {}
+void uring_quiesce() {}
+void uring_resume() {}
+void uring_close() {}
+
+#endif
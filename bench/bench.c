@@ -0,0 +1,133 @@
+#include "../common.h"
+#include "../solver.h"
+#include <time.h>
+
+/*
+ * Solver bench: plays games against random secrets in-process, keeping many games
+ * in flight at once the way a load-test bot does, and reports throughput and the
+ * number of guesses needed.
+ */
+
+typedef struct {
+    Solver solver;
+    Code secret;
+    int active;
+} BenchGame;
+
+uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/**
+ * @brief Returns the next output of a small xorshift64* generator.
+ */
+uint64_t bench_rand() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Prints the command-line usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-g PxC] [-s first|minimax] [-n games] [-c concurrent] [--seed N]\n", prog);
+    exit(1);
+}
+
+/**
+ * @brief Main function of the solver bench.
+ *
+ * Plays -n games of geometry -g (default 4x6) with strategy -s, -c of them at a
+ * time, advancing every game in flight by one guess per round.
+ */
+int main(int argc, char *argv[]) {
+    int pegs = COLOR_SEQUENCE_LEN, colors = NUM_COLORS;
+    int strategy = SOLVER_FIRST;
+    long games = 10000, concurrent = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &pegs, &colors) != 2) usage(argv[0]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if ((strategy = solver_strategy(argv[++i])) < 0) usage(argv[0]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            games = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            concurrent = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rng_state = strtoull(argv[++i], NULL, 0) | 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    int geometry = geometry_find(pegs, colors);
+    if (geometry < 0 || games <= 0 || concurrent <= 0) {
+        fprintf(stderr, "Error: unsupported geometry %dx%d or bad counts\n", pegs, colors);
+        exit(1);
+    }
+    const Geometry *g = &geometries[geometry];
+    if (concurrent > games) concurrent = games;
+
+    BenchGame *slots = calloc(concurrent, sizeof(BenchGame));
+    long histogram[MAX_TRIALS + 2] = {0};  // Guesses needed; the last bucket is "more"
+    long started = 0, finished = 0, total_guesses = 0;
+    int max_guesses = 0;
+    if (!slots) {
+        perror("calloc");
+        exit(1);
+    }
+
+    long start = now_us();
+    while (finished < games) {
+        for (long i = 0; i < concurrent; i++) {
+            BenchGame *game = &slots[i];
+            if (!game->active) {
+                if (started == games) continue;
+                if (!solver_init(&game->solver, geometry, strategy)) exit(1);
+                game->secret = code_from_index(g, (uint32_t)(((unsigned __int128)bench_rand() * g->space) >> 64));
+                game->active = 1;
+                started++;
+            }
+
+            int nB, nW;
+            Code guess = solver_next_guess(&game->solver);
+            g->score(guess, game->secret, &nB, &nW);
+            if (guess == CODE_INVALID || solver_feedback(&game->solver, guess, nB, nW) < 0) {
+                fprintf(stderr, "Error: solver lost the secret\n");
+                exit(1);
+            }
+
+            if (nB == g->pegs) {
+                int n = game->solver.guesses;
+                histogram[n <= MAX_TRIALS ? n : MAX_TRIALS + 1]++;
+                total_guesses += n;
+                if (n > max_guesses) max_guesses = n;
+                solver_free(&game->solver);
+                game->active = 0;
+                finished++;
+            }
+        }
+    }
+    long elapsed = now_us() - start;
+    free(slots);
+
+    printf("[*] %ld games of %dx%d (%s), %ld in flight: %.3f s, %.0f games/s\n",
+           games, g->pegs, g->colors, strategy == SOLVER_MINIMAX ? "minimax" : "first",
+           concurrent, elapsed / 1e6, games * 1e6 / (elapsed ? elapsed : 1));
+    printf("[*] Guesses: avg %.3f, max %d, over %d: %ld\n",
+           (double)total_guesses / games, max_guesses, MAX_TRIALS, histogram[MAX_TRIALS + 1]);
+    for (int n = 1; n <= MAX_TRIALS; n++) {
+        printf("    %d: %ld\n", n, histogram[n]);
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Compares the UDP protocols: runs the same solver games against a traced GS with
+# text requests (v1) and with binary frames (v2), then prints the bytes each put on
+# the wire and, from the trace, the time GS spent parsing requests and rendering
+# replies.
+#
+# Usage: bench/protocol.sh [GAMES [PORT]]
+
+GAMES=${1:-2000}
+PORT=${2:-58150}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+GS_PID=""
+trap 'kill $GS_PID 2>/dev/null; wait 2>/dev/null; rm -rf "$WORK"' EXIT INT TERM
+
+make -s -C "$ROOT" >/dev/null || exit 1
+
+for v in 1 2; do
+    dir="$WORK/v$v"
+    mkdir -p "$dir/GAMES" "$dir/SCORES"
+    (cd "$dir" && exec "$ROOT/GS/GS" -p "$PORT" --rate 0 --trace "$dir/trace.bin" >gs.log 2>&1) &
+    GS_PID=$!
+    sleep 0.3
+    "$ROOT/player/player" -p "$PORT" -r "$GAMES" -s minimax -P "$v" >"$dir/client.tsv" 2>/dev/null
+    kill -INT $GS_PID
+    wait $GS_PID 2>/dev/null
+    GS_PID=""
+
+    echo "[*] Protocol v$v:"
+    grep -h '^# totals:' "$dir/client.tsv" | tr ' ' '\n' | awk -F= '
+        $1 == "commands" { n = $2 } $1 == "bytes_out" { o = $2 } $1 == "bytes_in" { i = $2 }
+        $1 == "protocol" { p = $2 }
+        END {
+            if (p == "") { print "    no totals (client failed)"; exit }
+            printf "    %d commands, %d bytes out (%.1f per request), %d bytes in (%.1f per reply), sent as v%d\n",
+                   n, o, n ? o / n : 0, i, n ? i / n : 0, p
+        }'
+    # Per-command phases: parse and render are the protocol's share of the work
+    "$ROOT/tracedump/tracedump" -s "$dir/trace.bin" | awk '
+        /requests$/ { cmd = $1 }
+        $1 == "phase" || $1 == "parse" || $1 == "render" || $1 == "total" { printf "    %-4s %s\n", cmd, $0 }'
+done
@@ -0,0 +1,94 @@
+#include "cluster.h"
+
+// 32-bit finalizer of MurmurHash3: spreads consecutive PLIDs over the ring
+static uint32_t cluster_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+// FNV-1a over a string, finalized like PLIDs
+static uint32_t cluster_hash_string(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return cluster_mix(h);
+}
+
+// Position of a PLID on the ring
+uint32_t cluster_hash_plid(uint32_t plid) {
+    return cluster_mix(plid ^ 0x9e3779b9u);
+}
+
+// Adds a "host:port" node, resolving it once; returns its index, or -1 on failure
+int cluster_add_node(Cluster *c, const char *spec) {
+    if (c->count == CLUSTER_MAX_NODES) {
+        fprintf(stderr, "Too many cluster nodes (at most %d)\n", CLUSTER_MAX_NODES);
+        return -1;
+    }
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || strlen(spec) >= sizeof(c->nodes[0].name)) {
+        fprintf(stderr, "Invalid node '%s' (expected host:port)\n", spec);
+        return -1;
+    }
+
+    char host[80];
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    int errcode = getaddrinfo(host, colon + 1, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo error for %s: %s\n", spec, gai_strerror(errcode));
+        return -1;
+    }
+
+    ClusterNode *node = &c->nodes[c->count];
+    strcpy(node->name, spec);
+    memcpy(&node->addr, res->ai_addr, sizeof(node->addr));
+    freeaddrinfo(res);
+    return c->count++;
+}
+
+static int cluster_compare_points(const void *a, const void *b) {
+    const ClusterPoint *x = a, *y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return x->node - y->node;
+}
+
+// Places every node's points on the ring; call after the last cluster_add_node
+void cluster_build(Cluster *c) {
+    c->points = 0;
+    for (int i = 0; i < c->count; i++) {
+        for (int v = 0; v < CLUSTER_VNODES; v++) {
+            char key[96];
+            snprintf(key, sizeof(key), "%s#%d", c->nodes[i].name, v);
+            c->ring[c->points].hash = cluster_hash_string(key);
+            c->ring[c->points].node = i;
+            c->points++;
+        }
+    }
+    qsort(c->ring, c->points, sizeof(ClusterPoint), cluster_compare_points);
+}
+
+// Index of the node owning a PLID (binary search on the ring), -1 if there are no nodes
+int cluster_owner(const Cluster *c, uint32_t plid) {
+    if (c->points == 0) return -1;
+    uint32_t h = cluster_hash_plid(plid);
+    int lo = 0, hi = c->points;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (c->ring[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return c->ring[lo == c->points ? 0 : lo].node;
+}
@@ -0,0 +1,39 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Cluster membership and PLID placement. Every node (a GS instance, "host:port")
+ * gets CLUSTER_VNODES points on a 32-bit hash ring; a PLID belongs to the node of
+ * the first point at or after its hash. Adding or removing a node only moves the
+ * PLIDs of the ranges next to its points.
+ */
+
+#define CLUSTER_MAX_NODES 32
+#define CLUSTER_VNODES 64        // Ring points per node
+
+typedef struct {
+    char name[80];               // "host:port" as configured
+    struct sockaddr_in addr;     // Same address for UDP and TCP
+} ClusterNode;
+
+typedef struct {
+    uint32_t hash;
+    int node;
+} ClusterPoint;
+
+typedef struct {
+    ClusterNode nodes[CLUSTER_MAX_NODES];
+    int count;
+    ClusterPoint ring[CLUSTER_MAX_NODES * CLUSTER_VNODES];
+    int points;
+} Cluster;
+
+int cluster_add_node(Cluster *c, const char *spec);
+void cluster_build(Cluster *c);
+int cluster_owner(const Cluster *c, uint32_t plid);
+uint32_t cluster_hash_plid(uint32_t plid);
+
+#endif
@@ -0,0 +1,136 @@
+#include "code.h"
+
+// Returns the index of color c in COLORS, or -1 if c is not a valid color
+int color_index(char c) {
+    switch (c) {
+        case 'R': return 0;
+        case 'G': return 1;
+        case 'B': return 2;
+        case 'Y': return 3;
+        case 'O': return 4;
+        case 'P': return 5;
+        case 'W': return 6;
+        case 'K': return 7;
+        case 'C': return 8;
+        case 'M': return 9;
+        default: return -1;
+    }
+}
+
+/*
+ * Per-geometry kernels. Peg and color counts are constants in each instance, so the
+ * compiler unrolls the loops and sizes the histograms exactly; score_4x6 is the same
+ * code a dedicated 4x6 build would produce. The batch kernels (filter, tally) inline
+ * the scoring loop instead of calling it per code.
+ */
+#define DEFINE_GEOMETRY_KERNELS(P, C)                                               \
+    static inline void score_##P##x##C(Code guess, Code secret, int *nB, int *nW) {        \
+        int guess_count[C] = {0}, secret_count[C] = {0};                            \
+        int black = 0, white = 0;                                                   \
+        for (int i = 0; i < P; i++) {                                               \
+            int g = CODE_PEG(guess, i), s = CODE_PEG(secret, i);                    \
+            if (g == s) {                                                           \
+                black++;                                                            \
+            } else {                                                                \
+                guess_count[g]++;                                                   \
+                secret_count[s]++;                                                  \
+            }                                                                       \
+        }                                                                           \
+        for (int c = 0; c < C; c++) {                                               \
+            white += guess_count[c] < secret_count[c] ? guess_count[c] : secret_count[c]; \
+        }                                                                           \
+        *nB = black;                                                                \
+        *nW = white;                                                                \
+    }                                                                               \
+    static Code parse_##P##x##C(const char *s) {                                    \
+        Code code = 0;                                                              \
+        for (int i = 0; i < P; i++) {                                               \
+            int c = color_index(s[i]);                                              \
+            if (c < 0 || c >= C) return CODE_INVALID;                               \
+            code |= (Code)c << (CODE_BITS * i);                                     \
+        }                                                                           \
+        return s[P] == '\0' ? code : CODE_INVALID;                                  \
+    }                                                                               \
+    static uint32_t filter_##P##x##C(const Code *in, uint32_t n, Code *out,         \
+                                     Code guess, int nB, int nW) {                  \
+        uint32_t kept = 0;                                                          \
+        for (uint32_t i = 0; i < n; i++) {                                          \
+            int b, w;                                                               \
+            score_##P##x##C(guess, in[i], &b, &w);                                  \
+            out[kept] = in[i];                                                      \
+            kept += b == nB && w == nW;                                             \
+        }                                                                           \
+        return kept;                                                                \
+    }                                                                               \
+    static void tally_##P##x##C(const Code *codes, uint32_t n, Code guess,          \
+                                uint32_t *counts) {                                 \
+        for (uint32_t i = 0; i < n; i++) {                                          \
+            int b, w;                                                               \
+            score_##P##x##C(guess, codes[i], &b, &w);                               \
+            counts[FEEDBACK_CLASS(b, w)]++;                                         \
+        }                                                                           \
+    }
+
+GEOMETRY_LIST(DEFINE_GEOMETRY_KERNELS)
+
+// C^P for the 4 to 6 pegs of GEOMETRY_LIST
+#define GEOMETRY_SPACE(P, C) (C * C * C * C * (P > 4 ? C : 1) * (P > 5 ? C : 1))
+#define GEOMETRY_ENTRY(P, C) \
+    { P, C, GEOMETRY_SPACE(P, C), score_##P##x##C, parse_##P##x##C, filter_##P##x##C, tally_##P##x##C },
+
+const Geometry geometries[] = { GEOMETRY_LIST(GEOMETRY_ENTRY) };
+
+// Returns the index of the pegs x colors geometry, or -1 if it is not supported
+int geometry_find(int pegs, int colors) {
+    for (int i = 0; i < NUM_GEOMETRIES; i++) {
+        if (geometries[i].pegs == pegs && geometries[i].colors == colors) return i;
+    }
+    return -1;
+}
+
+// Returns the code with the given index in [0, g->space), read as a base-C number
+Code code_from_index(const Geometry *g, uint32_t index) {
+    Code code = 0;
+    for (int i = 0; i < g->pegs; i++) {
+        code |= (Code)(index % g->colors) << (CODE_BITS * i);
+        index /= g->colors;
+    }
+    return code;
+}
+
+// Writes the compact form ("RGBY") of a pegs-long code into out (CODE_STR_LEN bytes)
+void code_to_string(Code code, int pegs, char *out) {
+    for (int i = 0; i < pegs; i++) {
+        out[i] = COLORS[CODE_PEG(code, i)];
+    }
+    out[pegs] = '\0';
+}
+
+// Writes the protocol form ("R G B Y") of a pegs-long code into out (CODE_FMT_LEN bytes)
+void format_code(Code code, int pegs, char *out) {
+    for (int i = 0; i < pegs; i++) {
+        out[2 * i] = COLORS[CODE_PEG(code, i)];
+        out[2 * i + 1] = ' ';
+    }
+    out[2 * pegs - 1] = '\0';
+}
+
+// Whether code is a code of geometry g: pegs colors of its palette and nothing more
+int code_valid(const Geometry *g, Code code) {
+    if (code == CODE_INVALID || code >> (CODE_BITS * g->pegs) != 0) return 0;
+    for (int i = 0; i < g->pegs; i++) {
+        if (CODE_PEG(code, i) >= g->colors) return 0;
+    }
+    return 1;
+}
+
+// Parses a 6-digit PLID into an integer; returns 0 if it is not valid
+int parse_plid(const char *plid, uint32_t *out) {
+    if (!validate_plid(plid)) return 0;
+    uint32_t value = 0;
+    for (int i = 0; i < 6; i++) {
+        value = value * 10 + (plid[i] - '0');
+    }
+    *out = value;
+    return 1;
+}
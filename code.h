@@ -0,0 +1,65 @@
+#ifndef CODE_H
+#define CODE_H
+
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Packed representation of a color code: peg i occupies bits 4i..4i+3 and holds
+ * the index of its color in COLORS. A 6-peg code fits in 24 bits.
+ */
+typedef uint32_t Code;
+
+#define COLORS "RGBYOPWKCM"   // Classic games use the first 6
+#define NUM_COLORS 6          // Colors of the classic game
+#define MAX_PEGS 6
+#define MAX_COLORS 10
+#define CODE_BITS 4
+#define CODE_INVALID ((Code)0xFFFFFFFF)
+#define CODE_PEG(code, i) (((code) >> (CODE_BITS * (i))) & 0xF)
+
+// Textual forms: "RGBY" needs pegs + 1 bytes, "R G B Y" needs 2 * pegs
+#define CODE_STR_LEN (MAX_PEGS + 1)
+#define CODE_FMT_LEN (2 * MAX_PEGS)
+
+/*
+ * Supported game geometries (pegs x colors). Every entry gets its own scoring and
+ * parsing kernels with the sizes fixed at compile time; the classic 4x6 game must
+ * stay first so it is geometry 0.
+ */
+#define GEOMETRY_LIST(X) \
+    X(4, 6) X(4, 8) X(4, 10) \
+    X(5, 6) X(5, 8) X(5, 10) \
+    X(6, 6) X(6, 8) X(6, 10)
+
+#define GEOMETRY_CLASSIC 0
+#define GEOMETRY_COUNT_ONE(P, C) + 1
+#define NUM_GEOMETRIES (0 GEOMETRY_LIST(GEOMETRY_COUNT_ONE))
+
+// Feedback (nB, nW) as a small index, e.g. for counting how a guess splits candidates
+#define FEEDBACK_CLASS(nB, nW) ((nB) * (MAX_PEGS + 1) + (nW))
+#define FEEDBACK_CLASSES ((MAX_PEGS + 1) * (MAX_PEGS + 1))
+
+typedef struct {
+    uint8_t pegs;
+    uint8_t colors;
+    uint32_t space;                                           // colors^pegs possible codes
+    void (*score)(Code guess, Code secret, int *nB, int *nW); // Black and white pegs
+    Code (*parse)(const char *s);                             // "RGBY" to Code, CODE_INVALID if off-palette
+    // Copies the codes of in[0..n) that give (nB, nW) against guess to out (may equal in)
+    uint32_t (*filter)(const Code *in, uint32_t n, Code *out, Code guess, int nB, int nW);
+    // Adds, for each code, one to counts[FEEDBACK_CLASS] of its feedback against guess
+    void (*tally)(const Code *codes, uint32_t n, Code guess, uint32_t *counts);
+} Geometry;
+
+extern const Geometry geometries[];
+
+int geometry_find(int pegs, int colors);
+int color_index(char c);
+Code code_from_index(const Geometry *g, uint32_t index);
+void code_to_string(Code code, int pegs, char *out);
+void format_code(Code code, int pegs, char *out);
+int code_valid(const Geometry *g, Code code);
+int parse_plid(const char *plid, uint32_t *out);
+
+#endif
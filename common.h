@@ -20,6 +20,8 @@
 #define MAX_TRIALS 8
 #define MAX_PLAYTIME 600  // Maximum playtime in seconds
 #define MAX_BUFFER_SIZE 1024
+#define KEEPALIVE_TOKEN " K"  // Appended to STR/SSB to keep the TCP connection open
+#define ECHO_TOKEN " E"       // Appended to UDP requests to get replies tagged with the PLID
 
 
 // FUNCTIONS
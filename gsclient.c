@@ -0,0 +1,895 @@
+#define _GNU_SOURCE  // recvmmsg
+#include "gsclient.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <time.h>
+
+/**
+ * @brief Returns the current monotonic time in milliseconds.
+ */
+static long gs_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/**
+ * @brief Opens the UDP socket and resolves the server's UDP and TCP addresses.
+ *
+ * @param host The server's name or address.
+ * @param port The server's port (UDP and TCP).
+ * @return The client, or NULL on failure.
+ */
+GSClient *gs_client_open(const char *host, const char *port) {
+    GSClient *c = calloc(1, sizeof(GSClient));
+    if (!c) {
+        perror("calloc client");
+        return NULL;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    int errcode = getaddrinfo(host, port, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(errcode));
+        free(c);
+        return NULL;
+    }
+    memcpy(&c->udp_addr, res->ai_addr, sizeof(c->udp_addr));
+    freeaddrinfo(res);
+
+    hints.ai_socktype = SOCK_STREAM;
+    errcode = getaddrinfo(host, port, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(errcode));
+        free(c);
+        return NULL;
+    }
+    memcpy(&c->tcp_addr, res->ai_addr, res->ai_addrlen);
+    c->tcp_addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    c->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (c->fd == -1) {
+        perror("Socket creation failed");
+        free(c);
+        return NULL;
+    }
+    c->tcp_conn = -1;
+    c->rto_ms = GS_RTO_INITIAL_MS;
+    c->protocol = 1;
+    return c;
+}
+
+/**
+ * @brief Closes the sockets and frees the client; sessions must be freed first.
+ */
+void gs_client_close(GSClient *c) {
+    if (!c) return;
+    if (c->tcp_conn != -1) close(c->tcp_conn);
+    close(c->fd);
+    free(c);
+}
+
+/**
+ * @brief Finds the hash bucket of the sessions of a PLID.
+ */
+static GSSession **gs_bucket(GSClient *c, uint32_t plid) {
+    return &c->buckets[(plid * 2654435761u) >> 22 & (GS_SESSION_BUCKETS - 1)];
+}
+
+/**
+ * @brief Adds a session to the PLID hash.
+ *
+ * Sessions without a valid PLID are not hashed; their replies can only come untagged.
+ */
+static void gs_hash(GSSession *s) {
+    if (!parse_plid(s->plid, &s->plid_num)) return;
+    GSSession **bucket = gs_bucket(s->client, s->plid_num);
+    s->hash_next = *bucket;
+    *bucket = s;
+}
+
+/**
+ * @brief Removes a session from the PLID hash.
+ */
+static void gs_unhash(GSSession *s) {
+    if (!validate_plid(s->plid)) return;
+    for (GSSession **link = gs_bucket(s->client, s->plid_num); *link; link = &(*link)->hash_next) {
+        if (*link == s) {
+            *link = s->hash_next;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Unlinks a session from the list of sessions waiting for a reply.
+ */
+static void gs_pending_remove(GSSession *s) {
+    GSClient *c = s->client;
+    if (s->pending_prev) s->pending_prev->pending_next = s->pending_next;
+    else c->pending_head = s->pending_next;
+    if (s->pending_next) s->pending_next->pending_prev = s->pending_prev;
+    else c->pending_tail = s->pending_prev;
+    s->pending_prev = s->pending_next = NULL;
+    c->pending--;
+}
+
+/**
+ * @brief Creates a session.
+ *
+ * @param c The client the session sends through.
+ * @param plid The player's ID ("" until a game is started).
+ * @param callback Called when a request completes; may be NULL.
+ * @param user Passed to the callback.
+ * @return The session, or NULL on failure.
+ */
+GSSession *gs_session_new(GSClient *c, const char *plid, GSCallback callback, void *user) {
+    GSSession *s = calloc(1, sizeof(GSSession));
+    if (!s) {
+        perror("calloc session");
+        return NULL;
+    }
+    s->client = c;
+    s->callback = callback;
+    s->user = user;
+    s->geometry = GEOMETRY_CLASSIC;
+    snprintf(s->plid, sizeof(s->plid), "%s", plid);
+    gs_session_reset(s);
+    gs_hash(s);
+    return s;
+}
+
+/**
+ * @brief Switches the session to another player.
+ *
+ * @return 1 on success, 0 while a request is in flight.
+ */
+int gs_session_set_plid(GSSession *s, const char *plid) {
+    if (s->waiting) return 0;
+    gs_unhash(s);
+    snprintf(s->plid, sizeof(s->plid), "%s", plid);
+    gs_hash(s);
+    return 1;
+}
+
+/**
+ * @brief Forgets the current game.
+ */
+void gs_session_reset(GSSession *s) {
+    s->active = 0;
+    s->trial = 1;
+    s->last_nB = s->last_nW = -1;
+}
+
+/**
+ * @brief Frees a session, abandoning its request in flight.
+ */
+void gs_session_free(GSSession *s) {
+    if (!s) return;
+    if (s->waiting) gs_pending_remove(s);
+    gs_unhash(s);
+    free(s);
+}
+
+/**
+ * @brief Feeds an RTT sample to the estimator and updates the RTO.
+ *
+ * Standard SRTT/RTTVAR smoothing (alpha = 1/8, beta = 1/4), RTO = SRTT + 4 * RTTVAR,
+ * clamped to [GS_RTO_MIN_MS, GS_RTO_MAX_MS].
+ */
+static void gs_update_rtt(GSClient *c, long sample_ms) {
+    if (c->stats.rtt_samples++ == 0) {
+        c->srtt_ms = sample_ms;
+        c->rttvar_ms = sample_ms / 2;
+    } else {
+        long delta = sample_ms - c->srtt_ms;
+        c->srtt_ms += delta / 8;
+        c->rttvar_ms += ((delta < 0 ? -delta : delta) - c->rttvar_ms) / 4;
+    }
+
+    c->rto_ms = c->srtt_ms + 4 * c->rttvar_ms;
+    if (c->rto_ms < GS_RTO_MIN_MS) c->rto_ms = GS_RTO_MIN_MS;
+    if (c->rto_ms > GS_RTO_MAX_MS) c->rto_ms = GS_RTO_MAX_MS;
+}
+
+/**
+ * @brief Tracks the game state a reply implies.
+ *
+ * A RTR OK whose feedback cannot score the game's geometry (nB or nW negative, or
+ * more than pegs between them) is rejected: it changes nothing and leaves no
+ * feedback in last_nB/last_nW.
+ */
+static void gs_apply_reply(GSSession *s, const char *reply) {
+    int trial, nB, nW;
+    if (strncmp(reply, "RSG OK", 6) == 0 || strncmp(reply, "RDB OK", 6) == 0) {
+        gs_session_reset(s);
+        s->active = 1;
+    } else if (sscanf(reply, "RTR OK %d %d %d", &trial, &nB, &nW) == 3) {
+        if (nB < 0 || nW < 0 || nB + nW > geometries[s->geometry].pegs) {
+            s->last_nB = s->last_nW = -1;
+            return;
+        }
+        s->last_nB = nB;
+        s->last_nW = nW;
+        s->trial = trial + 1;
+        if (nB == geometries[s->geometry].pegs) s->active = 0;
+    } else if (strncmp(reply, "RSG ERR", 7) == 0 || strncmp(reply, "RDB ERR", 7) == 0 ||
+               strncmp(reply, "RTR ENT", 7) == 0 || strncmp(reply, "RTR ETM", 7) == 0 ||
+               strncmp(reply, "RQT OK", 6) == 0 || strncmp(reply, "RQT NOK", 7) == 0) {
+        gs_session_reset(s);
+    }
+}
+
+/**
+ * @brief Sends the session's request, as a binary frame or as text.
+ *
+ * The echo token is appended to text requests while the server is known (or being
+ * probed) to tag replies. Arms the retransmission deadline.
+ *
+ * @return 1 if the datagram was sent, 0 otherwise.
+ */
+static int gs_transmit(GSSession *s) {
+    GSClient *c = s->client;
+    int binary = c->protocol == WIRE_VERSION && s->has_frame;
+    int tagged = c->echo == GS_ECHO_ON || (c->echo_probe == s && validate_plid(s->plid));
+    char text[MAX_BUFFER_SIZE];
+    const void *data = binary ? (const void *)s->frame : text;
+    size_t len = binary ? sizeof(s->frame)
+                        : (size_t)snprintf(text, sizeof(text), "%s%s\n", s->request, tagged ? ECHO_TOKEN : "");
+    s->sent_at = gs_now_ms();
+    s->deadline = s->sent_at + s->timeout;
+    if (sendto(c->fd, data, len, 0, (struct sockaddr *)&c->udp_addr, sizeof(c->udp_addr)) == -1) {
+        perror("sendto failed");
+        return 0;
+    }
+    c->stats.bytes_sent += len;
+    return 1;
+}
+
+/**
+ * @brief Sends a request no longer held back, unless it must wait for the echo probe.
+ *
+ * @return 0 if sending failed, 1 otherwise.
+ */
+static int gs_release(GSSession *s) {
+    GSClient *c = s->client;
+    s->held = 0;
+    if (!(c->protocol == WIRE_VERSION && s->has_frame) && c->echo == GS_ECHO_UNKNOWN) {
+        // Until a reply tells whether the server tags replies, one text request goes at a time
+        if (!c->echo_probe) {
+            c->echo_probe = s;
+        } else if (c->echo_probe != s) {
+            s->held = GS_HELD_PROBE;
+            return 1;
+        }
+    }
+    if (gs_transmit(s)) return 1;
+    if (c->echo_probe == s) c->echo_probe = NULL;
+    return 0;
+}
+
+static void gs_complete(GSSession *s, const char *reply);
+
+/**
+ * @brief Sends the requests that waited for the echo probe, failing those that cannot be sent.
+ */
+static void gs_release_probe_waiters(GSClient *c) {
+    GSSession *next;
+    for (GSSession *s = c->pending_head; s; s = next) {
+        next = s->pending_next;
+        if (s->held == GS_HELD_PROBE && !gs_release(s)) gs_complete(s, NULL);
+    }
+}
+
+/**
+ * @brief Ends the request in flight and runs the callback.
+ *
+ * @param s The session.
+ * @param reply The reply, or NULL if every attempt timed out.
+ */
+static void gs_complete(GSSession *s, const char *reply) {
+    GSClient *c = s->client;
+    gs_pending_remove(s);
+    s->waiting = 0;
+    s->held = 0;
+    s->has_reply = reply != NULL;
+    memcpy(s->last_expected, s->expected, 4);
+    s->last_retransmitted = s->attempt > 0;
+    s->quiet_until = gs_now_ms() + c->rto_ms;
+    if (c->echo_probe == s) {
+        c->echo_probe = NULL;
+        gs_release_probe_waiters(c);
+    }
+    if (reply) {
+        // A reply to a retransmitted request is ambiguous (Karn), so it is not sampled
+        if (s->attempt == 0) gs_update_rtt(c, gs_now_ms() - s->sent_at);
+        snprintf(s->reply, sizeof(s->reply), "%s", reply);
+        gs_apply_reply(s, s->reply);
+    }
+    if (s->callback) s->callback(s, reply ? s->reply : NULL, s->user);
+}
+
+/**
+ * @brief Sends a request ("SNG 123456 060").
+ *
+ * The echo token and newline are appended when it is transmitted. frame holds the
+ * same request for the binary protocol; its version, ID and PLID are filled in here.
+ *
+ * @param s The session; it must have no request in flight.
+ * @param expected The reply code ("RSG").
+ * @param trial The trial a RTR OK must carry, -1 for any.
+ * @param frame The request for the binary protocol.
+ * @param fmt The text request, printf-style.
+ * @return 1 if the request is on its way, 0 otherwise.
+ */
+static int gs_send(GSSession *s, const char *expected, int trial, WireRequest *frame, const char *fmt, ...) {
+    GSClient *c = s->client;
+    if (s->waiting) return 0;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(s->request, sizeof(s->request) - sizeof(ECHO_TOKEN) - 1, fmt, ap);
+    va_end(ap);
+    if (len < 0 || len >= (int)(sizeof(s->request) - sizeof(ECHO_TOKEN) - 1)) return 0;
+
+    s->id = c->next_id++;
+    s->has_frame = parse_plid(s->plid, &frame->plid);
+    frame->version = WIRE_VERSION;
+    frame->id = s->id;
+    wire_encode_request(frame, s->frame);
+
+    memcpy(s->expected, expected, 4);
+    s->expected_trial = trial;
+    s->attempt = 0;
+    s->timeout = c->rto_ms;
+    s->has_reply = 0;
+
+    // A late copy of the last reply would match this text request too; let it pass first
+    int binary = c->protocol == WIRE_VERSION && s->has_frame;
+    if (!binary && s->last_retransmitted && strncmp(s->last_expected, expected, 3) == 0 &&
+        gs_now_ms() < s->quiet_until) {
+        s->held = GS_HELD_QUIET;
+        s->deadline = s->quiet_until;
+    } else if (!gs_release(s)) {
+        return 0;
+    }
+
+    s->waiting = 1;
+    s->pending_prev = c->pending_tail;
+    s->pending_next = NULL;
+    if (c->pending_tail) c->pending_tail->pending_next = s;
+    else c->pending_head = s;
+    c->pending_tail = s;
+    c->pending++;
+    c->stats.requests++;
+    return 1;
+}
+
+/**
+ * @brief Packs space-separated colors ("R G B Y") into a code.
+ *
+ * @param colors The colors.
+ * @param pegs Set to the number of colors.
+ * @return The code, or CODE_INVALID if one is not a color.
+ */
+static Code gs_pack_colors(const char *colors, int *pegs) {
+    Code code = 0;
+    *pegs = 0;
+    for (const char *p = colors; *p; p++) {
+        if (*p == ' ') continue;
+        int color = color_index(*p);
+        if (color < 0 || (p[1] != ' ' && p[1] != '\0') || *pegs == MAX_PEGS) return CODE_INVALID;
+        code |= (Code)color << (CODE_BITS * (*pegs)++);
+    }
+    return code;
+}
+
+/**
+ * @brief Converts a play time for a binary frame; out-of-range values are refused by the server.
+ */
+static uint16_t gs_frame_time(int time) {
+    return time > 0 && time <= 0xffff ? time : 0;
+}
+
+/**
+ * @brief Asks the server to start a game.
+ *
+ * @param s The session.
+ * @param time The play time, in seconds.
+ * @return 1 if the request was sent, 0 otherwise.
+ */
+int gs_start(GSSession *s, int time) {
+    const Geometry *g = &geometries[s->geometry];
+    WireRequest frame = { .op = WIRE_SNG, .arg = gs_frame_time(time), .pegs = g->pegs, .colors = g->colors };
+    if (s->geometry == GEOMETRY_CLASSIC) {
+        return gs_send(s, "RSG", -1, &frame, "SNG %s %03d", s->plid, time);
+    }
+    return gs_send(s, "RSG", -1, &frame, "SNG %s %03d %d %d", s->plid, time, g->pegs, g->colors);
+}
+
+/**
+ * @brief Sends a guess as the session's next trial.
+ *
+ * @param s The session.
+ * @param colors The guess, colors separated by spaces ("R G B Y").
+ * @return 1 if the request was sent, 0 otherwise.
+ */
+int gs_try(GSSession *s, const char *colors) {
+    int pegs;
+    WireRequest frame = { .op = WIRE_TRY, .arg = s->trial };
+    frame.code = gs_pack_colors(colors, &pegs);
+    frame.pegs = pegs;
+    return gs_send(s, "RTR", s->trial, &frame, "TRY %s %s %d", s->plid, colors, s->trial);
+}
+
+/**
+ * @brief Starts a debug game with the given secret.
+ *
+ * @param s The session.
+ * @param time The play time, in seconds.
+ * @param colors The secret key, colors separated by spaces ("R G B Y").
+ * @return 1 if the request was sent, 0 otherwise.
+ */
+int gs_debug(GSSession *s, int time, const char *colors) {
+    const Geometry *g = &geometries[s->geometry];
+    int pegs;
+    WireRequest frame = { .op = WIRE_DBG, .arg = gs_frame_time(time), .pegs = g->pegs, .colors = g->colors };
+    frame.code = gs_pack_colors(colors, &pegs);
+    if (pegs != g->pegs) frame.code = CODE_INVALID;
+    if (s->geometry == GEOMETRY_CLASSIC) {
+        return gs_send(s, "RDB", -1, &frame, "DBG %s %03d %s", s->plid, time, colors);
+    }
+    return gs_send(s, "RDB", -1, &frame, "DBG %s %03d %s %d %d", s->plid, time, colors, g->pegs, g->colors);
+}
+
+/**
+ * @brief Quits the session's game.
+ *
+ * @return 1 if the request was sent, 0 otherwise.
+ */
+int gs_quit(GSSession *s) {
+    WireRequest frame = { .op = WIRE_QUT };
+    return gs_send(s, "RQT", -1, &frame, "QUT %s", s->plid);
+}
+
+/**
+ * @brief Removes the PLID the server appends to replies of tagged requests.
+ *
+ * Keys and feedback never form a 6-digit word.
+ *
+ * @return The PLID, or -1 for an untagged reply.
+ */
+static long gs_strip_tag(char *reply) {
+    size_t len = strlen(reply);
+    if (len > 0 && reply[len - 1] == '\n') len--;
+    if (len < 8 || reply[len - 7] != ' ') return -1;
+
+    char tag[7];
+    uint32_t plid;
+    memcpy(tag, reply + len - 6, 6);
+    tag[6] = '\0';
+    if (!parse_plid(tag, &plid)) return -1;
+    strcpy(reply + len - 7, "\n");
+    return plid;
+}
+
+/**
+ * @brief Checks whether the waiting session s expects this reply.
+ */
+static int gs_matches(GSSession *s, const char *reply) {
+    int trial;
+    if (!s->waiting || s->held || strncmp(reply, s->expected, 3) != 0) return 0;
+    return s->expected_trial == -1 || sscanf(reply, "RTR OK %d", &trial) != 1 || trial == s->expected_trial;
+}
+
+/**
+ * @brief Routes one text reply to its session.
+ *
+ * @return 1 if it completed a request, 0 otherwise.
+ */
+static int gs_dispatch(GSClient *c, char *reply) {
+    long tag = gs_strip_tag(reply);
+    GSSession *s = NULL;
+    if (tag >= 0) {
+        for (s = *gs_bucket(c, tag); s; s = s->hash_next) {
+            if (s->plid_num == (uint32_t)tag && gs_matches(s, reply)) break;
+        }
+    } else {
+        for (s = c->pending_head; s && !gs_matches(s, reply); s = s->pending_next) ;
+    }
+
+    // Anything else answers a request that was retransmitted or abandoned
+    if (!s) {
+        c->stats.stale++;
+        return 0;
+    }
+
+    // The echo probe's reply tells whether the server understood the token
+    if (c->echo == GS_ECHO_UNKNOWN && s == c->echo_probe && validate_plid(s->plid)) {
+        c->echo = tag >= 0 ? GS_ECHO_ON : GS_ECHO_OFF;
+        if (c->echo == GS_ECHO_OFF && strncmp(reply + 3, " ERR", 4) == 0) {
+            // The token was read as a field; send the request again without it
+            if (c->log_retransmits) printf("[*] Server does not tag replies; sending requests untagged.\n");
+            c->echo_probe = NULL;
+            gs_release_probe_waiters(c);
+            if (gs_transmit(s)) return 0;
+            gs_complete(s, NULL);
+            return 1;
+        }
+    }
+    gs_complete(s, reply);
+    return 1;
+}
+
+/**
+ * @brief Sends the rest of the session's requests, and every later one, as text.
+ */
+static void gs_fall_back_to_text(GSClient *c, const char *why) {
+    c->protocol = 1;
+    if (c->log_retransmits) printf("[*] %s; using the text protocol.\n", why);
+}
+
+/**
+ * @brief Routes a binary reply to its session by PLID and request ID.
+ *
+ * The request is completed with the reply's text form.
+ *
+ * @return 1 if it completed a request, 0 otherwise.
+ */
+static int gs_dispatch_frame(GSClient *c, const uint8_t *data, size_t len) {
+    WireReply r;
+    GSSession *s = NULL;
+    if (wire_decode_reply(data, len, &r) && r.plid <= WIRE_PLID_MAX) {
+        for (s = *gs_bucket(c, r.plid); s; s = s->hash_next) {
+            if (s->plid_num == r.plid && s->waiting && !s->held && s->has_frame && s->id == r.id &&
+                strncmp(wire_reply_code(r.op), s->expected, 3) == 0) break;
+        }
+    }
+    if (!s) {
+        c->stats.stale++;
+        return 0;
+    }
+
+    if (r.status == WIRE_BADVERSION) {
+        gs_fall_back_to_text(c, "Server does not speak binary protocol v2");
+        if (!gs_release(s)) {
+            gs_complete(s, NULL);
+            return 1;
+        }
+        return 0;
+    }
+    c->binary_confirmed = 1;
+
+    char text[MAX_BUFFER_SIZE];
+    wire_reply_text(&r, geometries[s->geometry].pegs, text, sizeof(text));
+    gs_complete(s, text);
+    return 1;
+}
+
+/**
+ * @brief Receives the replies waiting on the socket and routes them to their sessions.
+ *
+ * @return The number of requests completed.
+ */
+static int gs_receive(GSClient *c) {
+    struct mmsghdr msgs[GS_RX_BATCH];
+    struct iovec iovs[GS_RX_BATCH];
+    struct sockaddr_in addrs[GS_RX_BATCH];
+    for (int i = 0; i < GS_RX_BATCH; i++) {
+        iovs[i].iov_base = c->rx[i];
+        iovs[i].iov_len = MAX_BUFFER_SIZE - 1;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(c->fd, msgs, GS_RX_BATCH, MSG_DONTWAIT, NULL);
+    if (n == -1) {
+        if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) perror("recvfrom failed");
+        return 0;
+    }
+
+    int completed = 0;
+    for (int i = 0; i < n; i++) {
+        c->stats.bytes_received += msgs[i].msg_len;
+        c->rx[i][msgs[i].msg_len] = '\0';
+        // Only the server we talk to may answer
+        if (addrs[i].sin_port != c->udp_addr.sin_port || addrs[i].sin_addr.s_addr != c->udp_addr.sin_addr.s_addr) {
+            c->stats.stale++;
+            continue;
+        }
+        if (wire_is_binary(c->rx[i], msgs[i].msg_len)) {
+            completed += gs_dispatch_frame(c, (const uint8_t *)c->rx[i], msgs[i].msg_len);
+        } else {
+            completed += gs_dispatch(c, c->rx[i]);
+        }
+    }
+    return completed;
+}
+
+/**
+ * @brief Handles the requests whose deadline passed.
+ *
+ * Retransmits the requests whose timeout expired, doubling their timeout, and fails
+ * those out of attempts. A failure also backs off the shared RTO for later requests.
+ * Held requests are sent for the first time once their quiet period is over;
+ * those waiting for the echo probe are left to its reply.
+ *
+ * @return The number of requests completed.
+ */
+static int gs_expire(GSClient *c) {
+    long now = gs_now_ms();
+    int completed = 0;
+    GSSession *next;
+    for (GSSession *s = c->pending_head; s; s = next) {
+        next = s->pending_next;
+        if (s->held == GS_HELD_PROBE || s->deadline > now) continue;
+
+        if (s->held) {
+            if (!gs_release(s)) {
+                gs_complete(s, NULL);
+                completed++;
+            }
+            continue;
+        }
+
+        s->timeout *= 2;
+        if (s->timeout > GS_RTO_MAX_MS) s->timeout = GS_RTO_MAX_MS;
+        if (s->attempt == GS_MAX_RETRANSMITS) {
+            c->stats.failures++;
+            c->rto_ms = s->timeout;
+            gs_complete(s, NULL);
+            completed++;
+            continue;
+        }
+
+        // Before any binary reply, repeated silence means a server that ignores
+        // binary frames; one timeout may just be a lost datagram
+        if (c->protocol == WIRE_VERSION && !c->binary_confirmed && s->attempt + 1 >= GS_BINARY_SILENCES) {
+            gs_fall_back_to_text(c, "No reply to binary protocol v2");
+        }
+        s->attempt++;
+        c->stats.retransmits++;
+        if (c->log_retransmits) {
+            printf("[*] No reply from server, retransmitting (%d/%d).\n", s->attempt, GS_MAX_RETRANSMITS);
+        }
+        if (!gs_release(s)) {
+            gs_complete(s, NULL);
+            completed++;
+        }
+    }
+    return completed;
+}
+
+/**
+ * @brief Returns the milliseconds until the earliest retransmission is due, or -1 if none is.
+ */
+int gs_client_next_timeout(GSClient *c) {
+    long now = gs_now_ms(), first = -1;
+    for (GSSession *s = c->pending_head; s; s = s->pending_next) {
+        if (s->held != GS_HELD_PROBE && (first == -1 || s->deadline < first)) first = s->deadline;
+    }
+    if (first == -1) return -1;
+    return first > now ? (int)(first - now) : 0;
+}
+
+/**
+ * @brief Waits for replies, then handles the replies received and the timeouts expired.
+ *
+ * @param c The client.
+ * @param timeout_ms Longest wait; -1 waits until a request is due.
+ * @return The number of requests completed, -1 on error.
+ */
+int gs_client_poll(GSClient *c, int timeout_ms) {
+    int wait = gs_client_next_timeout(c);
+    if (timeout_ms >= 0 && (wait < 0 || wait > timeout_ms)) wait = timeout_ms;
+
+    struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+    int ready = poll(&pfd, 1, wait);
+    if (ready == -1) {
+        if (errno == EINTR) return 0;
+        perror("poll failed");
+        return -1;
+    }
+
+    int completed = ready > 0 ? gs_receive(c) : 0;
+    return completed + gs_expire(c);
+}
+
+/**
+ * @brief Polls until the session's request completes.
+ *
+ * @return The reply, or NULL if the request failed.
+ */
+const char *gs_session_wait(GSSession *s) {
+    while (s->waiting) {
+        if (gs_client_poll(s->client, -1) < 0) return NULL;
+    }
+    return s->has_reply ? s->reply : NULL;
+}
+
+/**
+ * @brief Opens a TCP connection to the cached server address.
+ *
+ * @return The socket, or -1 on failure.
+ */
+static int gs_tcp_connect(GSClient *c) {
+    int tcp_fd = socket(c->tcp_addr.ss_family, SOCK_STREAM, 0);
+    if (tcp_fd == -1) {
+        perror("TCP socket failed");
+        return -1;
+    }
+    if (connect(tcp_fd, (struct sockaddr *)&c->tcp_addr, c->tcp_addrlen) == -1) {
+        perror("Connection to server failed");
+        close(tcp_fd);
+        return -1;
+    }
+    return tcp_fd;
+}
+
+/**
+ * @brief Sends a TCP request line and waits until the reply starts to arrive.
+ *
+ * In keep-alive mode the previous connection is reused, and if the server closed it
+ * meanwhile (idle timeout or request cap) the request is sent again on a fresh one.
+ *
+ * @return The socket to read the reply from, or -1 on failure.
+ */
+int gs_tcp_request(GSClient *c, const char *request) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int reused = (c->tcp_conn != -1);
+        int tcp_fd = reused ? c->tcp_conn : gs_tcp_connect(c);
+        if (tcp_fd == -1) return -1;
+        c->tcp_conn = -1;
+
+        char ch;
+        if (send(tcp_fd, request, strlen(request), MSG_NOSIGNAL) != -1 && recv(tcp_fd, &ch, 1, MSG_PEEK) == 1) {
+            return tcp_fd;
+        }
+
+        close(tcp_fd);
+        if (!reused) {
+            perror("Failed to send request or read response");
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Keeps a connection whose reply was read completely for the next request
+ * (keep-alive), else closes it.
+ */
+void gs_tcp_release(GSClient *c, int tcp_fd, int reusable) {
+    if (c->tcp_keepalive && reusable) {
+        c->tcp_conn = tcp_fd;
+    } else {
+        close(tcp_fd);
+    }
+}
+
+/**
+ * @brief Starts reading a reply from fd.
+ */
+void gs_reader_init(GSReader *r, int fd) {
+    r->fd = fd;
+    r->pos = r->len = 0;
+}
+
+/**
+ * @brief Reads the header of a STR/SSB reply.
+ *
+ * The header runs up to its fourth space ("RST ACT fname fsize ") or a newline for
+ * replies without a file ("RST NOK\n"). Bytes past the header stay buffered for
+ * gs_reader_save_file.
+ *
+ * @return 1 on success, 0 if the connection failed or the header is too long.
+ */
+int gs_reader_header(GSReader *r, char *header, int size) {
+    int header_len = 0;
+    int space_count = 0;
+
+    while (1) {
+        if (r->pos == r->len) {
+            int n = recv(r->fd, r->data, sizeof(r->data), 0);
+            if (n <= 0) {
+                perror("recv failed while reading header");
+                return 0;
+            }
+            r->pos = 0;
+            r->len = n;
+        }
+
+        while (r->pos < r->len) {
+            char c = r->data[r->pos++];
+            if (header_len >= size - 1) {
+                printf("[!] Header too long.\n");
+                return 0;
+            }
+            header[header_len++] = c;
+
+            if (c == '\n' || (c == ' ' && ++space_count == 4)) {
+                header[header_len] = '\0';
+                return 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reads the rest of a reply line, through the newline.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int gs_reader_line(GSReader *r, char *line, int size) {
+    int len = 0;
+    while (1) {
+        if (r->pos == r->len) {
+            int n = recv(r->fd, r->data, sizeof(r->data), 0);
+            if (n <= 0) {
+                perror("recv failed while reading reply");
+                return 0;
+            }
+            r->pos = 0;
+            r->len = n;
+        }
+        char c = r->data[r->pos++];
+        if (len >= size - 1) {
+            printf("[!] Reply line too long.\n");
+            return 0;
+        }
+        line[len++] = c;
+        if (c == '\n') {
+            line[len] = '\0';
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Writes the fsize-byte body of a reply to fname and consumes the trailing newline.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int gs_reader_save_file(GSReader *r, const char *fname, long fsize) {
+    FILE *file = fopen(fname, "wb");
+    if (!file) {
+        perror("Failed to open local file for writing");
+        return 0;
+    }
+
+    long buffered = r->len - r->pos;
+    if (buffered > fsize) buffered = fsize;
+    fwrite(r->data + r->pos, 1, buffered, file);
+    r->pos += buffered;
+
+    long bytes_received = buffered;
+    char chunk[8 * MAX_BUFFER_SIZE];
+    while (bytes_received < fsize) {
+        long to_read = (fsize - bytes_received) < (long)sizeof(chunk) ? fsize - bytes_received : (long)sizeof(chunk);
+        int n = recv(r->fd, chunk, to_read, 0);
+        if (n <= 0) {
+            perror("Failed to receive file data");
+            fclose(file);
+            return 0;
+        }
+        fwrite(chunk, 1, n, file);
+        bytes_received += n;
+    }
+    fclose(file);
+
+    char c;
+    if (r->pos < r->len) {
+        c = r->data[r->pos++];
+    } else if (recv(r->fd, &c, 1, 0) != 1) {
+        return 0;
+    }
+    return c == '\n';
+}
@@ -0,0 +1,154 @@
+#ifndef GSCLIENT_H
+#define GSCLIENT_H
+
+#include "code.h"
+#include "wire.h"
+
+/*
+ * Game Server client library. A GSClient owns one UDP socket and the server
+ * addresses, resolved once; any number of GSSession (one per PLID) share it.
+ *
+ * Requests are asynchronous: gs_start/gs_try/gs_debug/gs_quit send the datagram
+ * and return; gs_client_poll receives replies, retransmits on timeout and calls
+ * the session's callback once a request completes. A session has at most one
+ * request in flight, as the protocol requires.
+ *
+ * Text requests carry ECHO_TOKEN so the server tags replies with the PLID, which
+ * routes them to their session. Servers predating the token read it as one more
+ * field and answer ERR, so it is negotiated: the first text request goes out with
+ * the token alone, other sessions' requests waiting for its reply. A tagged reply
+ * keeps the token on; an untagged one turns it off (an ERR is then sent again
+ * without the token). Without the token, an untagged reply goes to the oldest
+ * session waiting for that code.
+ *
+ * Text replies carry no request ID, so a late copy of the reply to a retransmitted
+ * request could pass for the reply to the next request of the same command (a
+ * second RTR DUP, say). After a retransmitted request, the session's next request
+ * of the same command is therefore held back for one RTO, and replies arriving
+ * meanwhile are dropped as stale. Binary requests carry an ID and are never held.
+ *
+ * With protocol set to WIRE_VERSION, requests go out as binary frames (wire.h)
+ * and binary replies are handed to callbacks in their text form, so callers see
+ * no difference. Until the server has answered a binary frame, a WIRE_BADVERSION
+ * reply, or GS_BINARY_SILENCES unanswered sends of one request, switch the client
+ * back to text for good; a single lost datagram does not.
+ *
+ * STR/SSB go over TCP with gs_tcp_request and a GSReader.
+ */
+
+#define GS_RTO_INITIAL_MS 1000   // Timeout before the first RTT sample
+#define GS_RTO_MIN_MS 200
+#define GS_RTO_MAX_MS 4000
+#define GS_MAX_RETRANSMITS 3     // Retransmissions per request after the first send
+#define GS_BINARY_SILENCES 2     // Unanswered sends of a binary request that mean a text-only server
+#define GS_RX_BATCH 32           // Datagrams received per wakeup
+#define GS_SESSION_BUCKETS 1024  // PLID hash buckets (power of two)
+
+enum { GS_ECHO_UNKNOWN, GS_ECHO_ON, GS_ECHO_OFF };
+enum { GS_HELD_QUIET = 1, GS_HELD_PROBE };
+
+typedef struct GSSession GSSession;
+
+// Called when a request completes; reply is NULL if every attempt timed out
+typedef void (*GSCallback)(GSSession *s, const char *reply, void *user);
+
+typedef struct {
+    long requests;
+    long retransmits;
+    long failures;
+    long stale;
+    long rtt_samples;
+    long bytes_sent;                 // UDP payload bytes, retransmissions included
+    long bytes_received;
+} GSStats;
+
+typedef struct GSClient {
+    int fd;                          // UDP socket
+    struct sockaddr_in udp_addr;     // Resolved once, used for every datagram
+    struct sockaddr_storage tcp_addr;
+    socklen_t tcp_addrlen;
+    int tcp_keepalive;               // Reuse one TCP connection for STR/SSB
+    int tcp_conn;                    // Idle keep-alive connection, or -1
+    int log_retransmits;             // Print a line for every retransmission
+    int echo;                        // GS_ECHO_UNKNOWN, GS_ECHO_ON or GS_ECHO_OFF
+    GSSession *echo_probe;           // Request finding out whether the server tags replies
+    int protocol;                    // 1 (text) or WIRE_VERSION (binary frames)
+    int binary_confirmed;            // The server has answered a binary frame
+    uint16_t next_id;                // ID of the next binary request
+
+    long srtt_ms, rttvar_ms, rto_ms; // RTT estimator shared by all sessions
+    GSStats stats;
+
+    GSSession *buckets[GS_SESSION_BUCKETS];
+    GSSession *pending_head, *pending_tail;  // Sessions waiting for a reply, oldest first
+    int pending;
+    char rx[GS_RX_BATCH][MAX_BUFFER_SIZE];   // Preallocated receive buffers
+} GSClient;
+
+struct GSSession {
+    GSClient *client;
+    char plid[7];
+    uint32_t plid_num;
+    int geometry;            // Geometry of the games started by this session
+    int active;              // A game is in progress
+    int trial;               // Number of the next try
+    int last_nB, last_nW;    // Feedback of the last accepted try, -1 before any
+    GSCallback callback;
+    void *user;
+
+    // Request in flight
+    int waiting;
+    char expected[4];        // Reply code, e.g. "RTR"
+    int expected_trial;      // Trial a RTR OK must carry, -1 for any
+    char request[MAX_BUFFER_SIZE];   // Text request, without echo token and newline
+    uint8_t frame[WIRE_FRAME_LEN];   // The same request as a binary frame
+    int has_frame;                   // 0 if the PLID cannot be sent in binary
+    uint16_t id;
+    int attempt;
+    int held;                // Not sent yet: waiting out stale replies (GS_HELD_QUIET) until
+                             // deadline, or for the echo probe's reply (GS_HELD_PROBE)
+    long sent_at, deadline, timeout;
+
+    // Last completed request, to hold the next one after a retransmission
+    char last_expected[4];
+    int last_retransmitted;
+    long quiet_until;
+
+    char reply[MAX_BUFFER_SIZE];   // Last reply, tag removed
+    int has_reply;
+
+    GSSession *hash_next;
+    GSSession *pending_prev, *pending_next;
+};
+
+// Buffered reader for STR/SSB replies
+typedef struct {
+    int fd;
+    char data[MAX_BUFFER_SIZE];
+    int pos, len;
+} GSReader;
+
+GSClient *gs_client_open(const char *host, const char *port);
+void gs_client_close(GSClient *c);
+int gs_client_poll(GSClient *c, int timeout_ms);
+int gs_client_next_timeout(GSClient *c);
+
+GSSession *gs_session_new(GSClient *c, const char *plid, GSCallback callback, void *user);
+int gs_session_set_plid(GSSession *s, const char *plid);
+void gs_session_reset(GSSession *s);
+void gs_session_free(GSSession *s);
+const char *gs_session_wait(GSSession *s);
+
+int gs_start(GSSession *s, int time);
+int gs_try(GSSession *s, const char *colors);
+int gs_debug(GSSession *s, int time, const char *colors);
+int gs_quit(GSSession *s);
+
+int gs_tcp_request(GSClient *c, const char *request);
+void gs_tcp_release(GSClient *c, int tcp_fd, int reusable);
+void gs_reader_init(GSReader *r, int fd);
+int gs_reader_header(GSReader *r, char *header, int size);
+int gs_reader_line(GSReader *r, char *line, int size);
+int gs_reader_save_file(GSReader *r, const char *fname, long fsize);
+
+#endif
@@ -1,25 +1,37 @@
 #include "../common.h"
+#include "../solver.h"
+#include "../gsclient.h"
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
-int fd, errcode;
-struct addrinfo hints, *res;
-char buffer[MAX_BUFFER_SIZE];
-
-char currentPLID[7] = "";
-int gamestate = 0;
-int trial_number = 1;
+GSClient *client;    // Socket, server addresses and RTT estimate
+GSSession *session;  // The game of the current PLID
 int exit_requested = 0;
 
+// Batch mode (-b / -r) bookkeeping
+char last_reply[16] = "-";  // Reply code of the last request, e.g. "RTR OK" or "TIMEOUT"
+int solver_mode = -1;       // Solver strategy for -r games (-s), or -1 for random guesses
+
+struct {
+    FILE *report;
+    long *latencies;  // Per-command latency in microseconds
+    long count;
+    long capacity;
+    long timeouts;
+} batch;
+
+int tcp_keepalive = 0;  // Reuse one TCP connection for STR/SSB (-k)
+int udp_protocol = 1;   // UDP protocol version (-P): 1 text, 2 binary frames
+
 /**
  * @brief Resets the player's game state.
  *
- * Resets player variables to their original state, except PLID is not cleared 
- * because we might reuse it. The intention is to reset trial_number and gamestate.
+ * The PLID is kept because we might reuse it; the trial number and game state
+ * are reset.
  */
 void reset_player(){
-    trial_number = 1;
-    gamestate = 0;
+    gs_session_reset(session);
 }
 
 /**
@@ -33,36 +45,60 @@ void handle_signal(int sig) {
 }
 
 /**
- * @brief Receives a UDP response from the server with a timeout of 10 seconds.
- *
- * @return char* The response from the server, or NULL if no response was received within 10s.
+ * @brief Returns the current monotonic time in microseconds.
  */
-char* receive_udp_response() {
-    struct sockaddr_in server_addr;
-    socklen_t addr_len = sizeof(server_addr);
-    char *response = malloc(MAX_BUFFER_SIZE);
-    if (!response) {
-        perror("Failed to allocate memory for response");
-        exit(1);
-    }
+long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
 
-    int n = recvfrom(fd, response, MAX_BUFFER_SIZE - 1, 0, (struct sockaddr *)&server_addr, &addr_len);
-    if (n == -1) {
-        // Either timed out or error
-        if (errno == EWOULDBLOCK || errno == EAGAIN) {
-            // Timeout
-            free(response);
-            return NULL;
-        }
-        perror("recvfrom failed");
-        free(response);
-        return NULL;
+/**
+ * @brief Remembers the reply code (first two words) of a server response for the batch report.
+ */
+void record_reply(const char *response) {
+    char code[4], status[8];
+    if (sscanf(response, "%3s %7s", code, status) == 2) {
+        snprintf(last_reply, sizeof(last_reply), "%s %s", code, status);
     }
+}
 
-    response[n] = '\0';
+/**
+ * @brief Waits for the reply to the request just sent by the session.
+ *
+ * Retransmissions and RTT estimation are handled by the client library.
+ *
+ * @param sent Whether the request could be sent at all.
+ * @return The reply (valid until the next request), or NULL if it failed or timed out.
+ */
+const char *await_reply(int sent) {
+    const char *response = sent ? gs_session_wait(session) : NULL;
+    if (response) {
+        record_reply(response);
+    } else {
+        strcpy(last_reply, "TIMEOUT");
+    }
     return response;
 }
 
+/**
+ * @brief Prints the UDP retransmission statistics gathered during this session.
+ */
+void print_udp_stats() {
+    printf("[*] UDP stats: %ld requests, %ld retransmits, %ld failed, %ld stale replies discarded; srtt = %ld ms, rto = %ld ms; %ld bytes sent, %ld received (protocol v%d)\n",
+           client->stats.requests, client->stats.retransmits, client->stats.failures, client->stats.stale,
+           client->srtt_ms, client->rto_ms, client->stats.bytes_sent, client->stats.bytes_received, client->protocol);
+}
+
+/**
+ * @brief Prints the UDP statistics and releases the client when the interactive player exits.
+ */
+void close_client() {
+    print_udp_stats();
+    gs_session_free(session);
+    gs_client_close(client);
+}
+
 /**
  * @brief Handles the "start" command.
  *
@@ -80,38 +116,29 @@ void handle_start_command(const char *PLID, const char *time) {
         return;
     }
 
-    if (gamestate == 1) {
+    if (session->active) {
         printf("[!] You must terminate the current game before starting a new one.\n");
         return;
     }
 
     int time_int = atoi(time);
 
-    strcpy(currentPLID, PLID);
-
-    snprintf(buffer, MAX_BUFFER_SIZE, "SNG %s %03d\n", currentPLID, time_int);
-
-    sendto(fd, buffer, strlen(buffer), 0, res->ai_addr, res->ai_addrlen);
+    gs_session_set_plid(session, PLID);
 
-    char *response = receive_udp_response();
+    const char *response = await_reply(gs_start(session, time_int));
     if (!response) {
         printf("[!] No response from server (timeout or error).\n");
         return;
     }
 
     if (strcmp(response, "RSG OK\n") == 0) {
-        trial_number = 1;
-        gamestate = 1;
         printf("[+] Game started successfully. You can now play! You have %d seconds!\n", time_int);
 
     } else if (strcmp(response, "RSG NOK\n") == 0) {
         printf("[!] A game is already associated with this PLID.\n");
     } else if (strcmp(response, "RSG ERR\n") == 0) {
         printf("[!] Error starting the game. Please check the input and try again.\n");
-        reset_player();
     }
-
-    free(response);
 }
 
 /**
@@ -125,14 +152,14 @@ void handle_start_command(const char *PLID, const char *time) {
  * @param C4 Color 4 of the guess.
  */
 void handle_try_command(const char *C1, const char *C2, const char *C3, const char *C4) {
-    if (gamestate == 0) {
+    if (!session->active) {
         printf("[!] No active game. Please start a game first.\n");
         return;
     }
-    snprintf(buffer, MAX_BUFFER_SIZE, "TRY %s %s %s %s %s %d\n", currentPLID, C1, C2, C3, C4, trial_number);
+    char colors[CODE_FMT_LEN + 8];
+    snprintf(colors, sizeof(colors), "%s %s %s %s", C1, C2, C3, C4);
 
-    sendto(fd, buffer, strlen(buffer), 0, res->ai_addr, res->ai_addrlen);
-    char* response = receive_udp_response();
+    const char *response = await_reply(gs_try(session, colors));
     if (!response) {
         printf("[!] No response from server (timeout or error).\n");
         return;
@@ -145,13 +172,10 @@ void handle_try_command(const char *C1, const char *C2, const char *C3, const ch
         sscanf(response, "RTR OK %d %d %d", &trial, &nB, &nW);
         printf("[+] TRIAL %d: nB = %d, nW = %d\n", trial, nB, nW);
 
-        if(nB == 4){
-            printf("[+] WELL DONE! You guessed the key in %d trials!\n", trial_number);
-            reset_player();
+        if(nB == COLOR_SEQUENCE_LEN){
+            printf("[+] WELL DONE! You guessed the key in %d trials!\n", trial);
         }
 
-        trial_number++;
-
     } else if (strncmp(response, "RTR NOK", 7) == 0) {
         printf("[!] No ongoing game for this player. You need to start a game.\n");
 
@@ -168,19 +192,15 @@ void handle_try_command(const char *C1, const char *C2, const char *C3, const ch
         char c1, c2, c3, c4;
         sscanf(response, "RTR ENT %c %c %c %c", &c1, &c2, &c3, &c4);
         printf("[!] Game over! The secret key was: %c %c %c %c\n", c1, c2, c3, c4);
-        reset_player();
 
     } else if (strncmp(response, "RTR ETM", 7) == 0) {
         char c1, c2, c3, c4;
         sscanf(response, "RTR ETM %c %c %c %c", &c1, &c2, &c3, &c4);
         printf("[!] Time is up! The secret key was: %c %c %c %c\n", c1, c2, c3, c4);
-        reset_player();
 
     } else {
         printf("[!] Unrecognized response from the server.\n");
     }
-
-    free(response);
 }
 
 /**
@@ -194,37 +214,31 @@ void handle_debug_command(const char *PLID, const char *time, const char *C1, co
         return;
     }
 
-    if (gamestate == 1) {
+    if (session->active) {
         printf("[!] You must terminate the game before starting a new one.\n");
         return;
     }
 
-    strcpy(currentPLID, PLID);
+    gs_session_set_plid(session, PLID);
 
-    snprintf(buffer, MAX_BUFFER_SIZE, "DBG %s %s %s %s %s %s\n", PLID, time, C1, C2, C3, C4);
-    sendto(fd, buffer, strlen(buffer), 0, res->ai_addr, res->ai_addrlen);
-
-    char* response = receive_udp_response();
+    char colors[CODE_FMT_LEN + 8];
+    snprintf(colors, sizeof(colors), "%s %s %s %s", C1, C2, C3, C4);
+    const char *response = await_reply(gs_debug(session, atoi(time), colors));
     if (!response) {
         printf("[!] No response from server (timeout or error).\n");
         return;
     }
 
     if (strcmp(response, "RDB OK\n") == 0) {
-        int time_int = atoi(time);
-        trial_number = 1;
-        gamestate = 1;
-        printf("[+] Debug Game started successfully. You have %d seconds!\n", time_int);
+        printf("[+] Debug Game started successfully. You have %d seconds!\n", atoi(time));
 
     } else if(strcmp(response, "RDB NOK\n") == 0){
         printf("[!] This player ID already has a game running!\n");
 
     } else if (strcmp(response, "RDB ERR\n") == 0) {
         printf("[!] Error: PLID, color sequence or time not valid!\n");
-        reset_player();
     }
     printf("(<-) Server Response: %s\n", response);
-    free(response);
 }
 
 /**
@@ -233,10 +247,8 @@ void handle_debug_command(const char *PLID, const char *time, const char *C1, co
  * Sends the "QUT" command to the Game Server to terminate an active game.
  */
 void handle_quit_command() {
-    snprintf(buffer, MAX_BUFFER_SIZE, "QUT %s\n", currentPLID);
-    printf("(->) Sending: %s", buffer);
-    sendto(fd, buffer, strlen(buffer), 0, res->ai_addr, res->ai_addrlen);
-    char *response = receive_udp_response();
+    printf("(->) Sending: QUT %s\n", session->plid);
+    const char *response = await_reply(gs_quit(session));
     
     if (!response) {
         printf("[!] No response from server (timeout or error).\n");
@@ -250,10 +262,8 @@ void handle_quit_command() {
         char c1, c2, c3, c4;
         sscanf(response, "RQT OK %c %c %c %c", &c1, &c2, &c3, &c4);
         printf("[+] Quit game successfully! The secret key was: %c %c %c %c.\n", c1, c2, c3, c4);
-        reset_player();
 
     } else if(strncmp(response, "RQT NOK", 7) == 0){
-        reset_player();
         printf("[!] There is no game associated with this player.\n");
 
     } else if(strncmp(response, "RQT ERR", 7) == 0){
@@ -262,8 +272,22 @@ void handle_quit_command() {
     } else {
         printf("[!] Error: Unable to do this operation.\n");
     }
+}
 
-    free(response);
+/**
+ * @brief Prints a received text file to stdout.
+ */
+void print_file(const char *fname) {
+    char line[MAX_BUFFER_SIZE];
+    FILE *file = fopen(fname, "r");
+    if (!file) {
+        perror("Failed to open received file for reading");
+        return;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        printf("%s", line);
+    }
+    fclose(file);
 }
 
 /**
@@ -271,368 +295,469 @@ void handle_quit_command() {
  *
  * Sends the "STR PLID" command via TCP. Receives the file and prints it.
  */
-void handle_show_trials_command(const char *GSIP, const char *GSPort) {
+void handle_show_trials_command() {
     int tcp_fd;
-    struct addrinfo thints, *tres;
-    char tbuffer[MAX_BUFFER_SIZE];
+    GSReader reader;
+    char header[MAX_BUFFER_SIZE];
     char status[4], fname[64];
     long fsize = 0;
 
-    memset(&thints, 0, sizeof(thints));
-    thints.ai_family = AF_INET;
-    thints.ai_socktype = SOCK_STREAM;
-
-    // Estabilishes TCP connection.
-
-    if ((errcode = getaddrinfo(GSIP, GSPort, &thints, &tres)) != 0) {
-        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(errcode));
+    snprintf(header, sizeof(header), "STR %s%s\n", session->plid, tcp_keepalive ? KEEPALIVE_TOKEN : "");
+    strcpy(last_reply, "ERROR");
+    if ((tcp_fd = gs_tcp_request(client, header)) == -1) {
         return;
     }
 
-    tcp_fd = socket(tres->ai_family, tres->ai_socktype, tres->ai_protocol);
-    if (tcp_fd == -1) {
-        perror("TCP socket failed");
-        freeaddrinfo(tres);
+    // Server sends "RST NOK\n", or "RST ACT fname fsize " / "RST FIN fname fsize "
+    // followed by the data and a newline.
+    gs_reader_init(&reader, tcp_fd);
+    if (!gs_reader_header(&reader, header, sizeof(header))) {
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
+    record_reply(header);
 
-    if (connect(tcp_fd, tres->ai_addr, tres->ai_addrlen) == -1) {
-        perror("Connection to server failed");
-        close(tcp_fd);
-        freeaddrinfo(tres);
+    if (strncmp(header, "RST NOK", 7) == 0) {
+        printf("[!] No game available or error occurred for PLID %s.\n", session->plid);
+        gs_tcp_release(client, tcp_fd, 1);
         return;
     }
 
-    freeaddrinfo(tres);
+    if (sscanf(header, "RST %3s %63s %ld", status, fname, &fsize) != 3) {
+        printf("[!] Error: show trials not available at this stage.\n");
+        gs_tcp_release(client, tcp_fd, 0);
+        return;
+    }
 
-    snprintf(tbuffer, MAX_BUFFER_SIZE, "STR %s\n", currentPLID);
-    if (send(tcp_fd, tbuffer, strlen(tbuffer), 0) == -1) {
-        perror("Failed to send STR command");
-        close(tcp_fd);
+    if (strcmp(status, "ACT") != 0 && strcmp(status, "FIN") != 0) {
+        printf("[!] Unrecognized status: %s\n", status);
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
 
-    // Minimal check for NOK before reading until 4 spaces:
-    {
-        char peek_buf[16];
-        int r = recv(tcp_fd, peek_buf, sizeof(peek_buf)-1, MSG_PEEK);
-        if (r <= 0) {
-            perror("Failed to read show trials response");
-            close(tcp_fd);
-            return;
-        }
-        peek_buf[r] = '\0';
-
-        if (strstr(peek_buf, "RST NOK") == peek_buf) {
-            // The server response starts with "RST NOK"
-            // Consume the line until newline
-            while (1) {
-                char c;
-                int rr = recv(tcp_fd, &c, 1, 0);
-                if (rr <= 0 || c == '\n') break;
-            }
-            printf("[!] No game available or error occurred for PLID %s.\n", currentPLID);
-            close(tcp_fd);
-            return;
-        }
+    if (!gs_reader_save_file(&reader, fname, fsize)) {
+        gs_tcp_release(client, tcp_fd, 0);
+        return;
     }
+    gs_tcp_release(client, tcp_fd, 1);
 
-    // If not NOK, proceed with original logic:
-    // Server sends "RST ACT fname fsize " or "RST FIN fname fsize " and then data plus a newline at the end.
+    printf("[+] Received file '%s' (%ld bytes) from server.\n", fname, fsize);
 
-    char header_buffer[MAX_BUFFER_SIZE];
-    int header_len = 0;
-    int space_count = 0;
+    if (strcmp(status, "FIN") == 0) {
+        printf("[+] This game is finished. You can start a new game.\n");
+        reset_player();
+    } else {
+        printf("[+] Ongoing game summary received. You may continue playing.\n");
+    }
 
-    // Read until we have encountered the 4th space:
-    // RST, status, fname, fsize, and then a trailing space -> total 4 spaces.
-    while (space_count < 4) {
-        char c;
-        int r = recv(tcp_fd, &c, 1, 0);
-        if (r <= 0) {
-            perror("recv failed while reading header");
-            close(tcp_fd);
-            return;
-        }
+    print_file(fname);
+}
 
-        if (header_len >= (int)sizeof(header_buffer)-1) {
-            printf("[!] Header too long.\n");
-            close(tcp_fd);
-            return;
-        }
+/**
+ * @brief Handles the "scoreboard" command.
+ *
+ * Sends the "SSB" command over TCP and receives the scoreboard file.
+ *
+ * @param window "DAY" or "WEEK" for a rolling board, "" for the all-time one.
+ */
+void handle_scoreboard_command(const char *window) {
+    int tcp_fd;
+    GSReader reader;
+    char header[MAX_BUFFER_SIZE];
+    char status[6]; 
+    char fname[64];
+    long fsize = 0;
 
-        header_buffer[header_len++] = c;
-        if (c == ' ') {
-            space_count++;
-        }
+    snprintf(header, sizeof(header), "SSB%s%s%s\n", window[0] ? " " : "", window, tcp_keepalive ? KEEPALIVE_TOKEN : "");
+    strcpy(last_reply, "ERROR");
+    if ((tcp_fd = gs_tcp_request(client, header)) == -1) {
+        return;
     }
 
-    header_buffer[header_len] = '\0';
-
-    if (sscanf(header_buffer, "RST %3s %63s %ld", status, fname, &fsize) != 3) {
-        printf("[!] Error: show trials not available at this stage.\n");
-        close(tcp_fd);
+    // Server sends "RSS EMPTY\n", or "RSS OK fname fsize " followed by the data and a newline.
+    gs_reader_init(&reader, tcp_fd);
+    if (!gs_reader_header(&reader, header, sizeof(header))) {
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
+    record_reply(header);
 
-    if (strcmp(status, "ACT") != 0 && strcmp(status, "FIN") != 0) {
-        printf("[!] Unrecognized status: %s\n", status);
-        // consume until newline
-        {
-            char c;
-            while (1) {
-                int rr = recv(tcp_fd, &c, 1, 0);
-                if (rr <= 0) break;
-                if (c == '\n') break;
-            }
-        }
-        close(tcp_fd);
+    if (strncmp(header, "RSS EMPTY", 9) == 0) {
+        printf("[!] The scoreboard is empty. No winners %s.\n", window[0] ? "in this period" : "yet");
+        gs_tcp_release(client, tcp_fd, 1);
         return;
     }
 
-    FILE *file = fopen(fname, "wb");
-    if (!file) {
-        perror("Failed to open local file for writing");
-        close(tcp_fd);
+    if (sscanf(header, "RSS %5s %63s %ld", status, fname, &fsize) != 3) {
+        printf("[!] Invalid response format from server.\n");
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
 
-    // Read exactly fsize bytes of file data
-    long bytes_received = 0;
-    while (bytes_received < fsize) {
-        int to_read = (fsize - bytes_received) < MAX_BUFFER_SIZE ? (int)(fsize - bytes_received) : MAX_BUFFER_SIZE;
-        int n = recv(tcp_fd, tbuffer, to_read, 0);
-        if (n <= 0) {
-            perror("Failed to receive file data");
-            fclose(file);
-            close(tcp_fd);
-            return;
-        }
-        fwrite(tbuffer, 1, n, file);
-        bytes_received += n;
+    if (strcmp(status, "OK") != 0) {
+        printf("[!] Error: %s\n", status);
+        gs_tcp_release(client, tcp_fd, 0);
+        return;
     }
 
-    fclose(file);
-
-    // After data, server sends newline '\n', consume it
-    {
-        char c;
-        while (1) {
-            int rr = recv(tcp_fd, &c, 1, 0);
-            if (rr <= 0) break;
-            if (c == '\n') break;
-        }
+    if (!gs_reader_save_file(&reader, fname, fsize)) {
+        gs_tcp_release(client, tcp_fd, 0);
+        return;
     }
+    gs_tcp_release(client, tcp_fd, 1);
 
-    close(tcp_fd);
+    printf("[+] Received scoreboard file '%s' (%ld bytes) from server.\n", fname, fsize);
+    printf("[+] File '%s' saved successfully.\n", fname);
 
-    printf("[+] Received file '%s' (%ld bytes) from server.\n", fname, fsize);
+    const char *period = !window[0] ? "" : strcmp(window, "DAY") == 0 ? " - last 24 hours" : " - last 7 days";
+    printf("===== Top 10 Scores%s =====\n", period);
+    print_file(fname);
+    printf("\n=========================\n");
+}
 
-    if (strcmp(status, "FIN") == 0) {
-        printf("[+] This game is finished. You can start a new game.\n");
-        reset_player();
-    } else {
-        printf("[+] Ongoing game summary received. You may continue playing.\n");
+/**
+ * @brief Handles the "rank" command.
+ *
+ * Sends "SRK PLID [PLAY|DEBUG]" over TCP and prints the player's best score and
+ * its rank.
+ *
+ * @param PLID The player to look up.
+ * @param view "PLAY", "DEBUG", or "" for both modes.
+ */
+void handle_rank_command(const char *PLID, const char *view) {
+    int tcp_fd;
+    GSReader reader;
+    char header[MAX_BUFFER_SIZE], rest[MAX_BUFFER_SIZE] = "";
+    int rank, total;
+
+    snprintf(header, sizeof(header), "SRK %s%s%s%s\n", PLID, view[0] ? " " : "", view, tcp_keepalive ? KEEPALIVE_TOKEN : "");
+    strcpy(last_reply, "ERROR");
+    if ((tcp_fd = gs_tcp_request(client, header)) == -1) {
+        return;
     }
 
-    file = fopen(fname, "r");
-    if (!file) {
-        perror("Failed to open received trials file for reading");
+    // Server sends "RRK OK rank total SSS PLID KEY N MODE\n", "RRK NOK\n" or "RRK ERR\n"
+    gs_reader_init(&reader, tcp_fd);
+    if (!gs_reader_header(&reader, header, sizeof(header)) ||
+        (header[strlen(header) - 1] != '\n' && !gs_reader_line(&reader, rest, sizeof(rest)))) {
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
-    while (fgets(tbuffer, sizeof(tbuffer), file)) {
-        printf("%s", tbuffer);
+    gs_tcp_release(client, tcp_fd, 1);
+    record_reply(header);
+
+    if (strncmp(header, "RRK NOK", 7) == 0) {
+        printf("[!] No score recorded for PLID %s.\n", PLID);
+    } else if (sscanf(header, "RRK OK %d %d", &rank, &total) == 2) {
+        printf("[+] PLID %s is ranked %d of %d: %s", PLID, rank, total, rest);
+    } else {
+        printf("[!] Invalid rank request.\n");
     }
-    fclose(file);
 }
 
-
-
 /**
- * @brief Handles the "scoreboard" command.
+ * @brief Handles the "scores" command.
  *
- * Sends the "SSB" command over TCP and receives the scoreboard file.
+ * Sends "SPG first count [PLAY|DEBUG]" over TCP and prints the page of the
+ * scoreboard it receives.
+ *
+ * @param first Rank of the first entry.
+ * @param count Number of entries.
+ * @param view "PLAY", "DEBUG", or "" for both modes.
  */
-void handle_scoreboard_command(const char *GSIP, const char *GSPort) {
+void handle_scores_command(int first, int count, const char *view) {
     int tcp_fd;
-    struct addrinfo thints, *tres;
-    char tbuffer[MAX_BUFFER_SIZE];
-
-    char status[6]; 
-    char fname[64];
+    GSReader reader;
+    char header[MAX_BUFFER_SIZE];
+    char status[6], fname[64];
     long fsize = 0;
 
-    memset(&thints, 0, sizeof(thints));
-    thints.ai_family = AF_INET;
-    thints.ai_socktype = SOCK_STREAM;
-
-    if ((errcode = getaddrinfo(GSIP, GSPort, &thints, &tres)) != 0) {
-        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(errcode));
+    snprintf(header, sizeof(header), "SPG %d %d%s%s%s\n", first, count, view[0] ? " " : "", view, tcp_keepalive ? KEEPALIVE_TOKEN : "");
+    strcpy(last_reply, "ERROR");
+    if ((tcp_fd = gs_tcp_request(client, header)) == -1) {
         return;
     }
 
-    tcp_fd = socket(tres->ai_family, tres->ai_socktype, tres->ai_protocol);
-    if (tcp_fd == -1) {
-        perror("TCP socket failed");
-        freeaddrinfo(tres);
+    // Server sends "RPG EMPTY\n", "RPG ERR\n", or "RPG OK fname fsize " followed by the data and a newline.
+    gs_reader_init(&reader, tcp_fd);
+    if (!gs_reader_header(&reader, header, sizeof(header))) {
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
+    record_reply(header);
 
-    if (connect(tcp_fd, tres->ai_addr, tres->ai_addrlen) == -1) {
-        perror("Connection to server failed");
-        close(tcp_fd);
-        freeaddrinfo(tres);
+    if (strncmp(header, "RPG EMPTY", 9) == 0) {
+        printf("[!] No scores at rank %d or below.\n", first);
+        gs_tcp_release(client, tcp_fd, 1);
         return;
     }
 
-    freeaddrinfo(tres);
+    if (sscanf(header, "RPG %5s %63s %ld", status, fname, &fsize) != 3 || strcmp(status, "OK") != 0) {
+        printf("[!] Invalid scores request.\n");
+        gs_tcp_release(client, tcp_fd, 0);
+        return;
+    }
 
-    snprintf(tbuffer, MAX_BUFFER_SIZE, "SSB\n");
-    if (send(tcp_fd, tbuffer, strlen(tbuffer), 0) == -1) {
-        perror("Failed to send SSB command");
-        close(tcp_fd);
+    if (!gs_reader_save_file(&reader, fname, fsize)) {
+        gs_tcp_release(client, tcp_fd, 0);
         return;
     }
+    gs_tcp_release(client, tcp_fd, 1);
 
-    // Minimal check for EMPTY before while < 4:
-    {
-        char peek_buf[16];
-        int r = recv(tcp_fd, peek_buf, sizeof(peek_buf)-1, MSG_PEEK);
-        if (r <= 0) {
-            perror("Failed to read scoreboard response");
-            close(tcp_fd);
-            return;
-        }
-        peek_buf[r] = '\0';
-
-        if (strstr(peek_buf, "RSS EMPTY") == peek_buf) {
-            // The server response starts with "RSS EMPTY"
-            // Consume the line until newline
-            while (1) {
-                char c;
-                int rr = recv(tcp_fd, &c, 1, 0);
-                if (rr <= 0 || c == '\n') break;
-            }
-            printf("[!] The scoreboard is empty. No winners yet.\n");
-            close(tcp_fd);
-            return;
+    printf("[+] Received scores file '%s' (%ld bytes) from server.\n", fname, fsize);
+    print_file(fname);
+    printf("\n");
+}
+
+/**
+ * @brief Parses and executes one player command line.
+ *
+ * @param input_line The command line, without the trailing newline.
+ * @return int 1 if the player asked to exit, 0 otherwise.
+ */
+int execute_command(const char *input_line) {
+    char cmd[16];
+    int matched = sscanf(input_line, "%15s", cmd);
+    if (matched != 1) {
+        printf("Please enter a command.\n");
+        return 0;
+    }
+
+    // Checks if it's one of the program commands
+
+    if (strcmp(cmd, "start") == 0) {
+        char PLID[7];
+        char time_str[16];
+        int count = sscanf(input_line, "%*s %6s %15s", PLID, time_str); 
+        if (count == 2) {
+            handle_start_command(PLID, time_str);
+        } else {
+            printf("Invalid start command. Usage: start <PLID> <time>\n");
         }
-    }
 
-    // If not EMPTY, proceed with original logic:
-    // Server sends "RSS OK fname fsize " and then data and a newline at the end.
+    } else if (strcmp(cmd, "try") == 0) {
+        char C1[2], C2[2], C3[2], C4[2];
+        int count = sscanf(input_line, "%*s %1s %1s %1s %1s", C1, C2, C3, C4);
+        if (count == 4) {
+            handle_try_command(C1, C2, C3, C4);
+        } else {
+            printf("Invalid try command. Usage: try C1 C2 C3 C4\n");
+        }
 
-    char header_buffer[MAX_BUFFER_SIZE];
-    int header_len = 0;
-    int space_count = 0;
+    } else if (strcmp(cmd, "debug") == 0) {
+        char PLID[7], time_str[16], C1[2], C2[2], C3[2], C4[2];
+        int count = sscanf(input_line, "%*s %6s %15s %1s %1s %1s %1s", PLID, time_str, C1, C2, C3, C4);
+        if (count == 6) {
+            handle_debug_command(PLID, time_str, C1, C2, C3, C4);
+        } else {
+            printf("Invalid debug command. Usage: debug PLID time C1 C2 C3 C4\n");
+        }
 
-    // Read until we encounter the 4th space
-    while (space_count < 4) {
-        char c;
-        int r = recv(tcp_fd, &c, 1, 0);
-        if (r <= 0) {
-            perror("Failed to read scoreboard header");
-            close(tcp_fd);
-            return;
+    } else if (strcmp(cmd, "quit") == 0) {
+        handle_quit_command();
+
+    } else if (strcmp(cmd, "exit") == 0) {
+        if (session->active) handle_quit_command();
+        return 1;
+
+    } else if (strcmp(cmd, "show_trials") == 0 || strcmp(cmd, "st") == 0) {
+        handle_show_trials_command();
+
+    } else if (strcmp(cmd, "scoreboard") == 0 || strcmp(cmd, "sb") == 0) {
+        // scoreboard [day|week]
+        char period[8] = "";
+        sscanf(input_line, "%*s %7s", period);
+        if (strcasecmp(period, "day") == 0) {
+            handle_scoreboard_command("DAY");
+        } else if (strcasecmp(period, "week") == 0) {
+            handle_scoreboard_command("WEEK");
+        } else if (period[0] == '\0') {
+            handle_scoreboard_command("");
+        } else {
+            printf("Invalid scoreboard command. Usage: scoreboard [day|week]\n");
         }
-        if (header_len >= (int)sizeof(header_buffer)-1) {
-            printf("[!] Header too long.\n");
-            close(tcp_fd);
-            return;
+
+    } else if (strcmp(cmd, "rank") == 0) {
+        // rank [PLID] [PLAY|DEBUG]; the PLID defaults to the current player's
+        char arg1[8] = "", arg2[8] = "";
+        int count = sscanf(input_line, "%*s %7s %7s", arg1, arg2);
+        const char *PLID = session->plid;
+        const char *view = count == 1 ? arg1 : "";
+        if (count >= 1 && validate_plid(arg1)) {
+            PLID = arg1;
+            view = count == 2 ? arg2 : "";
         }
-        header_buffer[header_len++] = c;
-        if (c == ' ') {
-            space_count++;
+        if (!validate_plid(PLID) || (count == 2 && PLID != arg1)) {
+            printf("Invalid rank command. Usage: rank [PLID] [PLAY|DEBUG]\n");
+        } else {
+            handle_rank_command(PLID, view);
         }
-    }
 
-    header_buffer[header_len] = '\0';
+    } else if (strcmp(cmd, "scores") == 0) {
+        int first, count;
+        char view[8] = "";
+        if (sscanf(input_line, "%*s %d %d %7s", &first, &count, view) >= 2 && first >= 1 && count >= 1) {
+            handle_scores_command(first, count, view);
+        } else {
+            printf("Invalid scores command. Usage: scores FIRST COUNT [PLAY|DEBUG]\n");
+        }
 
-    // Parse line
-    if (sscanf(header_buffer, "RSS %5s %63s %ld", status, fname, &fsize) != 3) {
-        printf("[!] Invalid response format from server.\n");
-        close(tcp_fd);
-        return;
+    } else {
+        printf("Unknown command\n");
     }
+    return 0;
+}
 
-    if (strcmp(status, "OK") != 0) {
-        printf("[!] Error: %s\n", status);
-        // consume until newline
-        {
-            char c;
-            while (1) {
-                int rr = recv(tcp_fd, &c, 1, 0);
-                if (rr <= 0) break;
-                if (c == '\n') break;
-            }
+/**
+ * @brief Runs one command in batch mode and writes its report line.
+ *
+ * @return int 1 if the command asked to exit, 0 otherwise.
+ */
+int run_batch_command(const char *line) {
+    char cmd[16];
+    if (sscanf(line, "%15s", cmd) != 1 || cmd[0] == '#') return 0;
+
+    strcpy(last_reply, "-");
+    long start = now_us();
+    int exit_cmd = execute_command(line);
+    long latency = now_us() - start;
+
+    if (batch.count == batch.capacity) {
+        batch.capacity = batch.capacity ? batch.capacity * 2 : 256;
+        batch.latencies = realloc(batch.latencies, batch.capacity * sizeof(long));
+        if (!batch.latencies) {
+            perror("realloc latencies");
+            exit(1);
         }
-        close(tcp_fd);
-        return;
     }
+    batch.latencies[batch.count++] = latency;
+    if (strcmp(last_reply, "TIMEOUT") == 0) batch.timeouts++;
 
-    // If OK, read fsize bytes of file data
-    FILE *file = fopen(fname, "wb");
-    if (!file) {
-        perror("Failed to open local file for writing");
-        close(tcp_fd);
-        return;
-    }
+    fprintf(batch.report, "%ld\t%s\t%s\t%ld\n", batch.count, cmd, last_reply, latency);
+    return exit_cmd;
+}
 
-    long bytes_received = 0;
-    while (bytes_received < fsize) {
-        int to_read = (fsize - bytes_received) < MAX_BUFFER_SIZE ? (int)(fsize - bytes_received) : MAX_BUFFER_SIZE;
-        int n = recv(tcp_fd, tbuffer, to_read, 0);
-        if (n <= 0) {
-            perror("Failed to receive scoreboard file data");
-            fclose(file);
-            close(tcp_fd);
-            return;
-        }
-        fwrite(tbuffer, 1, n, file);
-        bytes_received += n;
-    }
+int compare_longs(const void *a, const void *b) {
+    long la = *(const long *)a, lb = *(const long *)b;
+    return (la > lb) - (la < lb);
+}
 
-    fclose(file);
+/**
+ * @brief Writes the batch totals line and frees the latency samples.
+ */
+void print_batch_totals(long elapsed_us) {
+    long sum = 0;
+    for (long i = 0; i < batch.count; i++) sum += batch.latencies[i];
+    qsort(batch.latencies, batch.count, sizeof(long), compare_longs);
+
+    long p50 = batch.count ? batch.latencies[batch.count / 2] : 0;
+    long p99 = batch.count ? batch.latencies[(batch.count * 99) / 100] : 0;
+    long max = batch.count ? batch.latencies[batch.count - 1] : 0;
+
+    fprintf(batch.report, "# totals: commands=%ld timeouts=%ld retransmits=%ld elapsed_us=%ld avg_us=%ld p50_us=%ld p99_us=%ld max_us=%ld protocol=%d bytes_out=%ld bytes_in=%ld\n",
+            batch.count, batch.timeouts, client->stats.retransmits, elapsed_us,
+            batch.count ? sum / batch.count : 0, p50, p99, max,
+            client->protocol, client->stats.bytes_sent, client->stats.bytes_received);
+    fflush(batch.report);
+    free(batch.latencies);
+}
 
-    // After data, server sends newline
-    {
-        char c;
-        while (1) {
-            int rr = recv(tcp_fd, &c, 1, 0);
-            if (rr <= 0) break; 
-            if (c == '\n') break;
-        }
-    }
+/**
+ * @brief Plays the current game with the solver until it ends or a try fails.
+ *
+ * Each guess is sent as a regular "try" command; its feedback narrows the
+ * solver's candidates for the next one.
+ */
+void play_solver_game() {
+    Solver solver;
+    if (!solver_init(&solver, GEOMETRY_CLASSIC, solver_mode)) return;
+
+    char line[MAX_BUFFER_SIZE], guess_str[CODE_FMT_LEN];
+    while (session->active && !exit_requested) {
+        Code guess = solver_next_guess(&solver);
+        if (guess == CODE_INVALID) break;
+
+        format_code(guess, COLOR_SEQUENCE_LEN, guess_str);
+        snprintf(line, sizeof(line), "try %s", guess_str);
+        session->last_nB = -1;
+        run_batch_command(line);
+        if (session->last_nB < 0 || solver_feedback(&solver, guess, session->last_nB, session->last_nW) < 0) break;
+    }
+    solver_free(&solver);
+}
 
-    close(tcp_fd);
+/**
+ * @brief Runs the player non-interactively.
+ *
+ * Commands come from script (one per line, '#' starts a comment, "-" is stdin), or
+ * random_games games are generated, with random guesses or, if a solver strategy
+ * was chosen (-s), with the solver's guesses. The usual human-readable
+ * output is discarded; one tab-separated line per command (sequence number,
+ * command, server reply, latency in microseconds) and a totals line are written to
+ * the original stdout instead.
+ */
+void run_batch(const char *script, int random_games) {
+    batch.report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!batch.report || !freopen("/dev/null", "w", stdout)) {
+        perror("Failed to set up batch report");
+        exit(1);
+    }
+    fprintf(batch.report, "seq\tcommand\treply\tlatency_us\n");
 
-    printf("[+] Received scoreboard file '%s' (%ld bytes) from server.\n", fname, fsize);
-    printf("[+] File '%s' saved successfully.\n", fname);
+    char line[MAX_BUFFER_SIZE];
+    long start = now_us();
+    int done = 0;
 
-    FILE *read_file = fopen(fname, "r");
-    if (!read_file) {
-        perror("Failed to open scoreboard file for reading");
-        return;
+    if (script) {
+        FILE *in = strcmp(script, "-") == 0 ? stdin : fopen(script, "r");
+        if (!in) {
+            perror("Failed to open batch script");
+            exit(1);
+        }
+        while (!done && !exit_requested && fgets(line, sizeof(line), in)) {
+            line[strcspn(line, "\n")] = 0;
+            done = run_batch_command(line);
+        }
+        if (in != stdin) fclose(in);
+    } else {
+        const char colors[] = "RGBYOP";
+        srand(time(NULL) ^ getpid());
+        for (int g = 0; g < random_games && !exit_requested; g++) {
+            snprintf(line, sizeof(line), "start %06d %d", 100000 + rand() % 900000, MAX_PLAYTIME);
+            run_batch_command(line);
+
+            if (solver_mode >= 0) {
+                play_solver_game();
+            } else {
+                for (int t = 0; t < MAX_TRIALS && session->active && !exit_requested; t++) {
+                    snprintf(line, sizeof(line), "try %c %c %c %c",
+                             colors[rand() % 6], colors[rand() % 6], colors[rand() % 6], colors[rand() % 6]);
+                    run_batch_command(line);
+                }
+            }
+            if (session->active) run_batch_command("quit");
+        }
     }
 
-    printf("===== Top 10 Scores =====\n");
-    while (fgets(tbuffer, sizeof(tbuffer), read_file)) {
-        printf("%s", tbuffer);
+    if (!done && session->active) {
+        run_batch_command("quit");
     }
-    printf("\n=========================\n");
-    fclose(read_file);
+    print_batch_totals(now_us() - start);
 }
 
-
 /**
  * @brief Main function of the Player application.
  *
  * Initializes the player's UDP connection to the Game Server (GS) and
- * processes commands..
+ * processes commands, interactively or in batch mode (-b script, -r N [-s strategy]).
+ * -P 2 sends UDP requests as binary frames (protocol v2), falling back to text if
+ * the server does not answer them.
  */
 int main(int argc, char *argv[]) {
     char GSIP[256] = DEFAULT_IP;
     char GSPort[16] = DEFAULT_PORT;
+    char *batch_script = NULL;
+    int random_games = 0;
 
     // Handle Ctrl+C
     signal(SIGINT, handle_signal);
@@ -652,48 +777,71 @@ int main(int argc, char *argv[]) {
                 fprintf(stderr, "Error: Missing argument for -p\n");
                 exit(1);
             }
+        } else if(strcmp(argv[i], "-k") == 0) {
+            tcp_keepalive = 1;
+        } else if(strcmp(argv[i], "-b") == 0) {
+            if (i+1 < argc) {
+                batch_script = argv[++i];
+            } else {
+                fprintf(stderr, "Error: Missing argument for -b\n");
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "-r") == 0) {
+            if (i+1 < argc && atoi(argv[i+1]) > 0) {
+                random_games = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: -r needs a positive number of games\n");
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "-s") == 0) {
+            if (i+1 < argc && solver_strategy(argv[i+1]) >= 0) {
+                solver_mode = solver_strategy(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: -s needs a solver strategy (first or minimax)\n");
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "-P") == 0) {
+            if (i+1 < argc && (atoi(argv[i+1]) == 1 || atoi(argv[i+1]) == WIRE_VERSION)) {
+                udp_protocol = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: -P needs a protocol version (1 or %d)\n", WIRE_VERSION);
+                exit(1);
+            }
         }
     }
 
-    printf("Using GSIP: %s and GSPort: %s\n", GSIP, GSPort);
-
-    // Create a UDP socket
-    fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd == -1) {
-        perror("Socket creation failed");
-        exit(1);
+    int batch_mode = batch_script || random_games > 0;
+    if (!batch_mode) {
+        printf("Using GSIP: %s and GSPort: %s\n", GSIP, GSPort);
     }
 
-    // Set a 10-second timeout for UDP responses
-    struct timeval tv;
-    tv.tv_sec = 10;
-    tv.tv_usec = 0;
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        perror("setsockopt failed");
+    // One UDP socket and the resolved server addresses serve every request
+    client = gs_client_open(GSIP, GSPort);
+    if (!client || !(session = gs_session_new(client, "", NULL, NULL))) {
         exit(1);
     }
+    client->tcp_keepalive = tcp_keepalive;
+    client->log_retransmits = 1;
+    client->protocol = udp_protocol;
 
-    // Set up the UDP address information
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
-
-    errcode = getaddrinfo(GSIP, GSPort, &hints, &res);
-    if (errcode != 0) {
-        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(errcode));
-        exit(1);
+    if (batch_mode) {
+        run_batch(batch_script, random_games);
+        gs_session_free(session);
+        gs_client_close(client);
+        return 0;
     }
 
+    // Timeouts are handled per request by the client library; report how they went on exit.
+    atexit(close_client);
+
     char input_line[MAX_BUFFER_SIZE];
     while (1) {
         if (exit_requested) {
             // Ctrl+C pressed
             // Act like "exit" command
-            if (gamestate == 1) {
+            if (session->active) {
                 handle_quit_command();
             }
-            freeaddrinfo(res);
-            close(fd);
             printf("\nExiting player client.\n");
             exit(0);
         }
@@ -704,11 +852,9 @@ int main(int argc, char *argv[]) {
             // EOF or error
             if (feof(stdin)) {
                 // If input closed, act like exit
-                if (gamestate == 1) {
+                if (session->active) {
                     handle_quit_command();
                 }
-                freeaddrinfo(res);
-                close(fd);
                 printf("Exiting player client.\n");
                 exit(0);
             }
@@ -722,65 +868,11 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
-        char cmd[16];
-        int matched = sscanf(input_line, "%15s", cmd);
-        if (matched != 1) {
-            printf("Please enter a command.\n");
-            continue;
-        }
-
-        // Checks if it's one of the program commands
-
-        if (strcmp(cmd, "start") == 0) {
-            char PLID[7];
-            char time_str[16];
-            int count = sscanf(input_line, "%*s %6s %15s", PLID, time_str); 
-            if (count == 2) {
-                handle_start_command(PLID, time_str);
-            } else {
-                printf("Invalid start command. Usage: start <PLID> <time>\n");
-            }
-
-        } else if (strcmp(cmd, "try") == 0) {
-            char C1[2], C2[2], C3[2], C4[2];
-            int count = sscanf(input_line, "%*s %1s %1s %1s %1s", C1, C2, C3, C4);
-            if (count == 4) {
-                handle_try_command(C1, C2, C3, C4);
-            } else {
-                printf("Invalid try command. Usage: try C1 C2 C3 C4\n");
-            }
-
-        } else if (strcmp(cmd, "debug") == 0) {
-            char PLID[7], time_str[16], C1[2], C2[2], C3[2], C4[2];
-            int count = sscanf(input_line, "%*s %6s %15s %1s %1s %1s %1s", PLID, time_str, C1, C2, C3, C4);
-            if (count == 6) {
-                handle_debug_command(PLID, time_str, C1, C2, C3, C4);
-            } else {
-                printf("Invalid debug command. Usage: debug PLID time C1 C2 C3 C4\n");
-            }
-
-        } else if (strcmp(cmd, "quit") == 0) {
-            handle_quit_command();
-
-        } else if (strcmp(cmd, "exit") == 0) {
-            handle_quit_command();
-            freeaddrinfo(res);
-            close(fd);
+        if (execute_command(input_line)) {
             printf("Exiting player client.\n");
             exit(0);
-
-        } else if (strcmp(cmd, "show_trials") == 0 || strcmp(cmd, "st") == 0) {
-            handle_show_trials_command(GSIP, GSPort);
-
-        } else if (strcmp(cmd, "scoreboard") == 0 || strcmp(cmd, "sb") == 0) {
-            handle_scoreboard_command(GSIP, GSPort);
-
-        } else {
-            printf("Unknown command\n");
         }
     }
 
-    freeaddrinfo(res);
-    close(fd);
     return 0;
 }
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Starts NODES GS instances and the proxy in front of them on this machine, runs
+# CLIENTS concurrent batch players (GAMES random games each) through the proxy and
+# prints the aggregate throughput.
+#
+# Usage: proxy/cluster.sh [NODES [CLIENTS [GAMES [PORT]]]]
+
+NODES=${1:-3}
+CLIENTS=${2:-8}
+GAMES=${3:-50}
+PORT=${4:-58100}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+PIDS=""
+trap 'kill $PIDS 2>/dev/null; wait 2>/dev/null; rm -rf "$WORK"' EXIT INT TERM
+
+make -s -C "$ROOT" >/dev/null || exit 1
+
+# Each node keeps its GAMES and SCORES in its own directory and trusts the proxy,
+# which rate-limits each client itself. Every client here shares the address
+# 127.0.0.1, so the proxy runs without a limit (--rate 0).
+SPECS=""
+for n in $(seq 1 "$NODES"); do
+    dir="$WORK/node$n"
+    mkdir -p "$dir/GAMES" "$dir/SCORES"
+    (cd "$dir" && exec "$ROOT/GS/GS" -p $((PORT + n)) --trusted-proxy 127.0.0.1 >gs.log 2>&1) &
+    PIDS="$PIDS $!"
+    SPECS="$SPECS 127.0.0.1:$((PORT + n))"
+done
+"$ROOT/proxy/proxy" -p "$PORT" --rate 0 $SPECS >"$WORK/proxy.log" 2>&1 &
+PIDS="$PIDS $!"
+sleep 0.5
+
+echo "[*] $NODES nodes behind the proxy on port $PORT, $CLIENTS clients x $GAMES games"
+for c in $(seq 1 "$CLIENTS"); do
+    "$ROOT/player/player" -p "$PORT" -r "$GAMES" >"$WORK/client$c.tsv" 2>/dev/null &
+    CLIENT_PIDS="$CLIENT_PIDS $!"
+done
+wait $CLIENT_PIDS
+
+# Aggregate: total commands over the slowest client's wall time
+grep -h '^# totals:' "$WORK"/client*.tsv | awk '
+{
+    for (i = 3; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+    commands += v["commands"]; timeouts += v["timeouts"]; retransmits += v["retransmits"]
+    if (v["elapsed_us"] > elapsed) elapsed = v["elapsed_us"]
+    if (v["p99_us"] > p99) p99 = v["p99_us"]
+}
+END {
+    if (elapsed == 0) { print "[!] No client finished"; exit 1 }
+    printf "[*] %d commands in %.2f s: %.0f commands/s (timeouts %d, retransmits %d, worst client p99 %d us)\n",
+           commands, elapsed / 1e6, commands * 1e6 / elapsed, timeouts, retransmits, p99
+}'
+
+for n in $(seq 1 "$NODES"); do
+    echo "    node$n: $(ls "$WORK/node$n/GAMES" | grep -c "\.arc$") players"
+done
@@ -0,0 +1,1022 @@
+#define _GNU_SOURCE  // recvmmsg
+#include "../common.h"
+#include "../code.h"
+#include "../cluster.h"
+#include "../wire.h"
+#include "../ratelimit.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <time.h>
+
+/*
+ * Cluster front proxy: clients talk to one address; every request carrying a PLID
+ * goes to the GS node owning that PLID on the cluster's hash ring.
+ *
+ * UDP requests are forwarded from one upstream socket with ECHO_TOKEN added, so
+ * each node tags its reply with the PLID; the tag names the client the reply goes
+ * back to (and is removed again unless the client asked for it). TCP connections
+ * are served by forked workers that route each request line separately and relay
+ * the reply, so a kept-alive connection may mix PLIDs owned by different nodes.
+ * Binary (v2) frames carry the PLID in a fixed field and their replies always
+ * echo it, so they are routed the same way and relayed unchanged.
+ * Every datagram reaches a node from the one upstream socket, so the nodes would
+ * rate-limit all clients together: each client is limited here instead (--rate,
+ * --burst, as GS does), and the nodes exempt the proxy (GS --trusted-proxy ADDR).
+ * SSB, SRK and SPG are answered from every node, as a single GS holding all the
+ * scores would answer them: SSB from each node's top 10 (gather_scoreboard), SRK
+ * by counting on every node the entries ranked ahead of the player's best
+ * (gather_rank), SPG by merging the nodes' pages (gather_page). The other requests
+ * without a PLID (SRP) go to the first node.
+ */
+
+#define PROXY_BATCH 64           // Datagrams read per wakeup
+#define PROXY_IDLE_TIMEOUT 30    // Seconds a client TCP connection may stay idle
+#define PROXY_NODE_TIMEOUT 3     // Seconds a node may take to accept a connection, or to send or answer
+#define PLID_SPACE 1000000
+#define SHARD_TOP_K 10           // Entries of an SSB board, and so all a shard can contribute
+#define SCORE_VIEWS 3            // Boards: all-time, DAY, WEEK
+#define SHARD_REPLY_MAX 4096     // Largest STK reply body accepted
+#define SHARD_PAGE 100           // Entries asked of a node per SPE page (GS SCORE_PAGE_MAX)
+#define SHARD_PAGE_REPLY_MAX (SHARD_PAGE * 80)  // Largest SPE reply body accepted
+#define PROXY_PAGE_DEPTH 10000   // Deepest rank SPG is answered for when merging nodes
+
+typedef struct {
+    struct sockaddr_in client;   // Last client that sent a request for this PLID
+    uint8_t in_use;
+    uint8_t tagged;              // The client asked for tagged replies itself
+} ProxyRoute;
+
+typedef struct {
+    int fd;
+    char data[MAX_BUFFER_SIZE];
+    int pos, len;
+} ProxyReader;
+
+typedef struct {
+    int SSS;
+    long end_time;
+    uint32_t plid;
+    char text[64];               // "SSS PLID KEY N MODE", as SSB shows it
+} ShardEntry;
+
+typedef struct {
+    int status;                  // 1 OK, 0 NOK (no score, or busy), -1 ERR
+    int rank, total;             // RBE: on the player's node; RAH: ahead of the entry, and total
+    ShardEntry entry;            // RBE
+} ShardRank;
+
+typedef struct {
+    int count;                   // 0 past the node's last entry
+    ShardEntry entries[SHARD_PAGE];
+} ShardPage;
+
+typedef struct {
+    char lock;                   // Held while a worker reads or replaces the board
+    char generation[48];         // As the shard last reported it; "" if never fetched
+    char fname[64];
+    int count;
+    ShardEntry top[SHARD_TOP_K]; // Best first
+} ShardBoard;
+
+static const char *score_views[SCORE_VIEWS] = { "ALL", "DAY", "WEEK" };
+
+Cluster cluster;
+ProxyRoute *routes;              // Indexed by PLID
+ShardBoard (*shard_boards)[CLUSTER_MAX_NODES];  // [view][node], shared by the TCP workers
+int udp_fd = -1, tcp_fd = -1, upstream_fd = -1;
+int verbose = 0;
+RateLimiter limiter;             // Per-client UDP limit, applied before forwarding
+uint32_t wakeup_ms;              // Monotonic milliseconds at the last wakeup
+unsigned long forwarded = 0, answered = 0, dropped = 0;
+
+/**
+ * @brief Prints the counters and exits.
+ */
+void handle_shutdown(int signum) {
+    (void)signum;
+    printf("\n[*] Forwarded %lu UDP requests, relayed %lu replies, dropped %lu datagrams.\n", forwarded, answered, dropped);
+    if (limiter.drops > 0) printf("[*] Rate limiter dropped %lu UDP datagrams.\n", limiter.drops);
+    exit(0);
+}
+
+/**
+ * @brief Reads the PLID that follows the command of a request ("CMD PLID ...").
+ *
+ * @return 1 if the request carries a valid PLID, 0 otherwise.
+ */
+int request_plid(const char *request, uint32_t *plid) {
+    char PLID[7];
+    if (strlen(request) < 10 || request[3] != ' ') return 0;
+    if (request[10] != '\0' && request[10] != ' ' && request[10] != '\n') return 0;
+    memcpy(PLID, request + 4, 6);
+    PLID[6] = '\0';
+    return parse_plid(PLID, plid);
+}
+
+/**
+ * @brief Returns the reply code of a UDP request, or NULL for unknown commands.
+ */
+const char *reply_code(const char *request) {
+    if (strncmp(request, "SNG", 3) == 0) return "RSG";
+    if (strncmp(request, "TRY", 3) == 0) return "RTR";
+    if (strncmp(request, "DBG", 3) == 0) return "RDB";
+    if (strncmp(request, "QUT", 3) == 0) return "RQT";
+    return NULL;
+}
+
+/**
+ * @brief Answers a binary request here, with a bare status.
+ */
+void answer_frame(const WireRequest *request, uint8_t status, struct sockaddr_in *addr) {
+    WireReply reply = { .version = WIRE_VERSION, .op = request->op, .id = request->id, .plid = request->plid, .status = status };
+    uint8_t frame[WIRE_FRAME_LEN];
+    wire_encode_reply(&reply, frame);
+    sendto(udp_fd, frame, sizeof(frame), 0, (struct sockaddr *)addr, sizeof(*addr));
+}
+
+/**
+ * @brief Reads the PLID of a binary request, answering the requests no node should see.
+ *
+ * @return 1 if the frame is to be forwarded to the owner of plid, 0 otherwise.
+ */
+int frame_plid(const char *data, size_t len, struct sockaddr_in *addr, uint32_t *plid) {
+    WireRequest request;
+    if (!wire_decode_request((const uint8_t *)data, len, &request)) {
+        dropped++;
+        return 0;
+    }
+    // The version first: ops are only defined per version
+    if (request.version != WIRE_VERSION) {
+        answer_frame(&request, WIRE_BADVERSION, addr);
+        return 0;
+    }
+    if (request.op == 0 || request.op >= WIRE_OPS) {
+        dropped++;
+        return 0;
+    }
+    if (request.plid > WIRE_PLID_MAX) {
+        answer_frame(&request, WIRE_ERR, addr);
+        return 0;
+    }
+    *plid = request.plid;
+    return 1;
+}
+
+/**
+ * @brief Forwards one client datagram to the node owning its PLID.
+ *
+ * @param data The datagram, with room for ECHO_TOKEN (MAX_BUFFER_SIZE bytes).
+ * @param len Its length.
+ * @param addr The client.
+ */
+void forward_request(char *data, size_t len, struct sockaddr_in *addr) {
+    if (!rate_limiter_allow(&limiter, addr->sin_addr.s_addr, wakeup_ms)) return;
+
+    uint32_t plid;
+    int binary = wire_is_binary(data, len);
+    if (binary && !frame_plid(data, len, addr, &plid)) return;
+
+    data[len] = '\0';
+    if (!binary && !request_plid(data, &plid)) {
+        // No node can tag the reply to an invalid request; answer it here
+        const char *code = reply_code(data);
+        if (code) {
+            char reply[16];
+            int n = snprintf(reply, sizeof(reply), "%s ERR\n", code);
+            sendto(udp_fd, reply, n, 0, (struct sockaddr *)addr, sizeof(*addr));
+        } else {
+            dropped++;
+        }
+        return;
+    }
+
+    size_t end = (len > 0 && data[len - 1] == '\n') ? len - 1 : len;
+    size_t tlen = strlen(ECHO_TOKEN);
+    int tagged = binary || (end > tlen && strncmp(data + end - tlen, ECHO_TOKEN, tlen) == 0);
+    if (!tagged) {
+        if (len + tlen >= MAX_BUFFER_SIZE) {
+            dropped++;
+            return;
+        }
+        memmove(data + end + tlen, data + end, len - end);
+        memcpy(data + end, ECHO_TOKEN, tlen);
+        len += tlen;
+    }
+
+    ProxyRoute *route = &routes[plid];
+    route->client = *addr;
+    route->in_use = 1;
+    route->tagged = tagged;
+
+    const ClusterNode *node = &cluster.nodes[cluster_owner(&cluster, plid)];
+    if (sendto(upstream_fd, data, len, 0, (const struct sockaddr *)&node->addr, sizeof(node->addr)) < 0) {
+        perror("sendto node failed");
+        return;
+    }
+    forwarded++;
+    if (verbose) {
+        if (binary) printf("UDP %06u -> %s: v%d %s\n", plid, node->name, data[0], wire_command(data[1]));
+        else printf("UDP %06u -> %s: %.*s\n", plid, node->name, (int)end, data);
+    }
+}
+
+/**
+ * @brief Sends a node's reply back to the client of its PLID.
+ *
+ * @param data The reply, ending with " PLID\n", or a binary reply frame.
+ * @param len Its length.
+ * @param from The node that sent it.
+ */
+void relay_reply(char *data, size_t len, struct sockaddr_in *from) {
+    int known = 0;
+    for (int i = 0; i < cluster.count && !known; i++) {
+        known = cluster.nodes[i].addr.sin_addr.s_addr == from->sin_addr.s_addr &&
+                cluster.nodes[i].addr.sin_port == from->sin_port;
+    }
+
+    WireReply frame;
+    if (wire_is_binary(data, len)) {
+        if (!known || !wire_decode_reply((const uint8_t *)data, len, &frame) || frame.plid > WIRE_PLID_MAX ||
+            !routes[frame.plid].in_use) {
+            dropped++;
+            return;
+        }
+        sendto(udp_fd, data, len, 0, (struct sockaddr *)&routes[frame.plid].client, sizeof(routes[frame.plid].client));
+        answered++;
+        return;
+    }
+
+    data[len] = '\0';
+    char *tag = len > 8 && data[len - 1] == '\n' ? data + len - 8 : NULL;
+    uint32_t plid;
+    if (!known || !tag || tag[0] != ' ' || (tag[7] = '\0', !parse_plid(tag + 1, &plid)) || !routes[plid].in_use) {
+        dropped++;
+        return;
+    }
+    tag[7] = '\n';
+
+    ProxyRoute *route = &routes[plid];
+    if (!route->tagged) {
+        tag[0] = '\n';
+        len -= 7;
+    }
+    sendto(udp_fd, data, len, 0, (struct sockaddr *)&route->client, sizeof(route->client));
+    answered++;
+}
+
+/**
+ * @brief Reads every queued datagram of a socket and hands each to a handler.
+ */
+void drain_datagrams(int fd, void (*handler)(char *, size_t, struct sockaddr_in *)) {
+    static char datagrams[PROXY_BATCH][MAX_BUFFER_SIZE];
+    static struct sockaddr_in addrs[PROXY_BATCH];
+    struct mmsghdr msgs[PROXY_BATCH];
+    struct iovec iovs[PROXY_BATCH];
+
+    for (int i = 0; i < PROXY_BATCH; i++) {
+        // Leave room for the echo token and a terminator
+        iovs[i].iov_base = datagrams[i];
+        iovs[i].iov_len = MAX_BUFFER_SIZE - 1 - strlen(ECHO_TOKEN);
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int count = recvmmsg(fd, msgs, PROXY_BATCH, MSG_DONTWAIT, NULL);
+    if (count == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("recvmmsg failed");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        handler(datagrams[i], msgs[i].msg_len, &addrs[i]);
+    }
+}
+
+/**
+ * @brief Fills the reader's buffer when it is empty.
+ *
+ * @return 1 if data is available, 0 on end of stream, error or timeout.
+ */
+int reader_fill(ProxyReader *r) {
+    if (r->pos < r->len) return 1;
+    int n;
+    do {
+        n = recv(r->fd, r->data, sizeof(r->data), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return 0;
+    r->pos = 0;
+    r->len = n;
+    return 1;
+}
+
+/**
+ * @brief Reads up to and including a newline, or up to the given number of spaces.
+ *
+ * @param spaces Stop after this many spaces (0 for a whole line).
+ * @return The length read (the text is NUL-terminated), 0 on failure.
+ */
+int reader_token(ProxyReader *r, char *out, int size, int spaces) {
+    int len = 0, seen = 0;
+    while (len < size - 1 && reader_fill(r)) {
+        char c = r->data[r->pos++];
+        out[len++] = c;
+        if (c == '\n' || (c == ' ' && spaces > 0 && ++seen == spaces)) {
+            out[len] = '\0';
+            return len;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes exactly len bytes to a stream socket.
+ */
+int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        data += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Copies a node's reply to one request to the client.
+ *
+ * Single-line replies are copied through the newline; file replies (RST/RSS/RPG
+ * OK|ACT|FIN fname size data) through the announced size and the final newline.
+ *
+ * @return 1 once the whole reply was copied, 0 if the node or client failed.
+ */
+int relay_tcp_reply(ProxyReader *node, int client_fd) {
+    char header[MAX_BUFFER_SIZE];
+    int len = reader_token(node, header, sizeof(header), 4);
+    if (len == 0 || !write_all(client_fd, header, len)) return 0;
+    if (header[len - 1] == '\n') return 1;
+
+    long size;
+    int file = (strncmp(header, "RST", 3) == 0 || strncmp(header, "RSS", 3) == 0 || strncmp(header, "RPG", 3) == 0) &&
+               sscanf(header, "%*s %*s %*s %ld", &size) == 1 && size >= 0;
+    if (!file) {
+        len = reader_token(node, header, sizeof(header), 0);
+        return len > 0 && write_all(client_fd, header, len);
+    }
+
+    for (size++; size > 0; ) {  // The data and its newline
+        if (!reader_fill(node)) return 0;
+        int chunk = node->len - node->pos < size ? node->len - node->pos : size;
+        if (!write_all(client_fd, node->data + node->pos, chunk)) return 0;
+        node->pos += chunk;
+        size -= chunk;
+    }
+    return 1;
+}
+
+/**
+ * @brief Finds the board an SSB request asks for ("SSB", "SSB DAY", "SSB WEEK").
+ *
+ * @param end Length of the line without its newline.
+ * @return Index in score_views, or -1 if the request is not a valid SSB.
+ */
+int scoreboard_view(const char *line, int end, int keepalive) {
+    if (keepalive) end -= strlen(KEEPALIVE_TOKEN);
+    if (end == 3) return 0;
+    for (int v = 1; v < SCORE_VIEWS; v++) {
+        int n = strlen(score_views[v]);
+        if (end == 4 + n && line[3] == ' ' && strncmp(line + 4, score_views[v], n) == 0) return v;
+    }
+    return -1;
+}
+
+/**
+ * @brief Opens a TCP connection to a node.
+ *
+ * The connect and every later send or receive on the socket give up after
+ * PROXY_NODE_TIMEOUT, so a node that stopped answering fails like one that is down
+ * instead of holding the worker (and its client) forever.
+ *
+ * @return The connected socket, or -1.
+ */
+int connect_node(const ClusterNode *node) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1) return -1;
+    int error = 0;
+    if (connect(fd, (const struct sockaddr *)&node->addr, sizeof(node->addr)) == -1) {
+        error = errno;
+        if (error == EINPROGRESS) {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            socklen_t error_len = sizeof(error);
+            int ready;
+            do {
+                ready = poll(&pfd, 1, PROXY_NODE_TIMEOUT * 1000);
+            } while (ready == -1 && errno == EINTR);
+            if (ready == 0) error = ETIMEDOUT;
+            else if (ready == -1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1) error = errno;
+        }
+    }
+    if (error != 0) {
+        fprintf(stderr, "[!] connect to %s failed: %s\n", node->name, strerror(error));
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    struct timeval tv = { .tv_sec = PROXY_NODE_TIMEOUT, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+/**
+ * @brief Copies a shard's cached board into board, or (store) board into the cache.
+ */
+void shard_board_exchange(ShardBoard *cached, ShardBoard *board, int store) {
+    while (__atomic_test_and_set(&cached->lock, __ATOMIC_ACQUIRE)) ;
+    if (store) {
+        memcpy(cached->generation, board->generation, sizeof(board->generation));
+        memcpy(cached->fname, board->fname, sizeof(board->fname));
+        cached->count = board->count;
+        memcpy(cached->top, board->top, board->count * sizeof(ShardEntry));
+    } else {
+        memcpy(board->generation, cached->generation, sizeof(board->generation));
+        memcpy(board->fname, cached->fname, sizeof(board->fname));
+        board->count = cached->count;
+        memcpy(board->top, cached->top, cached->count * sizeof(ShardEntry));
+    }
+    __atomic_clear(&cached->lock, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Reads the data of a file reply and its final newline.
+ *
+ * @param data Receives size bytes, NUL-terminated (size + 1 bytes of room).
+ * @return 1 on success, 0 if the node failed.
+ */
+int read_shard_data(ProxyReader *node, char *data, long size) {
+    for (long got = 0; got < size + 1; ) {  // The data and its newline
+        if (!reader_fill(node)) return 0;
+        int chunk = node->len - node->pos < size + 1 - got ? node->len - node->pos : size + 1 - got;
+        memcpy(data + got, node->data + node->pos, chunk);
+        node->pos += chunk;
+        got += chunk;
+    }
+    data[size] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Parses a node's "END SSS PLID KEY N MODE" line (STK, SPE).
+ *
+ * @return 1 if the line is valid.
+ */
+int parse_shard_entry(const char *line, ShardEntry *e) {
+    int skip;
+    if (sscanf(line, "%ld %n%d %u", &e->end_time, &skip, &e->SSS, &e->plid) != 3) return 0;
+    snprintf(e->text, sizeof(e->text), "%s", line + skip);
+    return 1;
+}
+
+/**
+ * @brief Reads a shard's answer to STK into board.
+ *
+ * "RTK SAME gen" leaves board (the cached copy) as it is; "RTK EMPTY gen" and
+ * "RTK OK gen fname size data" replace it.
+ *
+ * @return 1 if board changed, 0 if it is unchanged, -1 if the shard failed.
+ */
+int read_shard_board(ProxyReader *node, ShardBoard *board) {
+    char header[MAX_BUFFER_SIZE], status[16], generation[sizeof(board->generation)], fname[sizeof(board->fname)];
+    long size = 0;
+    int len = reader_token(node, header, sizeof(header), 5);
+    if (len == 0 || sscanf(header, "RTK %15s %47s %63s %ld", status, generation, fname, &size) < 2) return -1;
+    if (strcmp(status, "SAME") == 0) return 0;
+    if (strcmp(status, "EMPTY") == 0) {
+        strcpy(board->generation, generation);
+        board->count = 0;
+        return 1;
+    }
+    if (strcmp(status, "OK") != 0 || size < 0 || size >= SHARD_REPLY_MAX) return -1;
+
+    char data[SHARD_REPLY_MAX + 1];
+    if (!read_shard_data(node, data, size)) return -1;
+
+    strcpy(board->generation, generation);
+    strcpy(board->fname, fname);
+    board->count = 0;
+    for (char *line = strtok(data, "\n"); line && board->count < SHARD_TOP_K; line = strtok(NULL, "\n")) {
+        if (parse_shard_entry(line, &board->top[board->count])) board->count++;
+    }
+    return 1;
+}
+
+/**
+ * @brief Orders entries of different shards as SSB does: higher score, then earlier win.
+ */
+int compare_shard_entries(const ShardEntry *a, const ShardEntry *b) {
+    if (a->SSS != b->SSS) return b->SSS - a->SSS;
+    if (a->end_time != b->end_time) return a->end_time < b->end_time ? -1 : 1;
+    if (a->plid != b->plid) return a->plid < b->plid ? -1 : 1;
+    return strcmp(a->text, b->text);
+}
+
+/**
+ * @brief Answers SSB with the global board merged from every node's board.
+ *
+ * Every node is asked for its top entries at once, each "STK view gen" naming the
+ * generation cached for it, so unchanged nodes answer in one short line and only
+ * changed ones send their board. The per-node boards (best first) are then merged
+ * k ways into the top 10. A node that fails, or does not answer within
+ * PROXY_NODE_TIMEOUT, contributes its last cached board.
+ *
+ * @param view Index in score_views.
+ * @return 1 if the client was answered, 0 if writing to it failed.
+ */
+int gather_scoreboard(ProxyReader *nodes, int view, int keepalive, int client_fd) {
+    ShardBoard boards[CLUSTER_MAX_NODES];
+    int sent[CLUSTER_MAX_NODES];
+    char request[MAX_BUFFER_SIZE];
+
+    for (int i = 0; i < cluster.count; i++) {
+        shard_board_exchange(&shard_boards[view][i], &boards[i], 0);
+        int len = snprintf(request, sizeof(request), "STK %s%s%s%s\n", score_views[view],
+                           boards[i].generation[0] ? " " : "", boards[i].generation, keepalive ? KEEPALIVE_TOKEN : "");
+        sent[i] = 0;
+        for (int attempt = 0; attempt < 2 && !sent[i]; attempt++) {
+            if (nodes[i].fd == -1) {
+                nodes[i].fd = connect_node(&cluster.nodes[i]);
+                nodes[i].pos = nodes[i].len = 0;
+                if (nodes[i].fd == -1) break;
+            }
+            sent[i] = write_all(nodes[i].fd, request, len);
+            if (!sent[i]) {
+                close(nodes[i].fd);
+                nodes[i].fd = -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < cluster.count; i++) {
+        int changed = sent[i] ? read_shard_board(&nodes[i], &boards[i]) : -1;
+        if (changed == 1) shard_board_exchange(&shard_boards[view][i], &boards[i], 1);
+        if (changed < 0 && verbose) printf("[!] %s did not answer STK; using its cached board\n", cluster.nodes[i].name);
+        if ((changed < 0 || !keepalive) && nodes[i].fd != -1) {
+            close(nodes[i].fd);
+            nodes[i].fd = -1;
+        }
+    }
+
+    // k-way merge of the per-node boards
+    int heads[CLUSTER_MAX_NODES] = { 0 };
+    const char *fname = "scoreboard.txt";
+    char payload[SHARD_TOP_K * 64];
+    size_t len = 0;
+    for (int count = 0; count < SHARD_TOP_K; count++) {
+        int best = -1;
+        for (int i = 0; i < cluster.count; i++) {
+            if (heads[i] == boards[i].count) continue;
+            if (best == -1 || compare_shard_entries(&boards[i].top[heads[i]], &boards[best].top[heads[best]]) < 0) best = i;
+        }
+        if (best == -1) break;
+        len += snprintf(payload + len, sizeof(payload) - len, "%s%s", count > 0 ? "\n" : "", boards[best].top[heads[best]].text);
+        fname = boards[best].fname;
+        heads[best]++;
+    }
+
+    if (len == 0) return write_all(client_fd, "RSS EMPTY\n", 10);
+    char header[MAX_BUFFER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "RSS OK %s %zu ", fname, len);
+    return write_all(client_fd, header, header_len) && write_all(client_fd, payload, len) && write_all(client_fd, "\n", 1);
+}
+
+/**
+ * @brief Sends a request to a node and reads its reply, on a connection kept open.
+ *
+ * The request must end with KEEPALIVE_TOKEN. A kept connection the node has closed
+ * is reconnected once; a node that timed out is not asked again.
+ *
+ * @param read Reads the reply into out; returns 0 if the node failed.
+ * @return 1 if the reply was read, 0 if the node failed.
+ */
+int ask_node(ProxyReader *nodes, int n, const char *request, int len, int (*read)(ProxyReader *, void *), void *out) {
+    ProxyReader *node = &nodes[n];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (node->fd == -1) {
+            node->fd = connect_node(&cluster.nodes[n]);
+            node->pos = node->len = 0;
+            if (node->fd == -1) return 0;
+        }
+        errno = 0;
+        if (write_all(node->fd, request, len) && read(node, out)) return 1;
+        int timed_out = errno == EAGAIN || errno == EWOULDBLOCK;
+        close(node->fd);
+        node->fd = -1;
+        if (timed_out) break;
+    }
+    if (verbose) printf("[!] %s did not answer %.3s\n", cluster.nodes[n].name, request);
+    return 0;
+}
+
+/**
+ * @brief Closes the node connections, unless the client keeps its own open.
+ */
+void release_nodes(ProxyReader *nodes, int keepalive) {
+    for (int i = 0; i < cluster.count && !keepalive; i++) {
+        if (nodes[i].fd != -1) close(nodes[i].fd);
+        nodes[i].fd = -1;
+    }
+}
+
+/**
+ * @brief Reads "RBE OK rank total END SSS PLID KEY N MODE", "RBE NOK" or "RBE ERR".
+ */
+int read_best_entry(ProxyReader *node, void *out) {
+    ShardRank *r = out;
+    char line[MAX_BUFFER_SIZE], status[8];
+    int skip = 0;
+    if (!reader_token(node, line, sizeof(line), 0) || sscanf(line, "RBE %7s %n", status, &skip) != 1) return 0;
+    line[strcspn(line, "\n")] = '\0';
+    r->status = strcmp(status, "OK") == 0 ? 1 : strcmp(status, "NOK") == 0 ? 0 : -1;
+    int next;
+    if (r->status == 1 && (sscanf(line + skip, "%d %d %n", &r->rank, &r->total, &next) != 2 ||
+                           !parse_shard_entry(line + skip + next, &r->entry))) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads "RAH OK ahead total", "RAH NOK" or "RAH ERR".
+ */
+int read_rank_ahead(ProxyReader *node, void *out) {
+    ShardRank *r = out;
+    char line[MAX_BUFFER_SIZE], status[8];
+    if (!reader_token(node, line, sizeof(line), 0) || sscanf(line, "RAH %7s", status) != 1) return 0;
+    r->status = strcmp(status, "OK") == 0 ? 1 : strcmp(status, "NOK") == 0 ? 0 : -1;
+    return r->status != 1 || sscanf(line, "RAH OK %d %d", &r->rank, &r->total) == 2;
+}
+
+/**
+ * @brief Answers SRK with the player's rank among the scores of every node.
+ *
+ * The player's node gives its best entry (SBE) and its rank there; every other
+ * node counts the entries of the view ranked ahead of that entry (SAH). The global
+ * rank is one plus all entries ahead. If a node fails, the client gets the reply
+ * GS gives when busy.
+ *
+ * @param args The request after "SRK", without the keep-alive token or newline.
+ * @return 1 if the client was answered, 0 if writing to it failed.
+ */
+int gather_rank(ProxyReader *nodes, const char *args, int keepalive, int client_fd) {
+    char copy[MAX_BUFFER_SIZE], request[MAX_BUFFER_SIZE], reply[MAX_BUFFER_SIZE];
+    char *fields[3], *save = NULL;
+    int n = 0;
+    snprintf(copy, sizeof(copy), "%s", args);
+    for (char *tok = strtok_r(copy, " ", &save); tok && n < 3; tok = strtok_r(NULL, " ", &save)) fields[n++] = tok;
+    uint32_t plid;
+    if (n < 1 || n > 2 || !parse_plid(fields[0], &plid)) return write_all(client_fd, "RRK ERR\n", 8);
+    const char *view = n == 2 ? fields[1] : "";
+
+    ShardRank best, ahead;
+    int owner = cluster_owner(&cluster, plid);
+    int len = snprintf(request, sizeof(request), "SBE %s%s%s%s\n", fields[0], n == 2 ? " " : "", view, KEEPALIVE_TOKEN);
+    int ok = ask_node(nodes, owner, request, len, read_best_entry, &best);
+    if (ok && best.status == 1) {
+        char mode[8] = "";
+        sscanf(best.entry.text, "%*d %*u %*s %*d %7s", mode);
+        len = snprintf(request, sizeof(request), "SAH %ld %d %06u %s%s%s%s\n", best.entry.end_time, best.entry.SSS,
+                       best.entry.plid, mode, n == 2 ? " " : "", view, KEEPALIVE_TOKEN);
+        for (int i = 0; ok && i < cluster.count; i++) {
+            if (i == owner) continue;
+            ok = ask_node(nodes, i, request, len, read_rank_ahead, &ahead) && ahead.status == 1;
+            best.rank += ahead.rank;
+            best.total += ahead.total;
+        }
+    }
+    release_nodes(nodes, keepalive);
+
+    if (ok && best.status == 1) len = snprintf(reply, sizeof(reply), "RRK OK %d %d %s\n", best.rank, best.total, best.entry.text);
+    else len = snprintf(reply, sizeof(reply), "RRK %s\n", ok && best.status < 0 ? "ERR" : "NOK");
+    return write_all(client_fd, reply, len);
+}
+
+/**
+ * @brief Reads "RPE OK fname size data", "RPE EMPTY" or "RPE ERR" into a page.
+ */
+int read_page(ProxyReader *node, void *out) {
+    ShardPage *page = out;
+    char header[MAX_BUFFER_SIZE], status[8];
+    long size;
+    page->count = 0;
+    if (!reader_token(node, header, sizeof(header), 4) || sscanf(header, "RPE %7s", status) != 1) return 0;
+    if (strcmp(status, "EMPTY") == 0) return 1;
+    if (strcmp(status, "OK") != 0 || sscanf(header, "RPE OK %*s %ld", &size) != 1 || size < 0 ||
+        size >= SHARD_PAGE_REPLY_MAX) {
+        return 0;
+    }
+
+    char data[SHARD_PAGE_REPLY_MAX + 1];
+    if (!read_shard_data(node, data, size)) return 0;
+    char *save = NULL;
+    for (char *line = strtok_r(data, "\n", &save); line && page->count < SHARD_PAGE; line = strtok_r(NULL, "\n", &save)) {
+        if (parse_shard_entry(line, &page->entries[page->count])) page->count++;
+    }
+    return 1;
+}
+
+/**
+ * @brief Answers SPG with a page of the scores of every node, in SSB order.
+ *
+ * Every node's entries are read in rank order, SHARD_PAGE at a time as the merge
+ * consumes them (SPE), and merged k ways up to the last rank asked for, so ranks
+ * deeper than PROXY_PAGE_DEPTH are refused (RPG ERR). If a node fails, the client
+ * gets the reply GS gives when busy.
+ *
+ * @param args The request after "SPG", without the keep-alive token or newline.
+ * @return 1 if the client was answered, 0 if writing to it failed.
+ */
+int gather_page(ProxyReader *nodes, const char *args, int keepalive, int client_fd) {
+    char copy[MAX_BUFFER_SIZE], request[MAX_BUFFER_SIZE];
+    char *fields[4], *save = NULL;
+    int n = 0;
+    snprintf(copy, sizeof(copy), "%s", args);
+    for (char *tok = strtok_r(copy, " ", &save); tok && n < 4; tok = strtok_r(NULL, " ", &save)) fields[n++] = tok;
+    int numbers = n >= 2 && strlen(fields[0]) <= 9 && strlen(fields[1]) <= 9 &&
+                  strspn(fields[0], "0123456789") == strlen(fields[0]) && strspn(fields[1], "0123456789") == strlen(fields[1]);
+    int first = numbers ? atoi(fields[0]) : 0, count = numbers ? atoi(fields[1]) : 0;
+    if (n > 3 || first < 1 || count < 1 || (n == 3 && strcmp(fields[2], "PLAY") != 0 && strcmp(fields[2], "DEBUG") != 0)) {
+        return write_all(client_fd, "RPG ERR\n", 8);
+    }
+    if (count > SHARD_PAGE) count = SHARD_PAGE;
+    if (first > PROXY_PAGE_DEPTH - count + 1) return write_all(client_fd, "RPG ERR\n", 8);
+    const char *view = n == 3 ? fields[2] : "";
+
+    static ShardPage pages[CLUSTER_MAX_NODES];  // Workers serve one client each
+    int pos[CLUSTER_MAX_NODES], next[CLUSTER_MAX_NODES], done[CLUSTER_MAX_NODES];
+    for (int i = 0; i < cluster.count; i++) {
+        pages[i].count = pos[i] = done[i] = 0;
+        next[i] = 1;  // Rank of the node's next entry to ask for
+    }
+
+    char payload[SHARD_PAGE * 80];
+    size_t len = 0;
+    int ok = 1, last = 0;
+    for (int rank = 1; ok && rank < first + count; rank++) {
+        int best = -1;
+        for (int i = 0; ok && i < cluster.count; i++) {
+            if (pos[i] == pages[i].count && !done[i]) {
+                int rlen = snprintf(request, sizeof(request), "SPE %d %d%s%s%s\n", next[i], SHARD_PAGE,
+                                    n == 3 ? " " : "", view, KEEPALIVE_TOKEN);
+                ok = ask_node(nodes, i, request, rlen, read_page, &pages[i]);
+                pos[i] = 0;
+                next[i] += pages[i].count;
+                done[i] = pages[i].count < SHARD_PAGE;  // A short page is the node's last
+            }
+            if (!ok || pos[i] == pages[i].count) continue;
+            if (best == -1 || compare_shard_entries(&pages[i].entries[pos[i]], &pages[best].entries[pos[best]]) < 0) best = i;
+        }
+        if (!ok || best == -1) break;
+        if (rank >= first) {
+            len += snprintf(payload + len, sizeof(payload) - len, "%s%d %s", len > 0 ? "\n" : "", rank, pages[best].entries[pos[best]].text);
+            last = rank;
+        }
+        pos[best]++;
+    }
+    release_nodes(nodes, keepalive);
+
+    // A failed node gets the answer of a busy GS
+    if (!ok || len == 0) return write_all(client_fd, "RPG EMPTY\n", 10);
+    char header[MAX_BUFFER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "RPG OK scores_%d_%d.txt %zu ", first, last, len);
+    return write_all(client_fd, header, header_len) && write_all(client_fd, payload, len) && write_all(client_fd, "\n", 1);
+}
+
+/**
+ * @brief Serves one client TCP connection (in a worker process).
+ *
+ * Each request line is sent to its node over a connection kept per node while the
+ * client keeps its own connection alive; a node that closed a kept connection is
+ * reconnected once. A node that timed out is not asked again. If no node answers,
+ * the client gets the reply GS gives when busy.
+ *
+ * @param client_fd The client connection.
+ */
+void handle_tcp_client(int client_fd) {
+    ProxyReader client = { .fd = client_fd };
+    ProxyReader nodes[CLUSTER_MAX_NODES];
+    for (int i = 0; i < cluster.count; i++) nodes[i].fd = -1;
+
+    struct timeval tv = { .tv_sec = PROXY_IDLE_TIMEOUT, .tv_usec = 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char line[MAX_BUFFER_SIZE];
+    int len;
+    while ((len = reader_token(&client, line, sizeof(line), 0)) > 0) {
+        uint32_t plid;
+        int routed = (strncmp(line, "STR", 3) == 0 || strncmp(line, "SRK", 3) == 0) && request_plid(line, &plid);
+        int n = routed ? cluster_owner(&cluster, plid) : 0;
+        size_t tlen = strlen(KEEPALIVE_TOKEN);
+        int end = line[len - 1] == '\n' ? len - 1 : len;
+        if (end > 0 && line[end - 1] == '\r') end--;
+        int keepalive = end > (int)tlen && strncmp(line + end - tlen, KEEPALIVE_TOKEN, tlen) == 0;
+
+        int view = strncmp(line, "SSB", 3) == 0 && cluster.count > 1 ? scoreboard_view(line, end, keepalive) : -1;
+        if (view >= 0) {
+            if (!gather_scoreboard(nodes, view, keepalive, client_fd)) break;
+            if (verbose) printf("TCP SSB %s <- %d nodes\n", score_views[view], cluster.count);
+            if (!keepalive) break;
+            continue;
+        }
+
+        int rank = strncmp(line, "SRK", 3) == 0, page = strncmp(line, "SPG", 3) == 0;
+        if (cluster.count > 1 && (rank || page) && (end == 3 || line[3] == ' ')) {
+            char args[MAX_BUFFER_SIZE];
+            int args_len = end - 3 - (keepalive ? (int)tlen : 0);
+            snprintf(args, sizeof(args), "%.*s", args_len > 0 ? args_len : 0, line + 3);
+            if (!(rank ? gather_rank : gather_page)(nodes, args, keepalive, client_fd)) break;
+            if (verbose) printf("TCP %.3s <- %d nodes\n", line, cluster.count);
+            if (!keepalive) break;
+            continue;
+        }
+
+        int ok = 0;
+        for (int attempt = 0; attempt < 2 && !ok; attempt++) {
+            ProxyReader *node = &nodes[n];
+            if (node->fd == -1) {
+                node->fd = connect_node(&cluster.nodes[n]);
+                node->pos = node->len = 0;
+                if (node->fd == -1) break;
+            }
+            errno = 0;
+            ok = write_all(node->fd, line, len) && relay_tcp_reply(node, client_fd);
+            int timed_out = !ok && (errno == EAGAIN || errno == EWOULDBLOCK);
+            if (!ok || !keepalive) {
+                close(node->fd);
+                node->fd = -1;
+            }
+            if (timed_out) {
+                if (verbose) printf("[!] %s did not answer %.3s in time\n", cluster.nodes[n].name, line);
+                break;
+            }
+        }
+        if (!ok) {
+            // Same answers as a saturated GS
+            const char *busy = strncmp(line, "SSB", 3) == 0 ? "RSS EMPTY\n" : strncmp(line, "SRK", 3) == 0 ? "RRK NOK\n" :
+                               strncmp(line, "SPG", 3) == 0 ? "RPG EMPTY\n" : "RST NOK\n";
+            write_all(client_fd, busy, strlen(busy));
+            break;
+        }
+        if (verbose) printf("TCP %.3s -> %s\n", line, cluster.nodes[n].name);
+        if (!keepalive) break;
+    }
+
+    for (int i = 0; i < cluster.count; i++) {
+        if (nodes[i].fd != -1) close(nodes[i].fd);
+    }
+}
+
+/**
+ * @brief Binds the client-facing UDP socket and TCP listener, and the upstream UDP socket.
+ */
+void open_sockets(const char *port) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    int errcode = getaddrinfo(NULL, port, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(errcode));
+        exit(1);
+    }
+    udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp_fd == -1 || bind(udp_fd, res->ai_addr, res->ai_addrlen) == -1) {
+        perror("UDP bind failed");
+        exit(1);
+    }
+
+    tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (tcp_fd == -1 || bind(tcp_fd, res->ai_addr, res->ai_addrlen) == -1 || listen(tcp_fd, 128) == -1) {
+        perror("TCP bind failed");
+        exit(1);
+    }
+    freeaddrinfo(res);
+
+    upstream_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (upstream_fd == -1) {
+        perror("Socket creation failed");
+        exit(1);
+    }
+}
+
+/**
+ * @brief Prints the command-line usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p port] [-v] [--rate N] [--burst N] host:port [host:port ...]\n", prog);
+    fprintf(stderr, "  Routes the GS protocol by PLID to the listed GS nodes.\n");
+    fprintf(stderr, "  --rate/--burst limit each client's UDP datagrams (defaults %d/s, %d; rate 0 disables);\n",
+            RATE_DEFAULT, RATE_DEFAULT_BURST);
+    fprintf(stderr, "  start the nodes with --trusted-proxy set to this proxy's address.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *port = DEFAULT_PORT;
+    unsigned rate = RATE_DEFAULT, burst = RATE_DEFAULT_BURST;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+            burst = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else if (cluster_add_node(&cluster, argv[i]) == -1) {
+            return 1;
+        }
+    }
+    if (cluster.count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    cluster_build(&cluster);
+    rate_limiter_configure(&limiter, rate, burst, verbose);
+
+    routes = calloc(PLID_SPACE, sizeof(ProxyRoute));
+    if (!routes) {
+        perror("calloc routes");
+        return 1;
+    }
+    shard_boards = mmap(NULL, SCORE_VIEWS * sizeof(*shard_boards), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shard_boards == MAP_FAILED) {
+        perror("mmap shard boards");
+        return 1;
+    }
+    open_sockets(port);
+    signal(SIGINT, handle_shutdown);
+    signal(SIGTERM, handle_shutdown);
+    signal(SIGCHLD, SIG_IGN);  // Workers are reaped automatically
+
+    printf("[*] Proxy on port %s routing to %d nodes:", port, cluster.count);
+    for (int i = 0; i < cluster.count; i++) printf(" %s", cluster.nodes[i].name);
+    printf("\n");
+    fflush(stdout);
+
+    while (1) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(udp_fd, &read_fds);
+        FD_SET(upstream_fd, &read_fds);
+        FD_SET(tcp_fd, &read_fds);
+        int max_fd = udp_fd > upstream_fd ? udp_fd : upstream_fd;
+        if (tcp_fd > max_fd) max_fd = tcp_fd;
+
+        if (select(max_fd + 1, &read_fds, NULL, NULL, NULL) < 0) {
+            if (errno != EINTR) perror("Select error");
+            continue;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        wakeup_ms = (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+
+        if (FD_ISSET(upstream_fd, &read_fds)) drain_datagrams(upstream_fd, relay_reply);
+        if (FD_ISSET(udp_fd, &read_fds)) drain_datagrams(udp_fd, forward_request);
+
+        if (FD_ISSET(tcp_fd, &read_fds)) {
+            int client_fd = accept(tcp_fd, NULL, NULL);
+            if (client_fd == -1) {
+                if (errno != EINTR) perror("Accept failed");
+                continue;
+            }
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(udp_fd);
+                close(upstream_fd);
+                close(tcp_fd);
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+                handle_tcp_client(client_fd);
+                close(client_fd);
+                exit(0);
+            }
+            if (pid < 0) perror("fork failed");
+            close(client_fd);
+        }
+    }
+    return 0;
+}
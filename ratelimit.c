@@ -0,0 +1,105 @@
+#include "ratelimit.h"
+
+/**
+ * @brief Sets the per-source limit, forgetting every bucket (trusted sources are kept).
+ *
+ * @param rate Datagrams per second allowed per source address; 0 disables limiting.
+ * @param burst Datagrams a source may send at once after being idle (at least 1).
+ * @param verbose Print a line when a source starts being limited or a bucket is evicted.
+ */
+void rate_limiter_configure(RateLimiter *l, unsigned rate, unsigned burst, int verbose) {
+    l->rate_per_sec = rate;
+    l->burst = burst > 0 ? burst : 1;
+    l->verbose = verbose;
+    l->drops = 0;
+    memset(l->table, 0, sizeof(l->table));
+}
+
+/**
+ * @brief Exempts a source from the limit.
+ *
+ * @param host Host name or IPv4 address, resolved once.
+ * @return 1 on success, 0 if it cannot be resolved or too many are trusted.
+ */
+int rate_limiter_trust(RateLimiter *l, const char *host) {
+    if (l->trusted_count == RATE_TRUSTED_MAX) {
+        fprintf(stderr, "Too many trusted sources (at most %d)\n", RATE_TRUSTED_MAX);
+        return 0;
+    }
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    int errcode = getaddrinfo(host, NULL, &hints, &res);
+    if (errcode != 0) {
+        fprintf(stderr, "getaddrinfo error for %s: %s\n", host, gai_strerror(errcode));
+        return 0;
+    }
+    l->trusted[l->trusted_count++] = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return 1;
+}
+
+/**
+ * @brief Charges one datagram to its source address.
+ *
+ * @param addr The source IPv4 address (network byte order).
+ * @param now_ms Monotonic milliseconds; datagrams of one wakeup may share the instant.
+ * @return 1 if the datagram may be processed, 0 if it must be dropped.
+ */
+int rate_limiter_allow(RateLimiter *l, uint32_t addr, uint32_t now_ms) {
+    if (l->rate_per_sec == 0) return 1;
+    for (int i = 0; i < l->trusted_count; i++) {
+        if (l->trusted[i] == addr) return 1;
+    }
+
+    uint32_t now = now_ms;
+    uint32_t full = l->burst * 1000;                  // Tokens are kept in thousandths
+    uint32_t refill_ms = full / l->rate_per_sec + 1;  // Time for an empty bucket to refill
+    uint32_t start = (addr * 2654435761u) >> 20 & (RATE_TABLE_SIZE - 1);
+
+    RateBucket *bucket = NULL, *victim = NULL;
+    for (int i = 0; i < RATE_PROBE; i++) {
+        RateBucket *b = &l->table[(start + i) & (RATE_TABLE_SIZE - 1)];
+        if (b->in_use && b->addr == addr) {
+            bucket = b;
+            break;
+        }
+        // Prefer an unused slot, then the one idle the longest
+        if (!victim || (victim->in_use && (!b->in_use || now - b->last_ms > now - victim->last_ms))) {
+            victim = b;
+        }
+    }
+
+    if (!bucket) {
+        // A fully refilled bucket is as good as a fresh one, so reusing it loses nothing
+        bucket = victim;
+        if (bucket->in_use && now - bucket->last_ms < refill_ms && l->verbose) {
+            printf("[*] Rate limiter table busy, evicting %s\n", inet_ntoa((struct in_addr){ bucket->addr }));
+        }
+        bucket->in_use = 1;
+        bucket->addr = addr;
+        bucket->tokens = full;
+        bucket->drops = 0;
+    } else {
+        uint32_t elapsed = now - bucket->last_ms;
+        if (elapsed >= refill_ms) {
+            bucket->tokens = full;
+            bucket->drops = 0;
+        } else {
+            uint64_t tokens = bucket->tokens + (uint64_t)elapsed * l->rate_per_sec;
+            bucket->tokens = tokens > full ? full : (uint32_t)tokens;
+        }
+    }
+    bucket->last_ms = now;
+
+    if (bucket->tokens < 1000) {
+        l->drops++;
+        if (bucket->drops++ == 0 && l->verbose) {
+            printf("[*] Rate limiting %s\n", inet_ntoa((struct in_addr){ addr }));
+        }
+        return 0;
+    }
+    bucket->tokens -= 1000;
+    return 1;
+}
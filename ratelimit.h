@@ -0,0 +1,50 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Per-source token buckets for a UDP port (GS, and the cluster proxy in front of
+ * GS nodes).
+ *
+ * Each source IPv4 address gets a bucket of up to `burst` tokens refilled at `rate`
+ * tokens per second; a datagram costs one token and is dropped unanswered when the
+ * bucket is empty. Buckets live in a fixed open-addressing table probed over a short
+ * window. A bucket idle long enough to have refilled completely carries no state, so
+ * it counts as free and is reused (aging); if the whole window is busy, the least
+ * recently seen bucket is evicted.
+ *
+ * Trusted sources are never limited: a proxy sends every client's datagrams from
+ * one address and limits each client itself.
+ */
+
+#define RATE_TABLE_SIZE 4096  // UDP sources tracked by the rate limiter (power of two)
+#define RATE_PROBE 8          // Slots searched per source before evicting
+#define RATE_DEFAULT 200      // UDP datagrams per second allowed per source (--rate)
+#define RATE_DEFAULT_BURST 400  // Datagrams a source may send at once (--burst)
+#define RATE_TRUSTED_MAX 8    // Sources exempt from the limit (--trusted-proxy)
+
+typedef struct {
+    uint32_t addr;      // Source IPv4 address, network byte order
+    uint32_t tokens;    // Thousandths of a token
+    uint32_t last_ms;   // Last datagram seen from this source
+    uint32_t drops;     // Datagrams dropped since the bucket last ran full
+    uint8_t in_use;
+} RateBucket;
+
+typedef struct {
+    RateBucket table[RATE_TABLE_SIZE];
+    uint32_t rate_per_sec;              // 0 disables limiting
+    uint32_t burst;
+    uint32_t trusted[RATE_TRUSTED_MAX]; // Network byte order
+    int trusted_count;
+    unsigned long drops;
+    int verbose;                        // Report limited sources and evictions
+} RateLimiter;
+
+void rate_limiter_configure(RateLimiter *l, unsigned rate, unsigned burst, int verbose);
+int rate_limiter_trust(RateLimiter *l, const char *host);
+int rate_limiter_allow(RateLimiter *l, uint32_t addr, uint32_t now_ms);
+
+#endif
@@ -0,0 +1,171 @@
+#include "solver.h"
+
+/*
+ * Opening book of one geometry and strategy: the first guess, every code of the
+ * space grouped by its feedback against that guess, and the minimax reply to each
+ * feedback. Built on first use and shared by every solver of the process (the
+ * programs using them are single-threaded).
+ */
+struct SolverOpening {
+    Code guess;
+    Code *split;                           // All codes, grouped by feedback class
+    uint32_t start[FEEDBACK_CLASSES + 1];  // Group c is split[start[c] .. start[c + 1])
+    Code second[FEEDBACK_CLASSES];         // Minimax second guess, CODE_INVALID until computed
+};
+
+static struct SolverOpening *openings[NUM_GEOMETRIES][2];
+
+// Returns SOLVER_FIRST or SOLVER_MINIMAX for "first" or "minimax", -1 otherwise
+int solver_strategy(const char *name) {
+    if (strcmp(name, "first") == 0) return SOLVER_FIRST;
+    if (strcmp(name, "minimax") == 0) return SOLVER_MINIMAX;
+    return -1;
+}
+
+/*
+ * Picks the candidate whose worst feedback class is smallest. Guesses and the codes
+ * they are scored against are evenly spaced samples of the candidates, so a move
+ * costs at most SOLVER_MINIMAX_GUESSES x SOLVER_MINIMAX_SAMPLE scores.
+ */
+static Code minimax_pick(const Geometry *g, const Code *candidates, uint32_t count) {
+    static Code sample[SOLVER_MINIMAX_SAMPLE];
+    uint32_t sample_step = (count + SOLVER_MINIMAX_SAMPLE - 1) / SOLVER_MINIMAX_SAMPLE;
+    uint32_t guess_step = (count + SOLVER_MINIMAX_GUESSES - 1) / SOLVER_MINIMAX_GUESSES;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i += sample_step) {
+        sample[n++] = candidates[i];
+    }
+
+    Code best = candidates[0];
+    uint32_t best_worst = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i += guess_step) {
+        uint32_t counts[FEEDBACK_CLASSES] = {0};
+        g->tally(sample, n, candidates[i], counts);
+
+        uint32_t worst = 0;
+        for (int c = 0; c < FEEDBACK_CLASSES; c++) {
+            if (counts[c] > worst) worst = counts[c];
+        }
+        if (worst < best_worst) {
+            best_worst = worst;
+            best = candidates[i];
+        }
+    }
+    return best;
+}
+
+// Returns the opening book of a geometry and strategy, building it if needed; NULL if out of memory
+static struct SolverOpening *get_opening(int geometry, int strategy) {
+    if (openings[geometry][strategy]) return openings[geometry][strategy];
+
+    const Geometry *g = &geometries[geometry];
+    struct SolverOpening *o = calloc(1, sizeof(*o));
+    Code *space = malloc(g->space * sizeof(Code));
+    uint8_t *classes = malloc(g->space);
+    if (o) o->split = malloc(g->space * sizeof(Code));
+    if (!o || !o->split || !space || !classes) {
+        perror("malloc solver opening");
+        if (o) free(o->split);
+        free(o);
+        free(space);
+        free(classes);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < g->space; i++) {
+        space[i] = code_from_index(g, i);
+    }
+    o->guess = strategy == SOLVER_MINIMAX ? minimax_pick(g, space, g->space) : space[0];
+
+    // Counting sort of the space by feedback against the opening guess
+    uint32_t counts[FEEDBACK_CLASSES] = {0};
+    for (uint32_t i = 0; i < g->space; i++) {
+        int nB, nW;
+        g->score(o->guess, space[i], &nB, &nW);
+        classes[i] = FEEDBACK_CLASS(nB, nW);
+        counts[classes[i]]++;
+    }
+    for (int c = 0; c < FEEDBACK_CLASSES; c++) {
+        o->start[c + 1] = o->start[c] + counts[c];
+        o->second[c] = CODE_INVALID;
+    }
+    uint32_t next[FEEDBACK_CLASSES];
+    memcpy(next, o->start, sizeof(next));
+    for (uint32_t i = 0; i < g->space; i++) {
+        o->split[next[classes[i]]++] = space[i];
+    }
+
+    free(space);
+    free(classes);
+    openings[geometry][strategy] = o;
+    return o;
+}
+
+// Starts a solver for a new game; returns 0 if the opening book cannot be built
+int solver_init(Solver *s, int geometry, int strategy) {
+    struct SolverOpening *o = get_opening(geometry, strategy);
+    if (!o) return 0;
+    s->geometry = &geometries[geometry];
+    s->strategy = strategy;
+    s->opening = o;
+    s->candidates = o->split;
+    s->count = s->geometry->space;
+    s->owned = 0;
+    s->first_class = -1;
+    s->guesses = 0;
+    return 1;
+}
+
+// Releases the solver's own candidate set
+void solver_free(Solver *s) {
+    if (s->owned) free(s->candidates);
+    s->candidates = NULL;
+    s->count = 0;
+    s->owned = 0;
+}
+
+// Returns the next guess to play, or CODE_INVALID if no code fits the feedback given
+Code solver_next_guess(Solver *s) {
+    if (s->count == 0) return CODE_INVALID;
+    if (s->guesses == 0) return s->opening->guess;
+    if (s->strategy == SOLVER_FIRST || s->count == 1) return s->candidates[0];
+
+    if (s->first_class >= 0 && s->guesses == 1) {
+        // Right after the opening the candidates only depend on its feedback
+        Code *second = &s->opening->second[s->first_class];
+        if (*second == CODE_INVALID) {
+            *second = minimax_pick(s->geometry, s->candidates, s->count);
+        }
+        return *second;
+    }
+    return minimax_pick(s->geometry, s->candidates, s->count);
+}
+
+// Keeps only the candidates consistent with guess scoring (nB, nW); returns how many remain,
+// -1 on error or on feedback no guess of the geometry can get
+int solver_feedback(Solver *s, Code guess, int nB, int nW) {
+    const Geometry *g = s->geometry;
+    struct SolverOpening *o = s->opening;
+    if (nB < 0 || nW < 0 || nB + nW > g->pegs) return -1;
+
+    if (s->guesses == 0 && guess == o->guess) {
+        int c = FEEDBACK_CLASS(nB, nW);
+        s->first_class = c;
+        s->candidates = o->split + o->start[c];
+        s->count = o->start[c + 1] - o->start[c];
+    } else if (!s->owned) {
+        Code *own = malloc((s->count ? s->count : 1) * sizeof(Code));
+        if (!own) {
+            perror("malloc candidates");
+            return -1;
+        }
+        s->count = g->filter(s->candidates, s->count, own, guess, nB, nW);
+        Code *shrunk = realloc(own, (s->count ? s->count : 1) * sizeof(Code));
+        s->candidates = shrunk ? shrunk : own;
+        s->owned = 1;
+    } else {
+        s->count = g->filter(s->candidates, s->count, s->candidates, guess, nB, nW);
+    }
+    s->guesses++;
+    return s->count;
+}
@@ -0,0 +1,41 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "code.h"
+
+/*
+ * Automated Mastermind player. A Solver keeps the candidate codes that agree with
+ * every (guess, feedback) pair seen so far and picks its next guess among them.
+ *
+ * Every game of a geometry and strategy opens with the same guess, so the candidates
+ * left by each possible first feedback are computed once and shared; a solver only
+ * allocates its own (much smaller) set from the second feedback on, so many games
+ * can be played side by side.
+ */
+
+#define SOLVER_FIRST 0            // Play the first consistent candidate
+#define SOLVER_MINIMAX 1          // Play the candidate whose worst-case feedback leaves fewest codes
+
+#define SOLVER_MINIMAX_GUESSES 256   // Candidate guesses scored per minimax move
+#define SOLVER_MINIMAX_SAMPLE 2048   // Candidates each minimax guess is scored against
+
+struct SolverOpening;
+
+typedef struct {
+    const Geometry *geometry;
+    int strategy;
+    struct SolverOpening *opening;  // Shared first move of this geometry and strategy
+    Code *candidates;   // Shared until the second feedback, then owned
+    uint32_t count;
+    int owned;
+    int first_class;    // FEEDBACK_CLASS of the opening, -1 before it is known
+    int guesses;        // Guesses played so far
+} Solver;
+
+int solver_strategy(const char *name);
+int solver_init(Solver *s, int geometry, int strategy);
+void solver_free(Solver *s);
+Code solver_next_guess(Solver *s);
+int solver_feedback(Solver *s, Code guess, int nB, int nW);
+
+#endif
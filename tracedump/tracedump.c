@@ -0,0 +1,227 @@
+#include "../GS/GS.h"
+
+/*
+ * Reads a GS request trace (GS --trace FILE) and prints, per request, the time
+ * spent in each phase; or a per-command summary of the phases (-s); or the trace
+ * in Chrome trace format (-c), for chrome://tracing or Perfetto.
+ */
+
+#define MAX_COMMANDS 16  // Distinct commands in the summary
+
+static const char *phase_names[TRACE_PHASES] = {
+    "recv", "parse", "lookup", "dupscan", "score", "persist", "render", "send", "done",
+};
+
+typedef struct {
+    char command[4];
+    long count;
+    long *samples[TRACE_PHASES + 1];  // Per phase, then the whole request (ns)
+    long used[TRACE_PHASES + 1];
+    long size[TRACE_PHASES + 1];
+} CommandStats;
+
+/**
+ * @brief Prints the command-line usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s | -c] TRACEFILE\n", prog);
+    fprintf(stderr, "  (default)  one line per request with the time spent in each phase\n");
+    fprintf(stderr, "  -s         per-command summary: mean, p50, p99 and max of each phase\n");
+    fprintf(stderr, "  -c         Chrome trace format (JSON) on stdout\n");
+}
+
+/**
+ * @brief Orders events by process, then request, then time.
+ */
+int compare_events(const void *a, const void *b) {
+    const TraceEvent *x = a, *y = b;
+    if (x->pid != y->pid) return x->pid < y->pid ? -1 : 1;
+    if (x->request != y->request) return x->request < y->request ? -1 : 1;
+    if (x->ts_ns != y->ts_ns) return x->ts_ns < y->ts_ns ? -1 : 1;
+    return (int)x->phase - (int)y->phase;
+}
+
+/**
+ * @brief Orders durations ascending.
+ */
+int compare_longs(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Loads every event of a trace file.
+ *
+ * @param path The trace file.
+ * @param count Set to the number of events.
+ * @return A malloc'd array of events, or NULL on error (reported).
+ */
+TraceEvent *load_trace(const char *path, size_t *count) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != TRACE_MAGIC) {
+        fprintf(stderr, "%s: not a GS trace file\n", path);
+        fclose(file);
+        return NULL;
+    }
+    if (header.version != TRACE_VERSION || header.event_size != sizeof(TraceEvent)) {
+        fprintf(stderr, "%s: unsupported trace version %u\n", path, header.version);
+        fclose(file);
+        return NULL;
+    }
+
+    size_t size = 4096, n = 0;
+    TraceEvent *events = malloc(size * sizeof(TraceEvent));
+    while (events) {
+        if (n == size) {
+            TraceEvent *grown = realloc(events, 2 * size * sizeof(TraceEvent));
+            if (!grown) {
+                free(events);
+                events = NULL;
+                break;
+            }
+            events = grown;
+            size *= 2;
+        }
+        size_t got = fread(events + n, sizeof(TraceEvent), size - n, file);
+        n += got;
+        if (got == 0) break;
+    }
+    fclose(file);
+    if (!events) {
+        perror("malloc");
+        return NULL;
+    }
+    *count = n;
+    return events;
+}
+
+/**
+ * @brief Adds a sample to a growable array.
+ */
+void add_sample(CommandStats *stats, int slot, long value) {
+    if (stats->used[slot] == stats->size[slot]) {
+        stats->size[slot] = stats->size[slot] ? 2 * stats->size[slot] : 256;
+        stats->samples[slot] = realloc(stats->samples[slot], stats->size[slot] * sizeof(long));
+        if (!stats->samples[slot]) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    stats->samples[slot][stats->used[slot]++] = value;
+}
+
+/**
+ * @brief Prints mean, p50, p99 and max (microseconds) of one set of samples.
+ */
+void print_distribution(const char *name, long *samples, long n) {
+    if (n == 0) return;
+    qsort(samples, n, sizeof(long), compare_longs);
+    double sum = 0;
+    for (long i = 0; i < n; i++) sum += samples[i];
+    printf("  %-8s %8ld %10.1f %10.1f %10.1f %10.1f\n", name, n, sum / n / 1000.0,
+           samples[n / 2] / 1000.0, samples[n * 99 / 100] / 1000.0, samples[n - 1] / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    int summary = 0, chrome = 0;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            summary = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            chrome = 1;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path || (summary && chrome)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t count;
+    TraceEvent *events = load_trace(path, &count);
+    if (!events) return 1;
+
+    uint64_t origin = UINT64_MAX;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].ts_ns < origin) origin = events[i].ts_ns;
+    }
+    qsort(events, count, sizeof(TraceEvent), compare_events);
+
+    CommandStats stats[MAX_COMMANDS];
+    int commands = 0;
+    memset(stats, 0, sizeof(stats));
+    int first = 1;
+    if (chrome) printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    // One request per run of events with the same process and request number
+    for (size_t start = 0, end; start < count; start = end) {
+        for (end = start + 1; end < count && events[end].pid == events[start].pid &&
+                               events[end].request == events[start].request; end++) ;
+        const TraceEvent *e = &events[start];
+        char command[4];
+        memcpy(command, e->command, 3);
+        command[3] = '\0';
+        long total = events[end - 1].ts_ns - e->ts_ns;
+
+        if (chrome) {
+            printf("%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"plid\":\"%06u\",\"request\":%u}}",
+                   first ? "" : ",\n", command[0] ? command : "?", e->pid, e->pid,
+                   (e->ts_ns - origin) / 1000.0, total / 1000.0, e->plid, e->request);
+            first = 0;
+            for (size_t i = start + 1; i < end; i++) {
+                const TraceEvent *p = &events[i - 1], *q = &events[i];
+                if (q->phase >= TRACE_PHASES) continue;
+                printf(",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                       phase_names[q->phase], q->pid, q->pid,
+                       (p->ts_ns - origin) / 1000.0, (q->ts_ns - p->ts_ns) / 1000.0);
+            }
+        } else if (summary) {
+            int c = 0;
+            while (c < commands && strcmp(stats[c].command, command) != 0) c++;
+            if (c == commands) {
+                if (commands == MAX_COMMANDS) continue;
+                strcpy(stats[commands++].command, command);
+            }
+            stats[c].count++;
+            for (size_t i = start + 1; i < end; i++) {
+                if (events[i].phase < TRACE_PHASES) {
+                    add_sample(&stats[c], events[i].phase, events[i].ts_ns - events[i - 1].ts_ns);
+                }
+            }
+            add_sample(&stats[c], TRACE_PHASES, total);
+        } else {
+            printf("%u %u %s %06u at %.3f ms: %.1f us", e->pid, e->request, command,
+                   e->plid, (e->ts_ns - origin) / 1e6, total / 1000.0);
+            for (size_t i = start + 1; i < end; i++) {
+                if (events[i].phase >= TRACE_PHASES) continue;
+                printf(" %s=%.1f", phase_names[events[i].phase], (events[i].ts_ns - events[i - 1].ts_ns) / 1000.0);
+            }
+            printf("\n");
+        }
+    }
+
+    if (chrome) printf("\n]}\n");
+    for (int c = 0; c < commands; c++) {
+        printf("%s: %ld requests\n", stats[c].command, stats[c].count);
+        printf("  %-8s %8s %10s %10s %10s %10s\n", "phase", "count", "mean us", "p50 us", "p99 us", "max us");
+        for (int p = 1; p < TRACE_PHASES; p++) {
+            print_distribution(phase_names[p], stats[c].samples[p], stats[c].used[p]);
+        }
+        print_distribution("total", stats[c].samples[TRACE_PHASES], stats[c].used[TRACE_PHASES]);
+        for (int p = 0; p <= TRACE_PHASES; p++) free(stats[c].samples[p]);
+    }
+
+    free(events);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "wire.h"
+
+static const char *wire_commands[WIRE_OPS] = { "???", "SNG", "TRY", "DBG", "QUT" };
+static const char *wire_reply_codes[WIRE_OPS] = { "R??", "RSG", "RTR", "RDB", "RQT" };
+static const char *wire_statuses[WIRE_STATUSES] = { "OK", "NOK", "ERR", "DUP", "INV", "ENT", "ETM", "ERR" };
+
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint16_t get16(const uint8_t *p) {
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Writes a request frame (WIRE_FRAME_LEN bytes) into out
+void wire_encode_request(const WireRequest *r, uint8_t *out) {
+    out[0] = r->version;
+    out[1] = r->op;
+    put16(out + 2, r->id);
+    put32(out + 4, r->plid);
+    put32(out + 8, r->code);
+    put16(out + 12, r->arg);
+    out[14] = r->pegs;
+    out[15] = r->colors;
+}
+
+// Reads a request frame of any version; returns 0 if it is not a whole frame
+int wire_decode_request(const uint8_t *data, size_t len, WireRequest *r) {
+    if (len != WIRE_FRAME_LEN) return 0;
+    r->version = data[0];
+    r->op = data[1];
+    r->id = get16(data + 2);
+    r->plid = get32(data + 4);
+    r->code = get32(data + 8);
+    r->arg = get16(data + 12);
+    r->pegs = data[14];
+    r->colors = data[15];
+    return 1;
+}
+
+// Writes a reply frame (WIRE_FRAME_LEN bytes) into out
+void wire_encode_reply(const WireReply *r, uint8_t *out) {
+    out[0] = r->version;
+    out[1] = r->op;
+    put16(out + 2, r->id);
+    put32(out + 4, r->plid);
+    out[8] = r->status;
+    out[9] = r->trial;
+    out[10] = r->nB;
+    out[11] = r->nW;
+    put32(out + 12, r->code);
+}
+
+// Reads a reply frame; returns 0 if it is not a whole frame
+int wire_decode_reply(const uint8_t *data, size_t len, WireReply *r) {
+    if (len != WIRE_FRAME_LEN) return 0;
+    r->version = data[0];
+    r->op = data[1];
+    r->id = get16(data + 2);
+    r->plid = get32(data + 4);
+    r->status = data[8];
+    r->trial = data[9];
+    r->nB = data[10];
+    r->nW = data[11];
+    r->code = get32(data + 12);
+    return 1;
+}
+
+// Text command of an op ("TRY"), "???" if unknown
+const char *wire_command(int op) {
+    return op > 0 && op < WIRE_OPS ? wire_commands[op] : wire_commands[0];
+}
+
+// Text reply code of an op ("RTR"), "R??" if unknown
+const char *wire_reply_code(int op) {
+    return op > 0 && op < WIRE_OPS ? wire_reply_codes[op] : wire_reply_codes[0];
+}
+
+// Text status of a reply ("OK"); unknown statuses read as "ERR"
+const char *wire_status(int status) {
+    return status >= 0 && status < WIRE_STATUSES ? wire_statuses[status] : "ERR";
+}
+
+/*
+ * Writes the text (v1) form of a reply, newline included: "RTR OK 2 1 0",
+ * "RQT OK R G B Y", "RSG NOK". pegs is the length of the key in r->code.
+ * Returns the length written.
+ */
+int wire_reply_text(const WireReply *r, int pegs, char *out, size_t size) {
+    const char *code = wire_reply_code(r->op), *status = wire_status(r->status);
+    if (r->op == WIRE_TRY && r->status == WIRE_OK) {
+        return snprintf(out, size, "%s %s %d %d %d\n", code, status, r->trial, r->nB, r->nW);
+    }
+    int keyed = (r->op == WIRE_TRY && (r->status == WIRE_ENT || r->status == WIRE_ETM)) ||
+                (r->op == WIRE_QUT && r->status == WIRE_OK);
+    if (keyed && pegs > 0 && pegs <= MAX_PEGS) {
+        char key[CODE_FMT_LEN];
+        format_code(r->code, pegs, key);
+        return snprintf(out, size, "%s %s %s\n", code, status, key);
+    }
+    return snprintf(out, size, "%s %s\n", code, status);
+}
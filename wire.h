@@ -0,0 +1,67 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include "code.h"
+
+/*
+ * Binary UDP framing (protocol v2). Requests and replies are fixed 16-byte frames
+ * of little-endian fields; the first byte is the protocol version. Text (v1)
+ * requests start with a letter, so GS tells the two apart by that byte alone and
+ * answers each request in the protocol it came in. A client opts in by sending v2
+ * frames; a server that does not speak the version it got answers
+ * WIRE_BADVERSION in the highest version it does speak, or (older servers) not at
+ * all, and the client falls back to text.
+ *
+ * Request: version, op, id (u16), PLID (u32), code (u32), arg (u16), pegs, colors
+ * Reply:   version, op, id (u16), PLID (u32), status, trial, nB, nW, code (u32)
+ *
+ * The request ID is echoed in the reply, as is the PLID (v2 replies are always
+ * tagged). code is a packed Code: the guess of TRY, the key of DBG, the secret key
+ * in replies ENT, ETM and QUT OK. arg is the play time of SNG/DBG and the trial
+ * number of TRY. pegs and colors select the geometry of SNG/DBG (4, 6 for the
+ * classic game) and give the peg count of a TRY guess.
+ */
+
+#define WIRE_VERSION 2
+#define WIRE_FRAME_LEN 16
+#define WIRE_MAX_VERSION 0x1f    // A datagram starting with a byte up to this is binary
+#define WIRE_PLID_MAX 999999
+
+enum { WIRE_SNG = 1, WIRE_TRY, WIRE_DBG, WIRE_QUT, WIRE_OPS };
+enum { WIRE_OK = 0, WIRE_NOK, WIRE_ERR, WIRE_DUP, WIRE_INV, WIRE_ENT, WIRE_ETM, WIRE_BADVERSION, WIRE_STATUSES };
+
+typedef struct {
+    uint8_t version;
+    uint8_t op;
+    uint16_t id;
+    uint32_t plid;
+    uint32_t code;
+    uint16_t arg;
+    uint8_t pegs, colors;
+} WireRequest;
+
+typedef struct {
+    uint8_t version;
+    uint8_t op;
+    uint16_t id;
+    uint32_t plid;
+    uint8_t status;
+    uint8_t trial, nB, nW;
+    uint32_t code;
+} WireReply;
+
+static inline int wire_is_binary(const void *data, size_t len) {
+    return len > 0 && *(const uint8_t *)data <= WIRE_MAX_VERSION;
+}
+
+void wire_encode_request(const WireRequest *r, uint8_t *out);
+int wire_decode_request(const uint8_t *data, size_t len, WireRequest *r);
+void wire_encode_reply(const WireReply *r, uint8_t *out);
+int wire_decode_reply(const uint8_t *data, size_t len, WireReply *r);
+const char *wire_command(int op);
+const char *wire_reply_code(int op);
+const char *wire_status(int status);
+int wire_reply_text(const WireReply *r, int pegs, char *out, size_t size);
+
+#endif